@@ -27,6 +27,11 @@ EXTERNC LandruNode_t* landruCreateRootNode();
 EXTERNC int   landruParseProgram(LandruNode_t* rootNode, 
 //                                 std::vector<std::pair<std::string, Json::Value*> >* jsonVars,
                                  char const* buff, size_t len);
+// Parses each file into a root node of its own, on up to threads threads,
+// or one per core if threads is 0. roots[i] receives the program parsed
+// from paths[i], or null if it couldn't be read. Errors are printed in the
+// order of the files. Returns the number of files that failed.
+EXTERNC int   landruParseFiles(char const*const* paths, size_t count, LandruNode_t** roots, int threads);
 EXTERNC void  landruPrintAST(LandruNode_t* rootNode);
 EXTERNC void  landruPrintRawAST(LandruNode_t* rootNode);
 EXTERNC void  landruToJson(LandruNode_t* rootNode);
@@ -37,13 +42,49 @@ EXTERNC void landruInitializeStdLib(LandruLibrary_t* library, LandruVMContext_t*
 
 EXTERNC LandruAssembler_t* landruCreateAssembler(LandruLibrary_t*);
 EXTERNC int landruLoadRequiredLibraries(LandruAssembler_t*, LandruNode_t* root_node, LandruLibrary_t* library, LandruVMContext_t* vmContext);
+
+// plugins are searched for in LANDRU_PLUGIN_PATH, then in these directories
+EXTERNC void landruAddPluginSearchPath(char const*const path);
 EXTERNC void landruAssemble(LandruAssembler_t*, LandruNode_t* rootNode);
 EXTERNC void landruVMContextSetTraceEnabled(LandruVMContext_t*, bool);
+EXTERNC bool landruVMContextWriteTrace(LandruVMContext_t*, char const*const path);
+
+// debug info (instruction descriptions for traces) is only recorded for
+// programs assembled while it is enabled
+EXTERNC void landruSetDebugInfoEnabled(bool);
+
+// samples the running instruction every interval; results are attributed
+// to machine, state and line using the debug info
+EXTERNC void landruVMContextStartProfiler(LandruVMContext_t*, int sampleIntervalMicroseconds);
+EXTERNC void landruVMContextStopProfiler(LandruVMContext_t*);
+EXTERNC bool landruVMContextWriteProfile(LandruVMContext_t*, char const*const path); // collapsed stacks for flame graphs
+EXTERNC void landruVMContextPrintProfile(LandruVMContext_t*, int count); // the count heaviest locations
+
 EXTERNC void landruInitializeContext(LandruAssembler_t*, LandruVMContext_t*);
+
+// Hot reload. Assembles the machines of a newly parsed program that differ
+// from those the context is running, and swaps them in. Running fibers of a
+// changed machine switch to it at their next goto, keeping the values of
+// properties whose name and type are unchanged. Returns the number of
+// machines replaced, or -1 if the program doesn't assemble, in which case
+// the context is unchanged. Call it between updates.
+EXTERNC int landruReloadMachines(LandruLibrary_t*, LandruVMContext_t*, LandruNode_t* rootNode);
 EXTERNC void landruLaunchMachine(LandruVMContext_t*, char const*const name);
 
 EXTERNC bool landruUpdate(LandruVMContext_t*, double now);
 
+// Host events. Each record of a type is fields floats, delivered to the
+// statements of every on host.event("name") clause subscribed to the type,
+// with the record's fields pushed in order. Register returns the type, or
+// -1; registering a name again returns the same type. Events may be posted
+// from any thread, and run on the next update.
+EXTERNC int landruRegisterEventType(LandruVMContext_t*, char const*const name, int fields);
+EXTERNC bool landruPostEvents(LandruVMContext_t*, int eventType, const void* records, size_t count);
+
+// bounds the instructions or microseconds a fiber may run per update before
+// it is preempted at a loop back-edge or state change; 0 is unlimited
+EXTERNC void landruVMContextSetFiberBudget(LandruVMContext_t*, int instructions, int microseconds);
+
 EXTERNC void landruReleaseAssembler(LandruAssembler_t*);
 EXTERNC void landruReleaseRootNode(LandruNode_t*);
 EXTERNC void landruReleaseLibrary(LandruLibrary_t*);
@@ -0,0 +1,76 @@
+//
+//  DebugMap.cpp
+//  Landru
+//
+
+#include "DebugMap.h"
+
+namespace Landru {
+
+    DebugMap& DebugMap::shared()
+    {
+        static DebugMap map;
+        return map;
+    }
+
+    void DebugMap::record(uint32_t addr, const char* str)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries[addr] = str ? str : "";
+        if (_current.machine.length())
+            _locations[addr] = _current;
+    }
+
+    const char* DebugMap::lookup(uint32_t addr) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto i = _entries.find(addr);
+        if (i == _entries.end())
+            return nullptr;
+        return i->second.c_str();
+    }
+
+    void DebugMap::clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.clear();
+        _locations.clear();
+        _current = Location();
+    }
+
+    void DebugMap::setLocation(const std::string& machine, const std::string& state, int line)
+    {
+        if (!_enabled)
+            return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _current.machine = machine;
+        _current.state = state;
+        _current.line = line;
+    }
+
+    void DebugMap::setLine(int line)
+    {
+        if (!_enabled)
+            return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _current.line = line;
+    }
+
+    bool DebugMap::location(uint32_t addr, Location& result) const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto i = _locations.find(addr);
+        if (i == _locations.end())
+            return false;
+        result = i->second;
+        return true;
+    }
+
+    std::vector<std::pair<uint32_t, std::string>> DebugMap::entries() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<std::pair<uint32_t, std::string>> result(_entries.begin(), _entries.end());
+        return result;
+    }
+
+} // Landru
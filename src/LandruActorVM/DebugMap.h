@@ -0,0 +1,60 @@
+//
+//  DebugMap.h
+//  Landru
+//
+//  Side table of human readable instruction descriptions, keyed by the
+//  address stored in each Instruction's Meta. Nothing is recorded unless the
+//  map is enabled before assembly, so a production assembly carries only the
+//  32 bit address per instruction.
+//
+//  Each recorded address also takes the source location the assembler was
+//  working on when the instruction was created, which is how the profiler
+//  attributes samples to machine, state, and line.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Landru {
+
+    class DebugMap {
+    public:
+        struct Location
+        {
+            std::string machine;
+            std::string state;
+            int line = 0;       // 0 if unknown
+        };
+
+        static DebugMap& shared();
+
+        void setEnabled(bool e) { _enabled = e; }
+        bool enabled() const { return _enabled; }
+
+        void record(uint32_t addr, const char* str);
+        const char* lookup(uint32_t addr) const;
+        void clear();
+
+        // set by the assembler, applies to instructions recorded afterwards
+        void setLocation(const std::string& machine, const std::string& state, int line);
+        void setLine(int line);
+        bool location(uint32_t addr, Location& result) const;
+
+        std::vector<std::pair<uint32_t, std::string>> entries() const;
+
+    private:
+        std::atomic<bool> _enabled { false };
+        mutable std::mutex _mutex;
+        std::unordered_map<uint32_t, std::string> _entries;
+        std::unordered_map<uint32_t, Location> _locations;
+        Location _current;
+    };
+
+} // Landru
@@ -60,22 +60,77 @@ using namespace std;
 
 namespace Landru {
 
+	namespace {
+		shared_ptr<Property> instantiate(const Property& p, Fiber* owner)
+		{
+			// the definition resolved the factory when it was assembled
+			shared_ptr<Property> prop = make_shared<Property>(p.typeFactory());
+			prop->name = p.name;
+			prop->type = p.type;
+			prop->visibility = p.visibility;
+			prop->create();
+			prop->owner = owner;
+			return prop;
+		}
+	}
+
 	Fiber::Fiber(std::shared_ptr<MachineDefinition> m, VMContext * vm)
 		: machineDefinition(m)
 	{
         for (auto& p : m->properties) {
-			TypeFactory tf = vm->libs->findFactory(p.second->type.c_str());
-            shared_ptr<Property> prop = make_shared<Property>(tf);
-            prop->name = p.second->name;
-            prop->type = p.second->type;
-            prop->visibility = p.second->visibility;
-            prop->create();
-			prop->owner = this;
+            shared_ptr<Property> prop = instantiate(*p.second, this);
 			vm->storeInstance(this, p.first, prop);
+			int slot = m->slot(p.first);
+			if (slot >= 0) {
+				if (slot >= int(properties.size()))
+					properties.resize(slot + 1);
+				properties[slot] = prop;
+			}
         }
         stack.push_back(vector<shared_ptr<Wires::TypedData>>());
     }
 
+	void Fiber::adoptDefinition(FnContext& run)
+	{
+		VMContext* vm = run.vm;
+		shared_ptr<MachineDefinition> m = std::move(pendingDefinition);
+		pendingDefinition.reset();
+
+		map<string, shared_ptr<Property>> previous;
+		for (auto& p : machineDefinition->properties) {
+			if (shared_ptr<Property> prop = vm->findInstance(this, p.first))
+				previous[p.first] = prop;
+			if (!m->properties.count(p.first))
+				vm->removeInstance(this, p.first);
+		}
+
+		// every property is declared afresh, so that the declarations run
+		// without disturbing the values being kept
+		machineDefinition = m;
+		properties.clear();
+		auto bind = [this, vm, &m](const string& name, shared_ptr<Property> prop) {
+			vm->storeInstance(this, name, prop);
+			int slot = m->slot(name);
+			if (slot >= 0) {
+				if (slot >= int(properties.size()))
+					properties.resize(slot + 1);
+				properties[slot] = prop;
+			}
+		};
+		for (auto& p : m->properties)
+			bind(p.first, instantiate(*p.second, this));
+
+		auto declarations = m->states.find("__auto__");
+		if (declarations != m->states.end())
+			run.run(declarations->second->instructions);
+
+		for (auto& p : m->properties) {
+			auto i = previous.find(p.first);
+			if (i != previous.end() && i->second->type == p.second->type)
+				bind(p.first, i->second);
+		}
+	}
+
     Fiber::~Fiber() {
     }
 
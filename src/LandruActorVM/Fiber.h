@@ -13,6 +13,8 @@
 #include "LandruActorVM/State.h"
 #include "LandruActorVM/VMContext.h"
 #include "LandruActorVM/WiresTypedData.h"
+#include <chrono>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -190,6 +192,10 @@ namespace Landru {
 
         void gotoState(FnContext& run, const char* name, bool raiseIfStateNotFound)
 		{
+			// a reloaded machine takes effect as its fibers change state
+			if (pendingDefinition)
+				adoptDefinition(run);
+
             auto state = machineDefinition->states.find(name);
 			if (state == machineDefinition->states.end()) {
 				if (raiseIfStateNotFound) {
@@ -200,6 +206,9 @@ namespace Landru {
 
             _currentState = state->first.c_str();
 
+			// a goto abandons whatever the previous state left suspended
+			unwind(0);
+
 			run.clearContinuations(this, scopeLevel);
             run.run(state->second->instructions);
         }
@@ -217,7 +226,7 @@ namespace Landru {
             }
             std::shared_ptr<Wires::TypedData>& data = stack.back().back();
             if (data->type() != typeid(T))
-                return 0;
+                VM_RAISE("Wrong type on stack top");
             Wires::Data<T>* val = reinterpret_cast<Wires::Data<T>*>(data.get());
             return val->value();
         }
@@ -275,7 +284,7 @@ namespace Landru {
             }
             std::shared_ptr<Wires::TypedData>& data = stack.back()[sz + i];
             if (data->type() != typeid(T))
-                return T(0);
+                VM_RAISE("Wrong type on stack");
             Wires::Data<T>* val = reinterpret_cast<Wires::Data<T>*>(data.get());
             return val->value();
         }
@@ -302,11 +311,59 @@ namespace Landru {
 
         std::shared_ptr<MachineDefinition> machineDefinition;
 
-        //std::map<std::string, std::shared_ptr<Property>> properties;
+        // set by VMContext::replaceDefinitions, and adopted at the next goto
+        std::shared_ptr<MachineDefinition> pendingDefinition;
+
+        // Changes to the pending definition. Properties are matched by name,
+        // and keep their values if their type is unchanged. The rest take the
+        // values they are declared with, and those the definition no longer
+        // has are removed.
+        void adoptDefinition(FnContext& run);
+
+        // indexed by MachineDefinition::slot, the same properties the VMContext stores by name
+        std::vector<std::shared_ptr<Property>> properties;
 
 		// vector, because local scopes push back their local variables, and pop them on exit
 		std::vector<std::shared_ptr<Property>> locals;
 
+		// A block of instructions being executed by the trampoline in
+		// FnContext::run. Conditionals, for-each loops, and on statements
+		// enter a frame rather than recursing, so the native stack depth
+		// doesn't grow with the nesting of the script, and a fiber that yields
+		// keeps its frames here until the VMContext resumes it.
+		struct Frame {
+			const std::vector<Instruction>* instructions;
+			size_t pc;
+			size_t locals;                              // locals to restore if the frame is abandoned
+			std::function<bool(FnContext&)> repeat;     // if set, called at the end of the block, true runs it again
+			std::shared_ptr<const void> keepAlive;      // owner of instructions, if the frame may outlive the caller's
+		};
+		std::vector<Frame> frames;
+		int runDepth = 0;                               // nested FnContext::run calls on this fiber
+
+		// the fiber's share of the current update, see VMContext::setFiberBudget
+		uint64_t sliceEpoch = 0;
+		uint32_t sliceInstructions = 0;
+		std::chrono::steady_clock::time_point sliceStart;
+		bool suspended = false;                         // waiting in the VMContext to be resumed
+		uint64_t handle = 0;                            // for plugin events, see VMContext::fiberHandle
+
+		void enter(const std::vector<Instruction>& block,
+		           std::function<bool(FnContext&)> repeat = std::function<bool(FnContext&)>(),
+		           std::shared_ptr<const void> keepAlive = std::shared_ptr<const void>())
+		{
+			frames.push_back(Frame{ &block, 0, locals.size(), std::move(repeat), std::move(keepAlive) });
+		}
+
+		// abandons the frames above depth, discarding the locals they declared
+		void unwind(size_t depth)
+		{
+			if (frames.size() <= depth)
+				return;
+			locals.resize(frames[depth].locals);
+			frames.resize(depth);
+		}
+
         typedef std::vector<std::shared_ptr<Wires::TypedData>> Stack;
         std::vector<Stack> stack;
     };
@@ -1,24 +1,96 @@
 
 #include "FnContext.h"
+#include "LandruActorVM/Fiber.h"
+#include "LandruActorVM/Profiler.h"
+#include "LandruActorVM/State.h"
+#include "LandruActorVM/Trace.h"
 #include "LandruActorVM/VMContext.h"
 
 namespace Landru {
 
-	RunState FnContext::run(std::vector<Instruction>& instructions)
+	RunState FnContext::run(const std::vector<Instruction>& instructions, std::shared_ptr<const void> keepAlive)
 	{
-		RunState runstate = RunState::Continue;
-		if (vm->traceEnabled)
-			for (auto& i : instructions) {
-				i.second.exec(*this);
-				if ((runstate = i.first(*this)) != RunState::Continue)
-					break;
+		size_t base = self->frames.size();
+		self->enter(instructions, std::function<bool(FnContext&)>(), std::move(keepAlive));
+		return trampoline(base);
+	}
+
+	RunState FnContext::run(InstructionBlock block)
+	{
+		const std::vector<Instruction>& instructions = *block;
+		return run(instructions, std::move(block));
+	}
+
+	RunState FnContext::resume()
+	{
+		return trampoline(0);
+	}
+
+	RunState FnContext::trampoline(size_t base)
+	{
+#if LANDRU_ENABLE_TRACE
+		const bool traced = vm->traceEnabled;
+#else
+		const bool traced = false;
+#endif
+#if LANDRU_ENABLE_PROFILER
+		Profiler* profiler = vm->profiler().running() ? &vm->profiler() : nullptr;
+#else
+		Profiler* profiler = nullptr;
+#endif
+
+		struct Depth {
+			Fiber* f;
+			Profiler* profiler;
+			Depth(Fiber* f, Profiler* p) : f(f), profiler(p) { ++f->runDepth; }
+			~Depth() {
+				if (--f->runDepth == 0 && profiler)
+					profiler->idle();
 			}
-		else
-			for (auto& i : instructions)
-				if ((runstate = i.first(*this)) != RunState::Continue)
-					break;
+		} depth(self, profiler);
+
+		vm->beginSlice(self);
+		std::vector<Fiber::Frame>& frames = self->frames;
+		try {
+			while (frames.size() > base) {
+				Fiber::Frame& frame = frames.back();
+				if (frame.pc == frame.instructions->size()) {
+					if (frame.repeat && frame.repeat(*this))
+						frames.back().pc = 0;
+					else
+						frames.pop_back();
+					continue;
+				}
+
+				const Instruction& i = (*frame.instructions)[frame.pc++];
+				if (traced)
+					vm->traceInstruction(i.second, self);
+				if (profiler)
+					profiler->enter(i.second.addr);
+				++self->sliceInstructions;
 
-		return runstate;
+				// i may enter a frame, after which frame is no longer valid
+				RunState runstate = i.first(*this);
+				if (runstate == RunState::Continue)
+					continue;
+
+				if (runstate == RunState::Yield) {
+					// frames beneath a native caller can't be suspended
+					if (self->runDepth > 1)
+						continue;
+					vm->suspend(self);
+					return runstate;
+				}
+
+				self->unwind(base);
+				return runstate;
+			}
+		}
+		catch (...) {
+			self->unwind(base);
+			throw;
+		}
+		return RunState::Continue;
 	}
 
 	void FnContext::clearContinuations(Fiber* f, int level)
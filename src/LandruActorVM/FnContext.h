@@ -8,6 +8,7 @@
 
 #pragma once
 #include "LandruActorVM/LandruLibForward.h"
+#include <memory>
 #include <vector>
 
 namespace Landru {
@@ -23,7 +24,21 @@ namespace Landru {
         Fiber* self;                // fiber being executed upon
         Wires::TypedData* var;      // variable whose function is being invoked
         
-		RunState run(std::vector<Instruction>& instructions);
+		// Runs the instructions until one returns something other than
+		// Continue. Blocks entered by the instructions, see Fiber::enter, run
+		// in the same loop. Yield suspends the fiber with its frames intact if
+		// this is the outermost run on the fiber, and is otherwise ignored.
+		// keepAlive owns instructions if they may not outlive the call.
+		RunState run(const std::vector<Instruction>& instructions,
+		             std::shared_ptr<const void> keepAlive = std::shared_ptr<const void>());
+		RunState run(InstructionBlock block);
+
+		// continues the frames of a fiber that yielded
+		RunState resume();
+
 		void clearContinuations(Fiber* f, int level);
+
+	private:
+		RunState trampoline(size_t base);
     };
 }
@@ -0,0 +1,169 @@
+//
+//  FrozenMap.h
+//  Landru
+//
+//  Immutable string keyed map with a perfect hash, built once from a fixed
+//  set of keys by hash and displace. Keys are hashed into buckets, and each
+//  bucket is given the seed that places all of its keys in free slots of
+//  the table, so a lookup is two hashes and a single key comparison.
+//
+//  Used for the library's tables once it is frozen, see Library::freeze.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Landru {
+
+    template <typename V>
+    class FrozenMap
+    {
+    public:
+        // Keys must be unique. Returns false, leaving the map empty, if no
+        // perfect hash was found, in which case the caller should keep using
+        // whatever it was going to replace.
+        bool build(std::vector<std::pair<std::string, V>> items)
+        {
+            clear();
+            if (items.empty())
+                return true;
+
+            size_t n = items.size();
+            size_t buckets = std::max<size_t>(1, n / 2);
+            size_t slots = n + n / 4 + 1;
+
+            std::vector<uint64_t> hashes(n);
+            std::vector<std::vector<uint32_t>> bucketKeys(buckets);
+            for (size_t i = 0; i < n; ++i) {
+                hashes[i] = hash(items[i].first.data(), items[i].first.size());
+                bucketKeys[mix(hashes[i]) % buckets].push_back(static_cast<uint32_t>(i));
+            }
+
+            // place the fullest buckets first, while the table is emptiest
+            std::vector<uint32_t> order(buckets);
+            for (size_t b = 0; b < buckets; ++b)
+                order[b] = static_cast<uint32_t>(b);
+            std::stable_sort(order.begin(), order.end(), [&bucketKeys](uint32_t a, uint32_t b) {
+                return bucketKeys[a].size() > bucketKeys[b].size();
+            });
+
+            _seeds.assign(buckets, 0);
+            std::vector<uint32_t> table(slots, kEmpty);
+            std::vector<size_t> placed;
+            for (uint32_t b : order) {
+                const std::vector<uint32_t>& keys = bucketKeys[b];
+                if (keys.empty())
+                    break;
+
+                uint32_t seed = 1;
+                for (; seed < kMaxSeed; ++seed) {
+                    placed.clear();
+                    bool fits = true;
+                    for (uint32_t k : keys) {
+                        size_t s = slot(hashes[k], seed, slots);
+                        if (table[s] != kEmpty || std::find(placed.begin(), placed.end(), s) != placed.end()) {
+                            fits = false;
+                            break;
+                        }
+                        placed.push_back(s);
+                    }
+                    if (fits)
+                        break;
+                }
+                if (seed == kMaxSeed) {
+                    clear();
+                    return false;
+                }
+
+                _seeds[b] = seed;
+                for (size_t i = 0; i < keys.size(); ++i)
+                    table[placed[i]] = keys[i];
+            }
+
+            _slots.resize(slots);
+            for (size_t s = 0; s < slots; ++s) {
+                if (table[s] == kEmpty)
+                    continue;
+                _slots[s].used = true;
+                _slots[s].key = std::move(items[table[s]].first);
+                _slots[s].value = std::move(items[table[s]].second);
+            }
+            _size = n;
+            return true;
+        }
+
+        const V* find(const char* key, size_t length) const
+        {
+            if (!_size)
+                return nullptr;
+            uint64_t h = hash(key, length);
+            uint32_t seed = _seeds[mix(h) % _seeds.size()];
+            const Slot& s = _slots[slot(h, seed, _slots.size())];
+            if (!s.used || s.key.size() != length || memcmp(s.key.data(), key, length))
+                return nullptr;
+            return &s.value;
+        }
+
+        const V* find(const char* key) const { return find(key, strlen(key)); }
+        const V* find(const std::string& key) const { return find(key.data(), key.size()); }
+
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+        void clear()
+        {
+            _seeds.clear();
+            _slots.clear();
+            _size = 0;
+        }
+
+    private:
+        static const uint32_t kEmpty = ~0u;
+        static const uint32_t kMaxSeed = 1u << 20;
+
+        struct Slot
+        {
+            bool used = false;
+            std::string key;
+            V value = V();
+        };
+
+        // FNV-1a
+        static uint64_t hash(const char* key, size_t length)
+        {
+            uint64_t h = 0xcbf29ce484222325ull;
+            for (size_t i = 0; i < length; ++i) {
+                h ^= static_cast<unsigned char>(key[i]);
+                h *= 0x100000001b3ull;
+            }
+            return h;
+        }
+
+        // splitmix64 finalizer
+        static uint64_t mix(uint64_t h)
+        {
+            h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+            h ^= h >> 27; h *= 0x94d049bb133111ebull;
+            return h ^ (h >> 31);
+        }
+
+        static size_t slot(uint64_t h, uint32_t seed, size_t slots)
+        {
+            return static_cast<size_t>(mix(h ^ (seed * 0x9e3779b97f4a7c15ull)) % slots);
+        }
+
+        std::vector<uint32_t> _seeds;       // by bucket
+        std::vector<Slot> _slots;
+        size_t _size = 0;
+    };
+
+    template <typename T>
+    const uint32_t FrozenMap<T>::kEmpty;
+
+} // Landru
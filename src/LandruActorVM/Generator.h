@@ -8,6 +8,9 @@
 
 #pragma once
 
+#include <cstddef>
+#include <memory>
+
 namespace Landru {
     
     class Fiber;
@@ -26,6 +29,67 @@ namespace Landru {
         virtual void finalize(FnContext&) = 0;
         
         virtual const char* typeName() const = 0;
+
+        // Generators of reals may offer either of the following, so that a
+        // for-each loop can step through them without a virtual call per
+        // value. A generator stepped this way is not finalized.
+
+        // Writes up to capacity of the next values, returning how many were
+        // written, and zero once done. kNotChunked if not implemented.
+        static const size_t kNotChunked = ~size_t(0);
+        virtual size_t fill(float* /*values*/, size_t /*capacity*/) { return kNotChunked; }
+
+        // True if the values are first, first + incr, ... while less than
+        // last, from the generator's current position.
+        virtual bool arithmetic(float& /*first*/, float& /*last*/, float& /*incr*/) const { return false; }
+    };
+
+    // Steps through a generator of reals by the fastest means it offers,
+    // counting an arithmetic range directly, and otherwise taking values a
+    // chunk at a time.
+    class RealCursor {
+    public:
+        static const size_t kChunk = 64;
+
+        // false if the generator offers neither fill nor arithmetic
+        bool begin(std::shared_ptr<Generator> g)
+        {
+            generator = std::move(g);
+            count = cursor = 0;
+            if (generator->arithmetic(curr, last, incr)) {
+                counting = true;
+                return true;
+            }
+            counting = false;
+            count = generator->fill(chunk, kChunk);
+            return count != Generator::kNotChunked;
+        }
+
+        bool next(float& value)
+        {
+            if (counting) {
+                if (curr >= last)
+                    return false;
+                value = curr;
+                curr += incr;
+                return true;
+            }
+            if (cursor == count) {
+                count = generator->fill(chunk, kChunk);
+                cursor = 0;
+                if (!count)
+                    return false;
+            }
+            value = chunk[cursor++];
+            return true;
+        }
+
+    private:
+        std::shared_ptr<Generator> generator;
+        bool counting = false;
+        float curr = 0, last = 0, incr = 0;
+        size_t count = 0, cursor = 0;
+        float chunk[kChunk];
     };
     
 } // Landru
@@ -10,6 +10,7 @@
 
 #include <functional>
 #include <memory>
+#include <vector>
 
 namespace Wires {
     class TypedData;
@@ -24,10 +25,16 @@ namespace Landru {
     class Meta;
 
 	enum class RunState {
-		Stop, Continue, Goto, UndefinedBehavior
+		Stop, Continue, Goto, UndefinedBehavior,
+		Yield   // suspend the fiber, the VMContext resumes it on the next update
 	};
     
     typedef std::pair<std::function<RunState(FnContext&)>, Meta> Instruction;
+
+	// A compiled block, such as the statements of an on clause. Blocks are
+	// immutable once assembled, so they are shared by reference wherever
+	// they are registered, rather than copied.
+	typedef std::shared_ptr<const std::vector<Instruction>> InstructionBlock;
 	typedef std::function<RunState(FnContext&)> ActorFn;
 	typedef std::function<std::shared_ptr<Wires::TypedData>()> TypeFactory;
 }
@@ -10,169 +10,146 @@
 
 #include "LandruAssembler/LandruAssembler.h"
 #include "LandruCompiler/AST.h"
+#include "LandruActorVM/PluginLoader.h"
 #include "LandruActorVM/VMContext.h"
 #include "Landru/Landru.h"
 #include <LabText/TextScanner.hpp>
+#include <set>
 
 namespace Landru 
 {
 
-    std::function<std::shared_ptr<Wires::TypedData>()> Library::findFactory(const char* name) 
+    const Library::TypeId Library::kNoType;
+
+    std::function<std::shared_ptr<Wires::TypedData>()> Library::findFactory(const char* name) const
 	{
+        return factory(name);
+    }
+
+    TypeFactory const* Library::resolveFactory(const std::string& name) const
+    {
         std::vector<std::string> nameParts = TextScanner::Split(name, ".");
         if (nameParts.size() == 1) {
             auto f = factories.find(name);
-            if (f == factories.end()) {
-                VM_RAISE("Cannot construct object of type: " << std::string(name));
-            }
-            return f->second;
+            return f == factories.end() ? nullptr : &f->second;
         }
-        else {
+        if (nameParts.size() == 2) {
             for (auto& i : libraries) {
                 if (i.name == nameParts[0]) {
                     auto f = i.factories.find(nameParts[1]);
-                    if (f == i.factories.end()) {
-                        VM_RAISE("Cannot construct object of type: " << std::string(name));
-                    }
-                    return f->second;
+                    return f == i.factories.end() ? nullptr : &f->second;
                 }
             }
         }
-        VM_RAISE("Cannot construct object of type: " << std::string(name));
+        return nullptr;
     }
-    
-    Library::Vtable const*const Library::findVtable(const char* name) 
-	{
-        auto v = vtables.find(name);
-        if (v != vtables.end())
-            return v->second.get();
-        
-        for (auto& i : libraries) {
-            auto v = i.vtables.find(name);
-            if (v != i.vtables.end())
-                return v->second.get();
+
+    Library::TypeId Library::intern(const std::string& name, const TypeFactory& factory)
+    {
+        auto i = _typeIds.find(name);
+        if (i != _typeIds.end()) {
+            _types[i->second].factory = factory;
+            return i->second;
         }
-        VM_RAISE("Cannot find vtable for: " << std::string(name));
+        TypeId id = static_cast<TypeId>(_types.size());
+        _types.push_back(Type { name, factory });
+        _typeIds[name] = id;
+        return id;
     }
-    
-} // Landru
-
-
-#if defined(LANDRU_OS_WINDOWS)
- #include <Windows.h>
-#else
- #include <dlfcn.h>
-#endif
-
-#include <set>
-
-using namespace std;
-
-namespace {
-    #if defined(ARCH_OS_LINUX) || defined(ARCH_OS_DARWIN)
-    #   define ARCH_LIBRARY_LAZY    RTLD_LAZY
-    #   define ARCH_LIBRARY_NOW     RTLD_NOW
-    #   define ARCH_LIBRARY_LOCAL   RTLD_LOCAL
-    #   define ARCH_LIBRARY_GLOBAL  RTLD_GLOBAL
-    #else
-    #   define ARCH_LIBRARY_LAZY    0
-    #   define ARCH_LIBRARY_NOW     0
-    #   define ARCH_LIBRARY_LOCAL   0
-    #   define ARCH_LIBRARY_GLOBAL  0
-    #endif
-
-#if defined(LANDRU_OS_WINDOWS)
-	std::string ArchStrSysError(unsigned long errorCode)
-	{
-		if (errorCode == 0)
-			return std::string();
-
-		LPSTR buffer = nullptr;
-		size_t len = FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER |
-			FORMAT_MESSAGE_FROM_SYSTEM |
-			FORMAT_MESSAGE_IGNORE_INSERTS,
-			nullptr,
-			errorCode,
-			MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-			(LPSTR)&buffer,
-			0,
-			nullptr);
 
-		std::string message(buffer, len);
-
-		OutputDebugString(buffer);
-		LocalFree(buffer);
-
-		return message;
-		return std::string();
-	}
-#endif
+    void Library::freeze()
+    {
+        for (auto& f : factories)
+            intern(f.first, f.second);
+        for (auto& lib : libraries) {
+            for (auto& f : lib.factories) {
+                // the first library of a name is the one resolveFactory finds
+                std::string name = lib.name + "." + f.first;
+                if (resolveFactory(name) == &f.second)
+                    intern(name, f.second);
+            }
+        }
+        _typeIndex.build(std::vector<std::pair<std::string, TypeId>>(_typeIds.begin(), _typeIds.end()));
+        freezeVtables();
+        _frozen = true;
+    }
 
+    void Library::freezeVtables()
+    {
+        for (auto& v : vtables)
+            v.second->freeze();
+        for (auto& lib : libraries)
+            lib.freezeVtables();
+
+        // the same search order as findVtable, the first vtable of a name wins
+        std::vector<std::pair<std::string, Vtable*>> items;
+        std::set<std::string> names;
+        for (auto& v : vtables)
+            if (names.insert(v.first).second)
+                items.emplace_back(v.first, v.second.get());
+        for (auto& lib : libraries)
+            for (auto& v : lib.vtables)
+                if (names.insert(v.first).second)
+                    items.emplace_back(v.first, v.second.get());
+        _vtableIndex.build(std::move(items));
+    }
 
-    void* ArchLibraryOpen(const std::string &filename, int flag)
+    Library::TypeId Library::typeId(const char* name) const
     {
-    #if defined(LANDRU_OS_WINDOWS)
-        return LoadLibrary(filename.c_str());
-    #else
-        return dlopen(filename.c_str(), flag);
-    #endif
+        if (TypeId const* id = _typeIndex.find(name))
+            return *id;
+
+        // not frozen yet
+        auto i = _typeIds.find(name);
+        return i != _typeIds.end() ? i->second : kNoType;
     }
 
-    const char* ArchLibraryError()
+    const TypeFactory& Library::factory(TypeId id) const
     {
-    #if defined(LANDRU_OS_WINDOWS)
-        DWORD error = ::GetLastError();
-        return error ?  ArchStrSysError(error).c_str() : nullptr;
-    #else
-        return dlerror();
-    #endif
+        if (id >= _types.size())
+            VM_RAISE("Unknown type id: " << id);
+        return _types[id].factory;
     }
 
-    int ArchLibraryClose(void* handle)
+    const TypeFactory& Library::factory(const char* name) const
     {
-    #if defined(LANDRU_OS_WINDOWS)
-        int status = ::FreeLibrary(reinterpret_cast<HMODULE>(handle));
-    #else
-        int status = dlclose(handle);
-    #endif
-        return status;
+        TypeId id = typeId(name);
+        if (id != kNoType)
+            return _types[id].factory;
+
+        TypeFactory const* f = resolveFactory(name);
+        if (!f)
+            VM_RAISE("Cannot construct object of type: " << std::string(name));
+        return *f;
     }
 
-    void* ArchLibraryGetSymbol(void* handle, const char* name)
+    const std::string& Library::typeName(TypeId id) const
     {
-    #if defined(LANDRU_OS_WINDOWS)
-        return GetProcAddress((HMODULE) handle, name);
-    #else
-        return dlsym(handle, name);
-    #endif
+        if (id >= _types.size())
+            VM_RAISE("Unknown type id: " << id);
+        return _types[id].name;
     }
+    
+    Library::Vtable const*const Library::findVtable(const char* name) 
+	{
+        // a miss falls through to the search, for libraries added since freeze
+        if (Vtable* const* v = _vtableIndex.find(name))
+            return *v;
 
-void loadLibrary(Landru::Library & lib, const std::string & s, Landru::VMContext* vm)
-{
-	using Landru::LandruRequire;
-    static std::set<string> loadedLibraries;
-    if (loadedLibraries.find(s) == loadedLibraries.end()) {
-        if (s.length()) {
-			LandruRequire req;
-			req.name = "landru_" + s;
-            req.plugin = ArchLibraryOpen(req.name + ".dll", ARCH_LIBRARY_LAZY);
-            if (!req.plugin) {
-                // raise error
-            }
-            else {
-                req.init = (LandruRequire::InitFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_init").c_str());
-                req.update = (LandruRequire::UpdateFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_update").c_str());
-                req.finish = (LandruRequire::FinishFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_finish").c_str());
-                req.fiberExpiring = (LandruRequire::FiberExpiringFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_fiberExpiring").c_str());
-				req.clearContinuations = (LandruRequire::ClearContinuationsFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_clearContinuations").c_str());
-				req.pendingContinuations = (LandruRequire::PendingContinuationsFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_pendingContinuations").c_str());
-				vm->plugins.push_back(req);
-            }
+        auto v = vtables.find(name);
+        if (v != vtables.end())
+            return v->second.get();
+        
+        for (auto& i : libraries) {
+            auto v = i.vtables.find(name);
+            if (v != i.vtables.end())
+                return v->second.get();
         }
+        VM_RAISE("Cannot find vtable for: " << std::string(name));
     }
-}
+    
+} // Landru
 
-} // anon
 
 extern "C"
 LandruLibrary_t* landruCreateLibrary(char const*const name)
@@ -196,12 +173,14 @@ int landruLoadRequiredLibraries(LandruAssembler_t* assembler, LandruNode_t* root
     Landru::Library* library = reinterpret_cast<Landru::Library*>(library_);
 
     std::vector<std::string> requires = laa->requires2(root_node);
-    for (auto r : requires)
-        loadLibrary(*library, r, vmContext);
+    Landru::PluginLoader::shared().load(vmContext, requires);
 
     for (auto & r : vmContext->plugins)
         if (r.init)
             r.init(library);
 
+    // the plugins have registered their types
+    library->freeze();
+
     return static_cast<int>(requires.size());
 }
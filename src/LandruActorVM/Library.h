@@ -9,11 +9,14 @@
 #pragma once
 
 #include "Exception.h"
+#include "FrozenMap.h"
 #include "LandruLibForward.h"
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace Wires {
@@ -40,6 +43,11 @@ namespace Landru {
             factories.clear();
             std::swap(factories, rhs.factories);
 			std::swap(libraries, rhs.libraries);
+			std::swap(_typeIds, rhs._typeIds);
+			std::swap(_types, rhs._types);
+			std::swap(_typeIndex, rhs._typeIndex);
+			std::swap(_vtableIndex, rhs._vtableIndex);
+			_frozen = rhs._frozen;
             return *this;
         }
 
@@ -65,25 +73,28 @@ namespace Landru {
                 name = rh.name;
                 entries.clear();
                 std::swap(entries, rh.entries);
+                _index.clear();
+                return *this;
             }
 
             Vtable & operator=(const Vtable& rh)
             {
                 name = rh.name;
                 entries = rh.entries;
+                _index.clear();
                 return *this;
             }
 
             class Entry {
             public:
-                Entry(const char* name, const char* args, ActorFn fn)
-                : name(name), args(args), fn(fn) {}
+                Entry(const char* name, const char* args, const char* response, ActorFn fn)
+                : name(name), args(args), response(response), fn(fn) {}
                 Entry() {}
                 Entry(const Entry& rh) { *this = rh; }
                 ~Entry() {}
 
                 const Entry& operator =(const Entry& r) {
-                    name = r.name; args = r.args; fn = r.fn;
+                    name = r.name; args = r.args; response = r.response; fn = r.fn;
                     return *this;
                 }
 
@@ -95,19 +106,37 @@ namespace Landru {
 
             void registerFn(const char* protocol, const char* name, const char* args, const char* response, ActorFn fn)
             {
-                entries[name] = Entry(name, args, fn);
+                if (entries.find(name) == entries.end())
+                    _index.clear();
+                entries[name] = Entry(name, args, response, fn);
             }
 
             Entry const*const function(const char* name) const
             {
+                if (!_index.empty()) {
+                    Entry const*const* e = _index.find(name);
+                    return e ? *e : nullptr;
+                }
                 auto i = entries.find(name);
                 if (i == entries.end())
                     return nullptr;
                 return &i->second;
             }
 
+            void freeze()
+            {
+                std::vector<std::pair<std::string, Entry const*>> items;
+                items.reserve(entries.size());
+                for (auto& e : entries)
+                    items.emplace_back(e.first, &e.second);
+                _index.build(std::move(items));
+            }
+
             std::string name;
             std::map<std::string, Entry> entries;
+
+        private:
+            FrozenMap<Entry const*> _index;     // built by freeze, empty until then
         };
 
 
@@ -117,9 +146,15 @@ namespace Landru {
 
         void registerVtable(std::unique_ptr<Vtable> vtable) {
             vtables[vtable->name] = move(vtable);
+            _vtableIndex.clear();
         }
         Vtable const*const findVtable(const char* name);
 
+        // the vtable implementing the methods of a std type, float is implemented by real
+        static const char* stdTypeVtable(const std::string& type) {
+            return type == "float" ? "real" : type.c_str();
+        }
+
         std::map<std::string, std::unique_ptr<Vtable>> vtables;
 
         //---------------------
@@ -128,10 +163,55 @@ namespace Landru {
         void registerFactory(const char* type, TypeFactory factory) 
 		{
             factories[type] = factory;
+            auto i = _typeIds.find(type);
+            if (i != _typeIds.end())
+                _types[i->second].factory = factory;
         }
 
-        TypeFactory findFactory(const char* name);
+        TypeFactory findFactory(const char* name) const;
         std::map<std::string, TypeFactory> factories;
+
+        //---------------------
+        // Type registry       \_________________________
+        //
+        // Type names, qualified by library for plugin types such as
+        // audio.buffer, are interned to dense ids, so that instructions can
+        // construct values by id rather than resolving the name each time.
+
+        typedef uint32_t TypeId;
+        static const TypeId kNoType = ~0u;
+
+        // Interns every type registered so far, refreshes the cached
+        // factories, and builds perfect hash indexes of the types, vtables and
+        // functions. Called once the plugins have been initialized, and again
+        // if more libraries are loaded; a type registered by a nested library
+        // in between has no id until then, and is found by name.
+        void freeze();
+        bool frozen() const { return _frozen; }
+
+        // Lookups never intern, so that they are safe from any thread once
+        // the library is frozen. Ids are resolved when a program is assembled,
+        // and names are only looked up at run time for types that aren't
+        // known until then.
+        TypeId typeId(const char* name) const;  // kNoType if the type has no id
+        const TypeFactory& factory(TypeId id) const;
+        const TypeFactory& factory(const char* name) const;    // raises if there is no such type
+        const std::string& typeName(TypeId id) const;
+
+    private:
+        TypeFactory const* resolveFactory(const std::string& name) const;
+        TypeId intern(const std::string& name, const TypeFactory& factory);
+        void freezeVtables();
+
+        struct Type {
+            std::string name;
+            TypeFactory factory;
+        };
+        std::unordered_map<std::string, TypeId> _typeIds;
+        std::vector<Type> _types;           // indexed by TypeId
+        FrozenMap<TypeId> _typeIndex;
+        FrozenMap<Vtable*> _vtableIndex;    // includes the nested libraries' vtables
+        bool _frozen = false;
     };
 
 }
@@ -12,11 +12,37 @@
 
 namespace Landru {
     
+    MachineDefinition::MachineDefinition(const MachineDefinition& rhs)
+    : name(rhs.name), sourceHash(rhs.sourceHash), slots(rhs.slots) {
+        for (auto i : rhs.states)
+            states[i.first] = new State(*i.second);
+        for (auto i : rhs.properties)
+            properties[i.first] = new Property(*i.second);
+    }
+
     MachineDefinition::~MachineDefinition() {
         for (auto i : states)
             delete i.second;
         for (auto i : properties)
             delete i.second;
     }
+
+    void MachineDefinition::addProperty(const std::string& name, Property* prop) {
+        auto i = properties.find(name);
+        if (i != properties.end()) {
+            delete i->second;
+            i->second = prop;
+            return;
+        }
+        properties[name] = prop;
+        slots.push_back(name);
+    }
+
+    int MachineDefinition::slot(const std::string& name) const {
+        for (size_t i = 0; i < slots.size(); ++i)
+            if (slots[i] == name)
+                return int(i);
+        return -1;
+    }
     
 }
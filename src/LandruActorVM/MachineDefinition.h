@@ -8,8 +8,10 @@
 
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <string>
+#include <vector>
 
 namespace Landru {
     class State;
@@ -18,15 +20,22 @@ namespace Landru {
     class MachineDefinition {
     public:
         MachineDefinition() {}
-        MachineDefinition(const MachineDefinition& rhs) {
-            states = rhs.states;
-            name = rhs.name;
-        }
+        MachineDefinition(const MachineDefinition& rhs);    // copies the states and properties it owns
+        MachineDefinition& operator=(const MachineDefinition&) = delete;
         ~MachineDefinition();
         
         std::string name;
+        uint64_t sourceHash = 0;    // ASTNode::contentHash of the machine, to find the machines a reload changes
         std::map<std::string, State*> states;
         std::map<std::string, Property*> properties;
+
+        // property names in the order they were declared. A fiber's property
+        // vector is indexed the same way, so that assembled code can address
+        // a property by slot rather than by name.
+        std::vector<std::string> slots;
+
+        void addProperty(const std::string& name, Property*);
+        int slot(const std::string& name) const; // -1 if not found
     };
     
 } // Landru
@@ -0,0 +1,78 @@
+//
+//  MpscQueue.h
+//  Landru
+//
+//  Lock-free unbounded multiple producer, single consumer queue, after
+//  Dmitry Vyukov's. Producers swap themselves onto the head with a single
+//  atomic exchange and never wait on each other or on the consumer. A push
+//  that is still linking its node may be missed by a concurrent pop, and is
+//  seen by the next one.
+//
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace Landru {
+
+    template <typename T>
+    class MpscQueue
+    {
+    public:
+        MpscQueue() : _head(&_stub), _tail(&_stub) {}
+
+        ~MpscQueue()
+        {
+            T discard;
+            while (pop(discard)) {}
+            if (_tail != &_stub)
+                delete _tail;
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        // any thread
+        void push(T value)
+        {
+            Node* n = new Node();
+            n->value = std::move(value);
+            Node* prev = _head.exchange(n, std::memory_order_acq_rel);
+            prev->next.store(n, std::memory_order_release);
+        }
+
+        // the consumer thread only
+        bool pop(T& result)
+        {
+            Node* tail = _tail;
+            Node* next = tail->next.load(std::memory_order_acquire);
+            if (!next)
+                return false;
+            result = std::move(next->value);
+            next->value = T();
+            _tail = next;           // next is the new placeholder
+            if (tail != &_stub)
+                delete tail;
+            return true;
+        }
+
+        // the consumer thread only
+        bool empty() const
+        {
+            return !_tail->next.load(std::memory_order_acquire);
+        }
+
+    private:
+        struct Node
+        {
+            std::atomic<Node*> next { nullptr };
+            T value;
+        };
+
+        std::atomic<Node*> _head;   // most recently pushed
+        Node* _tail;                // already consumed, its next is the oldest
+        Node _stub;
+    };
+
+} // Landru
@@ -0,0 +1,268 @@
+//
+//  NativeState.cpp
+//  Landru
+//
+
+#include "NativeState.h"
+#include "Exception.h"
+#include "Fiber.h"
+#include "Generator.h"
+#include "Library.h"
+#include "State.h"
+#include "VMContext.h"
+#include "WiresTypedData.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace Landru {
+namespace Native {
+
+    void resolve(Library* lib, const CallSite* sites, ActorFn* fns, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            const CallSite& site = sites[i];
+            Library* l = lib;
+            const char* curr = site.library;
+            while (curr && *curr) {
+                const char* dot = strchr(curr, '.');
+                string name = dot ? string(curr, dot - curr) : string(curr);
+                Library* next = nullptr;
+                for (auto& j : l->libraries)
+                    if (j.name == name) {
+                        next = &j;
+                        break;
+                    }
+                if (!next)
+                    VM_RAISE("Native state requires missing library " << site.library);
+                l = next;
+                curr = dot ? dot + 1 : nullptr;
+            }
+
+            Library::Vtable const*const vtable = l->findVtable(site.vtable);
+            auto entry = vtable->function(site.function);
+            if (!entry)
+                VM_RAISE("Native state requires missing function " << site.vtable << "." << site.function);
+            fns[i] = entry->fn;
+        }
+    }
+
+    void pushInt(FnContext& run, int i)
+    {
+        run.self->stack.back().emplace_back(make_shared<Wires::Data<int>>(i));
+    }
+
+    void pushFloat(FnContext& run, float f)
+    {
+        run.self->stack.back().emplace_back(make_shared<Wires::Data<float>>(f));
+    }
+
+    void pushString(FnContext& run, const char* s)
+    {
+        run.self->stack.back().emplace_back(make_shared<Wires::Data<string>>(string(s)));
+    }
+
+    void pushRangedRandom(FnContext& run, float r1, float r2)
+    {
+        float r = (float)rand() / RAND_MAX;
+        r *= (r2 - r1);
+        r += r1;
+        run.self->stack.back().emplace_back(make_shared<Wires::Data<float>>(r));
+    }
+
+    void pushLocal(FnContext& run, int index)
+    {
+        run.self->stack.back().emplace_back(run.self->locals[index]->data);
+    }
+
+    void pushInstance(FnContext& run, const char* name)
+    {
+        auto i = run.vm->findInstance(run.self, name);
+        run.self->stack.back().emplace_back(i->data);
+    }
+
+    void pushGlobal(FnContext& run, const char* name)
+    {
+        auto i = run.vm->findGlobal(name);
+        run.self->stack.back().emplace_back(i->data);
+    }
+
+    void pushInstanceReference(FnContext& run, const char* name)
+    {
+        auto i = run.vm->findInstance(run.self, name);
+        run.self->stack.back().emplace_back(make_shared<Wires::Data<shared_ptr<Property>>>(i));
+    }
+
+    void pushGlobalReference(FnContext& run, const char* name)
+    {
+        auto i = run.vm->findGlobal(name);
+        run.self->stack.back().emplace_back(make_shared<Wires::Data<shared_ptr<Property>>>(i));
+    }
+
+    void pushOnStatements(FnContext& run, NativeStateFn body)
+    {
+        // one block per body, rather than per execution, so that contexts
+        // hold one block handle and the DebugMap one record for each
+        static mutex lock;
+        static unordered_map<NativeStateFn, InstructionBlock> blocks;
+        InstructionBlock block;
+        {
+            lock_guard<mutex> guard(lock);
+            InstructionBlock& b = blocks[body];
+            if (!b) {
+                auto instructions = make_shared<vector<Instruction>>();
+                instructions->emplace_back(Instruction(body, "native on statements"));
+                b = instructions;
+            }
+            block = b;
+        }
+        run.self->push<InstructionBlock>(block);
+    }
+
+    float popFloat(FnContext& run)
+    {
+        return run.self->pop<float>();
+    }
+
+    int popInt(FnContext& run)
+    {
+        return run.self->pop<int>();
+    }
+
+    int divideInt(int v1, int v2)
+    {
+        if (!v2)
+            VM_RAISE("Integer division by zero");
+        return v1 / v2;
+    }
+
+    int modulusInt(int v1, int v2)
+    {
+        if (!v2)
+            VM_RAISE("Integer modulus by zero");
+        return v1 % v2;
+    }
+
+    void storeLocal(FnContext& run, int index)
+    {
+        auto data = run.self->popVar();
+        run.self->locals[index]->assign(data, true);
+    }
+
+    void storeInstance(FnContext& run, const char* name)
+    {
+        auto prop = run.vm->findInstance(run.self, name);
+        auto data = run.self->popVar();
+        prop->copy(data, true);
+    }
+
+    void storeGlobal(FnContext& run, const char* name)
+    {
+        auto prop = run.vm->findGlobal(name);
+        auto data = run.self->popVar();
+        prop->copy(data, true);
+    }
+
+    void initializeShared(FnContext& run, const char* name)
+    {
+        auto prop = run.vm->findInstance(run.self, name);
+        auto data = run.self->popVar();
+        if (!prop->assignCount) {
+            prop->data->copy(data.get());
+            ++prop->assignCount;
+        }
+    }
+
+    void addLocal(FnContext& run, const char* name, const char* type)
+    {
+        const TypeFactory& factory = run.vm->libs->factory(type);
+        auto local = factory();
+        run.self->push_local(name, type, factory, local);
+    }
+
+    void popLocals(FnContext& run, int count)
+    {
+        for (int i = 0; i < count; ++i)
+            run.self->locals.pop_back();
+    }
+
+    RunState callOnSlot(FnContext& run, const ActorFn& fn, int slot)
+    {
+        FnContext fnRun(run);
+        fnRun.var = run.self->properties[slot]->data.get();
+        return fn(fnRun);
+    }
+
+    RunState callOnProperty(FnContext& run, const ActorFn& fn, const char* propertyName)
+    {
+        FnContext fnRun(run);
+        auto property = run.vm->findInstance(run.self, propertyName);
+        if (!property) {
+            property = run.vm->findGlobal(propertyName);
+            if (!property)
+                VM_RAISE("Couldn't find property: " << propertyName);
+        }
+        fnRun.var = property->data.get();
+        return fn(fnRun);
+    }
+
+    RunState forEach(FnContext& run, NativeStateFn body)
+    {
+        RunState runstate = RunState::Continue;
+        auto genVarPtr = run.self->popVar();
+        auto generatorVar = reinterpret_cast<Wires::Data<shared_ptr<Generator>>*>(genVarPtr.get());
+        auto generator = generatorVar->value();
+
+        const TypeFactory& factory = run.vm->libs->factory(generator->typeName());
+        auto local = factory();
+        auto var = run.self->push_local(string("gen"), string(generator->typeName()), factory, local);
+
+        generator->begin();
+        RealCursor cursor;
+        if (var->type() == typeid(float) && cursor.begin(generator)) {
+            auto real = static_cast<Wires::Data<float>*>(var.get());
+            float value;
+            while (cursor.next(value)) {
+                real->Wires::Data<float>::setValue(value);
+                runstate = body(run);
+                if (runstate != RunState::Continue && runstate != RunState::Yield)
+                    break;
+            }
+        }
+        else {
+            for (; !generator->done(); generator->next()) {
+                generator->generate(var.get());
+                runstate = body(run);
+                generator->finalize(run);
+                // a goto in the body ends the state, as it does when interpreted
+                if (runstate != RunState::Continue && runstate != RunState::Yield)
+                    break;
+            }
+        }
+
+        run.self->pop_local();
+        return runstate;
+    }
+
+    RunState gotoState(FnContext& run, const char* state)
+    {
+        run.vm->enqueueGoto(run.self, state);
+        return RunState::Goto;
+    }
+
+    void launchMachine(FnContext& run)
+    {
+        string machine = run.self->pop<string>();
+        run.vm->launchQueue.push(VMContext::LaunchRecord(machine, Fiber::Stack()));
+    }
+
+} // Native
+} // Landru
@@ -0,0 +1,104 @@
+//
+//  NativeState.h
+//  Landru
+//
+//  Support for states compiled ahead of time to C++ by landruc --emit-cpp.
+//  The generated code is built into a plugin that exports
+//  landru_<module>_nativeStates; when the plugin is loaded,
+//  VMContext::setDefinitions runs copies of the machine definitions in which
+//  every state the plugin provides is a single call to its native function.
+//
+//  The Native functions mirror the instructions emitted by ActorAssembler,
+//  so that native and interpreted states behave identically.
+//
+
+#pragma once
+
+#include "Landru/defines.h"
+#include "LandruActorVM/LandruLibForward.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+
+#if defined(LANDRU_OS_WINDOWS)
+#define LANDRU_NATIVE_API __declspec(dllexport)
+#else
+#define LANDRU_NATIVE_API __attribute__((visibility("default")))
+#endif
+
+namespace Landru {
+
+    typedef RunState (*NativeStateFn)(FnContext&);
+
+    class NativeStates
+    {
+    public:
+        void add(const char* machine, const char* state, NativeStateFn fn)
+        {
+            _states[std::make_pair(std::string(machine), std::string(state))] = fn;
+        }
+
+        NativeStateFn find(const std::string& machine, const std::string& state) const
+        {
+            auto i = _states.find(std::make_pair(machine, state));
+            return i == _states.end() ? nullptr : i->second;
+        }
+
+        bool empty() const { return _states.empty(); }
+
+    private:
+        std::map<std::pair<std::string, std::string>, NativeStateFn> _states;
+    };
+
+    namespace Native {
+
+        // a library function called by generated code, resolved once when the
+        // plugin registers its states
+        struct CallSite
+        {
+            const char* library;    // dotted path of nested libraries, empty to search from the root
+            const char* vtable;
+            const char* function;
+        };
+        void resolve(Library*, const CallSite* sites, ActorFn* fns, size_t count);
+
+        void pushInt(FnContext&, int);
+        void pushFloat(FnContext&, float);
+        void pushString(FnContext&, const char*);
+        void pushRangedRandom(FnContext&, float r1, float r2);
+        void pushLocal(FnContext&, int index);
+        void pushInstance(FnContext&, const char* name);
+        void pushGlobal(FnContext&, const char* name);
+        void pushInstanceReference(FnContext&, const char* name);
+        void pushGlobalReference(FnContext&, const char* name);
+
+        // pushes the body of an on statement for the on clause to consume
+        void pushOnStatements(FnContext&, NativeStateFn body);
+
+        float popFloat(FnContext&);
+        int popInt(FnContext&);
+
+        // int division and modulus, which raise on a zero divisor
+        int divideInt(int, int);
+        int modulusInt(int, int);
+
+        void storeLocal(FnContext&, int index);
+        void storeInstance(FnContext&, const char* name);
+        void storeGlobal(FnContext&, const char* name);
+        void initializeShared(FnContext&, const char* name);
+
+        void addLocal(FnContext&, const char* name, const char* type);
+        void popLocals(FnContext&, int count);
+
+        // a method on a machine property, by its slot in the fiber's properties
+        RunState callOnSlot(FnContext&, const ActorFn&, int slot);
+        RunState callOnProperty(FnContext&, const ActorFn&, const char* property);
+        RunState forEach(FnContext&, NativeStateFn body);
+        RunState gotoState(FnContext&, const char* state);
+        void launchMachine(FnContext&);
+
+    } // Native
+
+} // Landru
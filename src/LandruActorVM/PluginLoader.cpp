@@ -0,0 +1,391 @@
+//
+//  PluginLoader.cpp
+//  Landru
+//
+
+#include "PluginLoader.h"
+#include "Landru/defines.h"
+#include "Landru/Landru.h"
+#include "LandruActorVM/VMContext.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <set>
+#include <sys/stat.h>
+
+#if defined(LANDRU_OS_WINDOWS)
+ #include <Windows.h>
+#else
+ #include <dlfcn.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+    void* ArchLibraryOpen(const std::string &filename)
+    {
+    #if defined(LANDRU_OS_WINDOWS)
+        return LoadLibrary(filename.c_str());
+    #else
+        // bind everything now, rather than on each symbol's first call
+        return dlopen(filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+    #endif
+    }
+
+    void* ArchLibraryGetSymbol(void* handle, const char* name)
+    {
+    #if defined(LANDRU_OS_WINDOWS)
+        return GetProcAddress((HMODULE) handle, name);
+    #else
+        return dlsym(handle, name);
+    #endif
+    }
+
+    bool fileStat(const std::string& path, int64_t& modified, uint64_t& size)
+    {
+        struct stat s;
+        if (stat(path.c_str(), &s) != 0)
+            return false;
+        modified = static_cast<int64_t>(s.st_mtime);
+        size = static_cast<uint64_t>(s.st_size);
+        return true;
+    }
+
+    std::string joinPath(const std::string& dir, const std::string& file)
+    {
+        if (dir.empty())
+            return file;
+        char last = dir.back();
+        return last == '/' || last == '\\' ? dir + file : dir + "/" + file;
+    }
+
+    std::string directoryOf(const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash);
+    }
+
+    bool sameDirectory(const std::string& a, const std::string& b)
+    {
+        size_t la = a.length(), lb = b.length();
+        while (la > 1 && (a[la - 1] == '/' || a[la - 1] == '\\')) --la;
+        while (lb > 1 && (b[lb - 1] == '/' || b[lb - 1] == '\\')) --lb;
+        return la == lb && a.compare(0, la, b, 0, lb) == 0;
+    }
+
+    // the exports a plugin may provide, landru_<name>_<suffix>, a bit each
+    enum Export : uint32_t
+    {
+        kInit = 1 << 0,
+        kCreateInstance = 1 << 1,
+        kDestroyInstance = 1 << 2,
+        kUpdate = 1 << 3,
+        kFinish = 1 << 4,
+        kFiberExpiring = 1 << 5,
+        kClearContinuations = 1 << 6,
+        kPendingContinuations = 1 << 7,
+        kNativeStates = 1 << 8,
+        kProtocol = 1 << 9,
+        kUpdateEvents = 1 << 10,
+        kAllExports = (1 << 11) - 1
+    };
+
+    typedef int (*ProtocolFn)();
+
+    // looks up the exports in the mask, returning those found
+    uint32_t bindExports(Landru::LandruRequire& req, uint32_t mask)
+    {
+        using Landru::LandruRequire;
+        uint32_t found = 0;
+        auto symbol = [&req, &found, mask](uint32_t bit, const char* suffix) -> void* {
+            if (!(mask & bit))
+                return nullptr;
+            void* s = ArchLibraryGetSymbol(req.plugin, (req.name + suffix).c_str());
+            if (s)
+                found |= bit;
+            return s;
+        };
+
+        req.init = (LandruRequire::InitFn) symbol(kInit, "_init");
+        req.createInstance = (LandruRequire::CreateInstanceFn) symbol(kCreateInstance, "_createInstance");
+        req.destroyInstance = (LandruRequire::DestroyInstanceFn) symbol(kDestroyInstance, "_destroyInstance");
+        req.finish = (LandruRequire::FinishFn) symbol(kFinish, "_finish");
+        req.nativeStates = (LandruRequire::NativeStatesFn) symbol(kNativeStates, "_nativeStates");
+        ProtocolFn protocol = (ProtocolFn) symbol(kProtocol, "_protocol");
+        req.protocol = protocol ? protocol() : 1;
+
+        // the same exports take the plugin's instance from version 2
+        void* update = symbol(kUpdate, "_update");
+        void* fiberExpiring = symbol(kFiberExpiring, "_fiberExpiring");
+        void* clearContinuations = symbol(kClearContinuations, "_clearContinuations");
+        void* pendingContinuations = symbol(kPendingContinuations, "_pendingContinuations");
+        if (req.protocol >= 2) {
+            req.instanceUpdate = (LandruRequire::InstanceUpdateFn) update;
+            req.instanceFiberExpiring = (LandruRequire::InstanceFiberExpiringFn) fiberExpiring;
+            req.instanceClearContinuations = (LandruRequire::InstanceClearContinuationsFn) clearContinuations;
+            req.instancePendingContinuations = (LandruRequire::InstancePendingContinuationsFn) pendingContinuations;
+            req.updateEvents = (LandruRequire::UpdateEventsFn) symbol(kUpdateEvents, "_updateEvents");
+        }
+        else {
+            req.update = (LandruRequire::UpdateFn) update;
+            req.fiberExpiring = (LandruRequire::FiberExpiringFn) fiberExpiring;
+            req.clearContinuations = (LandruRequire::ClearContinuationsFn) clearContinuations;
+            req.pendingContinuations = (LandruRequire::PendingContinuationsFn) pendingContinuations;
+        }
+        return found;
+    }
+
+    const char* kManifestHeader = "landru-plugin-manifest 2";
+
+} // anon
+
+namespace Landru {
+
+    PluginLoader& PluginLoader::shared()
+    {
+        static PluginLoader loader;
+        return loader;
+    }
+
+    PluginLoader::PluginLoader()
+    {
+        if (const char* path = getenv("LANDRU_PLUGIN_MANIFEST"))
+            _manifestPath = path;
+        else {
+#if defined(LANDRU_OS_WINDOWS)
+            const char* cache = getenv("LOCALAPPDATA");
+            if (cache)
+                _manifestPath = joinPath(cache, "landru-plugins.manifest");
+#else
+            const char* cache = getenv("XDG_CACHE_HOME");
+            const char* home = getenv("HOME");
+            if (cache)
+                _manifestPath = joinPath(cache, "landru-plugins.manifest");
+            else if (home)
+                _manifestPath = joinPath(joinPath(home, ".cache"), "landru-plugins.manifest");
+#endif
+        }
+    }
+
+    void PluginLoader::addSearchPath(const std::string& dir)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _searchPath.push_back(dir);
+    }
+
+    std::vector<std::string> PluginLoader::searchPath() const
+    {
+        std::vector<std::string> result;
+#if defined(LANDRU_OS_WINDOWS)
+        const char separator = ';';
+#else
+        const char separator = ':';
+#endif
+        if (const char* env = getenv("LANDRU_PLUGIN_PATH")) {
+            std::string paths(env);
+            size_t start = 0;
+            while (start <= paths.length()) {
+                size_t end = paths.find(separator, start);
+                if (end == std::string::npos)
+                    end = paths.length();
+                if (end > start)
+                    result.push_back(paths.substr(start, end - start));
+                start = end + 1;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        result.insert(result.end(), _searchPath.begin(), _searchPath.end());
+        result.push_back(std::string());   // the platform's search
+        return result;
+    }
+
+    void PluginLoader::setManifestPath(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _manifestPath = path;
+        _manifest.clear();
+        _manifestRead = false;
+    }
+
+    std::string PluginLoader::manifestPath() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _manifestPath;
+    }
+
+    std::vector<std::string> PluginLoader::fileNames(const std::string& plugin)
+    {
+        std::string name = "landru_" + plugin;
+#if defined(LANDRU_OS_WINDOWS)
+        return { name + ".dll" };
+#elif defined(LANDRU_OS_DARWIN)
+        return { name + ".dylib", "lib" + name + ".dylib" };
+#else
+        return { name + ".so", "lib" + name + ".so" };
+#endif
+    }
+
+    // one plugin per line, name path modified size exports protocol, tab separated
+    void PluginLoader::readManifest()
+    {
+        _manifestRead = true;
+        if (_manifestPath.empty())
+            return;
+        FILE* f = fopen(_manifestPath.c_str(), "r");
+        if (!f)
+            return;
+
+        char line[4096];
+        if (!fgets(line, sizeof(line), f) || std::string(line).find(kManifestHeader) != 0) {
+            fclose(f);
+            return;
+        }
+        while (fgets(line, sizeof(line), f)) {
+            std::vector<std::string> fields;
+            std::string s(line);
+            while (!s.empty() && (s.back() == '\n' || s.back() == '\r'))
+                s.pop_back();
+            size_t start = 0;
+            for (size_t tab; (tab = s.find('\t', start)) != std::string::npos; start = tab + 1)
+                fields.push_back(s.substr(start, tab - start));
+            fields.push_back(s.substr(start));
+            if (fields.size() != 6)
+                continue;
+
+            Entry e;
+            e.path = fields[1];
+            e.modified = strtoll(fields[2].c_str(), nullptr, 10);
+            e.size = strtoull(fields[3].c_str(), nullptr, 10);
+            e.exports = static_cast<uint32_t>(strtoul(fields[4].c_str(), nullptr, 16));
+            e.protocol = atoi(fields[5].c_str());
+            _manifest[fields[0]] = e;
+        }
+        fclose(f);
+    }
+
+    void PluginLoader::writeManifest() const
+    {
+        if (_manifestPath.empty())
+            return;
+        FILE* f = fopen(_manifestPath.c_str(), "w");
+        if (!f)
+            return;     // the manifest is only a cache
+        fprintf(f, "%s\n", kManifestHeader);
+        for (auto& i : _manifest)
+            fprintf(f, "%s\t%s\t%lld\t%llu\t%x\t%d\n", i.first.c_str(), i.second.path.c_str(),
+                    static_cast<long long>(i.second.modified), static_cast<unsigned long long>(i.second.size),
+                    i.second.exports, i.second.protocol);
+        fclose(f);
+    }
+
+    std::vector<PluginLoader::Timing> PluginLoader::load(VMContext* vm, const std::vector<std::string>& names)
+    {
+        struct Result
+        {
+            Timing timing;
+            LandruRequire req;
+            Entry entry;
+        };
+
+        std::vector<std::string> dirs = searchPath();
+        std::map<std::string, Entry> manifest;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_manifestRead)
+                readManifest();
+            manifest = _manifest;
+        }
+
+        std::vector<std::string> pending;
+        std::set<std::string> seen;
+        for (auto& name : names)
+            if (name.length() && seen.insert(name).second && !vm->hasPlugin("landru_" + name))
+                pending.push_back(name);
+
+        auto open = [&dirs, &manifest](const std::string& name) -> Result {
+            auto start = std::chrono::steady_clock::now();
+            Result r;
+            r.timing.name = name;
+            r.req.name = "landru_" + name;
+
+            // an entry from a directory no longer searched is stale
+            auto cached = manifest.find(name);
+            bool searched = false;
+            if (cached != manifest.end())
+                for (auto& dir : dirs)
+                    searched = searched || sameDirectory(dir, directoryOf(cached->second.path));
+            if (searched) {
+                int64_t modified;
+                uint64_t size;
+                if (fileStat(cached->second.path, modified, size)
+                    && modified == cached->second.modified && size == cached->second.size) {
+                    r.req.plugin = ArchLibraryOpen(cached->second.path);
+                    if (r.req.plugin) {
+                        r.entry = cached->second;
+                        bindExports(r.req, r.entry.exports);
+                        r.timing.cached = true;
+                    }
+                }
+            }
+
+            for (size_t d = 0; !r.req.plugin && d < dirs.size(); ++d)
+                for (auto& file : fileNames(name)) {
+                    std::string path = joinPath(dirs[d], file);
+                    // the platform's search can't be checked in advance
+                    if (dirs[d].length() && !fileStat(path, r.entry.modified, r.entry.size))
+                        continue;
+                    r.req.plugin = ArchLibraryOpen(path);
+                    if (r.req.plugin) {
+                        r.entry.path = path;
+                        r.entry.exports = bindExports(r.req, kAllExports);
+                        r.entry.protocol = r.req.protocol;
+                        break;
+                    }
+                }
+
+            if (r.req.plugin) {
+                r.timing.path = r.entry.path;
+                r.timing.loaded = true;
+            }
+            r.timing.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return r;
+        };
+
+        std::vector<std::future<Result>> futures;
+        for (auto& name : pending)
+            futures.push_back(std::async(std::launch::async, open, name));
+
+        std::vector<Timing> result;
+        bool dirty = false;
+        for (auto& f : futures) {
+            Result r = f.get();
+            if (r.req.plugin) {
+                vm->addPlugin(r.req);
+                // only files found on disk can be cached, not those found by the platform's search
+                if (!r.timing.cached && r.entry.path.find_first_of("/\\") != std::string::npos) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _manifest[r.timing.name] = r.entry;
+                    dirty = true;
+                }
+            }
+            result.push_back(r.timing);
+        }
+
+        if (dirty) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            writeManifest();
+        }
+        return result;
+    }
+
+} // Landru
+
+extern "C"
+void landruAddPluginSearchPath(char const*const path)
+{
+    Landru::PluginLoader::shared().addSearchPath(path);
+}
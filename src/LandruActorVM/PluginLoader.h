@@ -0,0 +1,87 @@
+//
+//  PluginLoader.h
+//  Landru
+//
+//  Finds, opens and binds plugins, the shared libraries named by require
+//  statements. require("gl") loads landru_gl.dll on Windows, landru_gl.dylib
+//  on macOS, and landru_gl.so or liblandru_gl.so elsewhere, from the
+//  directories in LANDRU_PLUGIN_PATH, then those added to the loader, and
+//  finally the platform's own library search.
+//
+//  Plugins named together are opened and bound in parallel, and added to
+//  the VMContext in the order they were named. Each plugin is opened with
+//  its symbols bound immediately, and its exports are looked up once.
+//
+//  Where each plugin was found, and which exports it has, is cached in a
+//  manifest so that later runs go straight to the file and look up only the
+//  exports it provides. An entry is used only while the file's size and
+//  modification time are unchanged. The manifest is written to
+//  LANDRU_PLUGIN_MANIFEST if it is set, and otherwise to the user's cache
+//  directory.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Landru {
+
+    class VMContext;
+
+    class PluginLoader
+    {
+    public:
+        static PluginLoader& shared();
+
+        // searched in the order added, after LANDRU_PLUGIN_PATH
+        void addSearchPath(const std::string& dir);
+        std::vector<std::string> searchPath() const;
+
+        // an empty path disables the manifest
+        void setManifestPath(const std::string& path);
+        std::string manifestPath() const;
+
+        // the file names tried for a plugin, eg landru_gl.so and liblandru_gl.so
+        static std::vector<std::string> fileNames(const std::string& plugin);
+
+        struct Timing
+        {
+            std::string name;       // as required, eg gl
+            std::string path;       // empty if not found
+            double seconds = 0;     // to find, open and bind
+            bool cached = false;    // found through the manifest
+            bool loaded = false;    // false if it wasn't found, or was already loaded
+        };
+
+        // Loads the named plugins that the context doesn't already have. A
+        // name that isn't found is not an error, because it may name a
+        // library built in to the VM, such as io.
+        std::vector<Timing> load(VMContext* vm, const std::vector<std::string>& names);
+
+    private:
+        PluginLoader();
+
+        struct Entry
+        {
+            std::string path;
+            int64_t modified = 0;
+            uint64_t size = 0;
+            uint32_t exports = 0;   // a bit per export, see PluginLoader.cpp
+            int protocol = 0;
+        };
+
+        void readManifest();
+        void writeManifest() const;
+
+        mutable std::mutex _mutex;
+        std::vector<std::string> _searchPath;
+        std::string _manifestPath;
+        std::map<std::string, Entry> _manifest;
+        bool _manifestRead = false;
+    };
+
+} // Landru
@@ -0,0 +1,170 @@
+//
+//  Profiler.cpp
+//  Landru
+//
+
+#include "Profiler.h"
+#include "DebugMap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <tuple>
+
+namespace Landru {
+
+    Profiler::~Profiler()
+    {
+        stop();
+    }
+
+    void Profiler::start(int sampleIntervalMicroseconds)
+    {
+        stop();
+        _interval = std::max(sampleIntervalMicroseconds, 1);
+        _running = true;
+        _thread = std::thread([this]() {
+            while (_running.load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_for(std::chrono::microseconds(_interval));
+                sample();
+            }
+        });
+    }
+
+    void Profiler::stop()
+    {
+        _running = false;
+        if (_thread.joinable())
+            _thread.join();
+        idle();
+    }
+
+    void Profiler::reset()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _samples.clear();
+        _idleSamples = 0;
+        std::fill(_counts.begin(), _counts.end(), 0);
+    }
+
+    void Profiler::grow(uint32_t addr)
+    {
+        _counts.resize(std::max(static_cast<size_t>(addr) + 1, _counts.size() * 2), 0);
+    }
+
+    void Profiler::sample()
+    {
+        uint32_t addr = _current.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (addr == kIdle)
+            ++_idleSamples;
+        else
+            ++_samples[addr];
+    }
+
+    uint64_t Profiler::samples() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint64_t result = _idleSamples;
+        for (auto & i : _samples)
+            result += i.second;
+        return result;
+    }
+
+    uint64_t Profiler::idleSamples() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _idleSamples;
+    }
+
+    std::vector<Profiler::Entry> Profiler::report(const DebugMap& map) const
+    {
+        typedef std::tuple<std::string, std::string, int> Key;
+        std::map<Key, Entry> totals;
+
+        auto entry = [&map, &totals](uint32_t addr) -> Entry& {
+            DebugMap::Location loc;
+            if (!map.location(addr, loc)) {
+                // no source location, fall back to the instruction's description
+                const char* str = map.lookup(addr);
+                loc.machine = "(unknown)";
+                loc.state = str ? str : "addr " + std::to_string(addr);
+            }
+            Key key(loc.machine, loc.state, loc.line);
+            auto i = totals.find(key);
+            if (i == totals.end())
+                i = totals.emplace(key, Entry { loc.machine, loc.state, loc.line, 0, 0 }).first;
+            return i->second;
+        };
+
+        for (size_t addr = 0; addr < _counts.size(); ++addr)
+            if (_counts[addr])
+                entry(static_cast<uint32_t>(addr)).instructions += _counts[addr];
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto & i : _samples)
+                entry(i.first).samples += i.second;
+        }
+
+        std::vector<Entry> result;
+        result.reserve(totals.size());
+        for (auto & i : totals)
+            result.push_back(i.second);
+
+        std::stable_sort(result.begin(), result.end(), [](const Entry& a, const Entry& b) {
+            return a.samples != b.samples ? a.samples > b.samples : a.instructions > b.instructions;
+        });
+        return result;
+    }
+
+    bool Profiler::writeCollapsed(const char* path, const DebugMap& map) const
+    {
+        FILE* f = fopen(path, "w");
+        if (!f)
+            return false;
+
+        for (auto & e : report(map)) {
+            if (!e.samples)
+                continue;
+            fprintf(f, "%s;%s", e.machine.c_str(), e.state.c_str());
+            if (e.line)
+                fprintf(f, ";line %d", e.line);
+            fprintf(f, " %llu\n", static_cast<unsigned long long>(e.samples));
+        }
+
+        uint64_t idle = idleSamples();
+        if (idle)
+            fprintf(f, "(idle) %llu\n", static_cast<unsigned long long>(idle));
+
+        fclose(f);
+        return true;
+    }
+
+    void Profiler::printTop(FILE* f, size_t count, const DebugMap& map) const
+    {
+        std::vector<Entry> entries = report(map);
+        uint64_t total = samples();
+        uint64_t idle = idleSamples();
+        double interval = sampleInterval();
+
+        fprintf(f, "%llu samples at %.3f ms, %.1f%% idle\n",
+                static_cast<unsigned long long>(total), interval * 1.e3,
+                total ? 100.0 * idle / total : 0.0);
+        fprintf(f, "%8s %10s %6s %12s  %s\n", "samples", "time ms", "%", "instructions", "location");
+
+        for (size_t i = 0; i < entries.size() && i < count; ++i) {
+            const Entry& e = entries[i];
+            std::string location = e.machine + "." + e.state;
+            if (e.line)
+                location += ":" + std::to_string(e.line);
+            fprintf(f, "%8llu %10.2f %6.1f %12llu  %s\n",
+                    static_cast<unsigned long long>(e.samples),
+                    e.samples * interval * 1.e3,
+                    total ? 100.0 * e.samples / total : 0.0,
+                    static_cast<unsigned long long>(e.instructions),
+                    location.c_str());
+        }
+    }
+
+} // Landru
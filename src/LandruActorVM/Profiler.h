@@ -0,0 +1,100 @@
+//
+//  Profiler.h
+//  Landru
+//
+//  Sampling instruction profiler. While it runs, the interpreter publishes
+//  the address of each instruction it dispatches and counts it, and a
+//  sampling thread reads the published address at a fixed interval. Samples
+//  estimate where time goes, counts say how much work was done, and both are
+//  attributed to machine, state and source line through the DebugMap, so a
+//  program to be profiled should be assembled with debug info enabled.
+//
+//  States run natively from a plugin are a single instruction, and are
+//  reported as a whole.
+//
+//  The profiler is compiled in when LANDRU_ENABLE_PROFILER is non-zero.
+//
+
+#pragma once
+
+#ifndef LANDRU_ENABLE_PROFILER
+#define LANDRU_ENABLE_PROFILER 1
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Landru {
+
+    class DebugMap;
+
+    class Profiler
+    {
+    public:
+        static const uint32_t kIdle = ~0u;
+
+        Profiler() {}
+        ~Profiler();
+
+        void start(int sampleIntervalMicroseconds = 1000);
+        void stop();
+        bool running() const { return _running.load(std::memory_order_relaxed); }
+        void reset();
+
+        // interpreter side, called for every dispatched instruction
+        void enter(uint32_t addr)
+        {
+            _current.store(addr, std::memory_order_relaxed);
+            if (addr >= _counts.size())
+                grow(addr);
+            ++_counts[addr];
+        }
+
+        // called when the interpreter returns to its host
+        void idle() { _current.store(kIdle, std::memory_order_relaxed); }
+
+        struct Entry
+        {
+            std::string machine;
+            std::string state;
+            int line;
+            uint64_t samples;
+            uint64_t instructions;
+        };
+
+        // totals by source location, most sampled first. Instruction counts
+        // are written by the interpreter without synchronization, so report
+        // from the thread running the VM or after the VM has stopped.
+        std::vector<Entry> report(const DebugMap&) const;
+
+        uint64_t samples() const;
+        uint64_t idleSamples() const;
+        double sampleInterval() const { return _interval * 1.e-6; }
+
+        // one "machine;state;line count" record per location, for flame graph tools
+        bool writeCollapsed(const char* path, const DebugMap&) const;
+        void printTop(FILE*, size_t count, const DebugMap&) const;
+
+    private:
+        void grow(uint32_t addr);
+        void sample();
+
+        std::atomic<uint32_t> _current { kIdle };
+        std::vector<uint64_t> _counts;      // by address, owned by the interpreter
+
+        mutable std::mutex _mutex;          // guards the samples
+        std::unordered_map<uint32_t, uint64_t> _samples;
+        uint64_t _idleSamples = 0;
+
+        std::thread _thread;
+        std::atomic<bool> _running { false };
+        int _interval = 1000;
+    };
+
+} // Landru
@@ -39,6 +39,7 @@ namespace Landru {
 		bool copy(std::shared_ptr<Wires::TypedData>&, bool mustBeCompatible);
 
 		void create();
+		const TypeFactory& typeFactory() const { return _typeFactory; }
 
         std::string name;
         std::string type;
@@ -7,22 +7,20 @@
 //
 
 #include "State.h"
+#include "DebugMap.h"
 
-#include "FnContext.h"
-#include "LandruActorVM/VMContext.h"
 #include <cstdint>
-#include <cstdio>
 
 namespace Landru {
 
-    uint32_t Meta::globalAddr = 0;
-        
-    void Meta::exec(FnContext& run) const 
-	{
-        std::cout << addr << ": " << str << std::endl;
-        if (run.vm->breakPoint == addr) {
-            std::cout << "Break hit" << std::endl;
-        }
+    std::atomic<uint32_t> Meta::globalAddr(0);
+
+    Meta::Meta(const char* s)
+    : addr(globalAddr.fetch_add(1, std::memory_order_relaxed))
+    {
+        DebugMap& map = DebugMap::shared();
+        if (map.enabled())
+            map.record(addr, s);
     }
     
 }
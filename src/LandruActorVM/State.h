@@ -10,8 +10,9 @@
 
 #include "LandruActorVM/LandruLibForward.h"
 
+#include <atomic>
+#include <cstdint>
 #include <functional>
-#include <iostream>
 #include <string>
 #include <vector>
 
@@ -19,17 +20,17 @@ namespace Landru {
 
     struct FnContext;
     
+    // Meta carries only the instruction's address. The descriptive string
+    // goes to the DebugMap side table, and only when debug info is enabled.
     class Meta {
     public:
-        Meta() {}
-        Meta(const std::string& s) : str(s), addr(globalAddr++) {}
-        Meta(const char* s) : str(s), addr(globalAddr++) {}
-        std::string str;
+        Meta() : addr(~0u) {}
+        Meta(const std::string& s) : Meta(s.c_str()) {}
+        Meta(const char* s);
         uint32_t addr;
         
-        static uint32_t globalAddr;
-        
-        void exec(FnContext&) const;
+        // machines may be assembled on several threads at once
+        static std::atomic<uint32_t> globalAddr;
     };
     
     class State {
@@ -30,6 +30,7 @@ namespace Landru {
             u->registerFn("2.0", "sqrt", "f", "f", sqrt);
             u->registerFn("2.0", "toggle", "i", "i", toggle);
             u->registerFn("2.0", "new", "s", "*", newFn);
+            u->registerFn("2.0", "yield", "", "", yield);
             l.registerVtable(move(u));
         }
         
@@ -38,6 +39,11 @@ namespace Landru {
 			return RunState::Continue;
 		}
         
+		RunState FiberLib::yield(FnContext& run) {
+            // suspends the rest of the state until the next update
+			return RunState::Yield;
+		}
+        
 		RunState FiberLib::add(FnContext& run) {
             float f1 = run.self->back<float>(-2);
             float f2 = run.self->pop<float>();
@@ -124,8 +130,7 @@ namespace Landru {
         
 		RunState FiberLib::newFn(FnContext& run) {
             string type = run.self->pop<string>();
-            auto factory = run.vm->libs->findFactory(type.c_str());
-            auto v = factory();
+            auto v = run.vm->libs->factory(type.c_str())();
             run.self->push(v);
 			return RunState::Continue;
         }
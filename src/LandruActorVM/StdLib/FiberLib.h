@@ -30,6 +30,7 @@ namespace Landru {
             static RunState sqrt(FnContext& run);
             static RunState toggle(FnContext& run);
             static RunState newFn(FnContext& run);
+            static RunState yield(FnContext& run);
         };
         
     } // Std
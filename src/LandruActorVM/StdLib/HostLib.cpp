@@ -0,0 +1,39 @@
+//
+//  HostLib.cpp
+//  Landru
+//
+
+#include "HostLib.h"
+#include "LandruActorVM/Fiber.h"
+#include "LandruActorVM/Library.h"
+#include "LandruActorVM/VMContext.h"
+#include <memory>
+#include <string>
+
+using namespace std;
+
+namespace Landru {
+    namespace Std {
+
+
+        //-------------
+        // Host Libary \__________________________________________
+
+        void HostLib::registerLib(Library& l) {
+            auto u = unique_ptr<Library::Vtable>(new Library::Vtable("host"));
+            u->registerFn("2.0", "event", "s", "", event);
+            l.registerVtable(move(u));
+        }
+
+        RunState HostLib::event(FnContext& run)
+        {
+            InstructionBlock instr = run.self->back<InstructionBlock>(-2);
+            string type = run.self->pop<string>();
+            run.self->popVar(); // drop the instr
+            run.vm->subscribe(type, run.vm->fiberPtr(run.self), instr);
+            return RunState::Continue;
+        }
+
+
+    } // Std
+} // Landru
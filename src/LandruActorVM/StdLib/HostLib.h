@@ -0,0 +1,29 @@
+//
+//  HostLib.h
+//  Landru
+//
+//  Events posted by the program embedding the VM, see landruPostEvents.
+//
+//      on host.event("pointer"):
+//
+
+#pragma once
+#include "LandruActorVM/LandruLibForward.h"
+
+namespace Landru {
+    namespace Std {
+
+
+        //-------------
+        // Host Libary \__________________________________________
+
+        class HostLib {
+        public:
+            static void registerLib(Library& l);
+            static RunState event(FnContext& run);
+        };
+
+
+
+    } // Std
+} // Landru
@@ -38,6 +38,19 @@ namespace Landru {
             virtual void finalize(FnContext&) override {}
             
             virtual const char* typeName() const override { return "real"; }
+
+            virtual size_t fill(float* values, size_t capacity) override {
+                size_t n = 0;
+                for (; n < capacity && curr < last; ++n, curr += incr)
+                    values[n] = curr;
+                return n;
+            }
+            virtual bool arithmetic(float& from, float& to, float& step) const override {
+                from = curr;
+                to = last;
+                step = incr;
+                return true;
+            }
             
             float first, last, incr, curr;
         };
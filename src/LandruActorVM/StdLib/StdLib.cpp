@@ -19,6 +19,7 @@ namespace Landru {
 
 void populateLibrary(Library& l, VMContext &vm) {
     Std::FiberLib::registerLib(l);
+    HostLib::registerLib(l);
     IntLib::registerLib(l);
     IoLib::registerLib(l);
     RealLib::registerLib(l);
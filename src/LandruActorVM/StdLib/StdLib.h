@@ -8,6 +8,7 @@
 
 #include "LandruActorVM/LandruLibForward.h"
 #include "FiberLib.h"
+#include "HostLib.h"
 #include "IntLib.h"
 #include "IoLib.h"
 #include "RealLib.h"
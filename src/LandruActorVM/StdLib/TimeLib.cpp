@@ -10,65 +10,244 @@
 #include "LandruActorVM/Fiber.h"
 #include "LandruActorVM/Library.h"
 #include "LandruActorVM/State.h"
+#include "LandruActorVM/TimingWheel.h"
 #include "LandruActorVM/VMContext.h"
-#include <cmath>
+#include <algorithm>
 #include <memory>
-#include <set>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 namespace {
 	using namespace Landru;
 
-	class TimeoutTuple : public OnEventEvaluator
+	// Timeouts started on the same tick, with the same period, recurrence,
+	// and statements, such as every actor of a machine running
+	// time.every(0.1) from the same state, share a single timer.
+	struct GroupKey
 	{
-	public:
-		TimeoutTuple(TimeoutTuple && rhs)
-			: OnEventEvaluator(std::move(rhs))
-			, timeout(rhs.timeout)
-			, delay(rhs.delay)
-			, recurrence(rhs.recurrence)
+		uint64_t tick;
+		double delay;
+		int recurrence;
+		uint32_t first;		// Meta::addr of the block's first and last instructions
+		uint32_t last;
+		size_t size;
+
+		bool operator==(const GroupKey& rh) const
 		{
-			rhs._detail = nullptr;
+			return tick == rh.tick && delay == rh.delay && recurrence == rh.recurrence
+				&& first == rh.first && last == rh.last && size == rh.size;
 		}
+	};
+
+	struct GroupKeyHash
+	{
+		size_t operator()(const GroupKey& k) const
+		{
+			size_t h = std::hash<uint64_t>{}(k.tick);
+			h ^= std::hash<double>{}(k.delay) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= std::hash<uint64_t>{}((uint64_t(k.first) << 32) | k.last) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return h ^ (k.size + size_t(k.recurrence) * 31);
+		}
+	};
 
-		TimeoutTuple(float timeout, float delay, std::shared_ptr<Fiber> fiberPtr, vector<Instruction> & statements, int recurrence)
-			: OnEventEvaluator(fiberPtr, statements)
-			, timeout(timeout)
-			, delay(delay)
-			, recurrence(recurrence)
-		{}
+	class TimerGroup;
+	typedef TimingWheel<shared_ptr<TimerGroup>> TimeoutWheel;
 
-		TimeoutTuple& operator=(TimeoutTuple && rhs)
+	class TimerGroup
+	{
+	public:
+		InstructionBlock instructions;
+		double delay;
+		int recurrence;		// firings remaining, -1 for forever
+
+		vector<shared_ptr<Fiber>> fibers;
+		uint32_t block = ~0u;		// VMContext::blockHandle of instructions, held until the group finishes
+		TimeoutWheel::Handle handle;
+		GroupKey key;
+		bool coalescing = false;	// registered under key
+
+		// false if the fiber is already subscribed
+		bool add(shared_ptr<Fiber> f)
 		{
-			_detail = rhs._detail;
-			timeout = rhs.timeout;
-			delay = rhs.delay;
-			recurrence = rhs.recurrence;
-			rhs._detail = nullptr;
-			return *this;
+			if (!slots.emplace(f.get(), fibers.size()).second)
+				return false;
+			fibers.push_back(std::move(f));
+			return true;
 		}
 
-		float timeout;
-		float delay;
-		int recurrence;
+		void remove(Fiber* f)
+		{
+			auto i = slots.find(f);
+			if (i == slots.end())
+				return;
+			size_t slot = i->second;
+			slots.erase(i);
+			if (slot != fibers.size() - 1) {
+				fibers[slot] = std::move(fibers.back());
+				slots[fibers[slot].get()] = slot;
+			}
+			fibers.pop_back();
+		}
+
+	private:
+		unordered_map<Fiber*, size_t> slots;	// index of each fiber in fibers
 	};
 
-    class CompareTimeout {
-    public:
-        bool operator()(const TimeoutTuple& t1, const TimeoutTuple& t2) {
-			return t2.timeout < t1.timeout;
-        }
-    };
+	// the time plugin's state in one VMContext
+	class TimeInstance
+	{
+	public:
+		explicit TimeInstance(VMContext* vm) : vm(vm) {}
 
-    multiset<TimeoutTuple, CompareTimeout> timeoutQueue;
+		void onTimeout(double now, double delay, int recurrences,
+			std::shared_ptr<Fiber> f,
+			InstructionBlock instr)
+		{
+			if (!timeouts)
+				timeouts.reset(new TimeoutWheel(1.e-3, now));
+
+			double deadline = now + delay;
+			GroupKey key;
+			bool coalescable = keyFor(deadline, delay, recurrences, *instr, key);
+			if (coalescable) {
+				auto i = groups.find(key);
+				if (i != groups.end() && i->second->add(f)) {
+					track(f.get(), i->second);
+					return;
+				}
+			}
+
+			auto group = make_shared<TimerGroup>();
+			group->instructions = std::move(instr);
+			group->delay = delay;
+			group->recurrence = recurrences;
+			group->add(f);
+			schedule(group, deadline, coalescable);
+			track(f.get(), group);
+		}
+
+		// the events stay valid until the next update
+		LandruEventSpan update(double now)
+		{
+			events.clear();
+			if (!timeouts)
+				return LandruEventSpan { nullptr, 0 };
+
+			// fire everything that has expired, rescheduling recurrences from
+			// their deadline so they don't drift. A group's statements run on
+			// each of its fibers in turn; fibers share the VMContext, so they
+			// can't run in parallel.
+			timeouts->advance(now, [this](TimeoutWheel::Handle, shared_ptr<TimerGroup>& group, double deadline) {
+				if (group->coalescing) {
+					groups.erase(group->key);
+					group->coalescing = false;
+				}
+
+				if (group->block == ~0u)
+					group->block = vm->blockHandle(group->instructions);
+				for (auto & f : group->fibers)
+					events.push_back(LandruEvent { vm->fiberHandle(f.get()), group->block, 0, {} });
+
+				if (group->recurrence > 1 || group->recurrence < 0) {
+					if (group->recurrence > 1)
+						--group->recurrence;
+					GroupKey key;
+					bool coalescable = keyFor(deadline + group->delay, group->delay, group->recurrence, *group->instructions, key);
+					schedule(group, deadline + group->delay, coalescable);
+				}
+				else
+					finish(*group);
+			});
+			return LandruEventSpan { events.data(), events.size() };
+		}
+
+		// removes the fiber from its groups, a group is cancelled when its last fiber leaves
+		void cancelTimeouts(Fiber* f)
+		{
+			auto i = fiberTimeouts.find(f);
+			if (i == fiberTimeouts.end())
+				return;
+			for (auto & weak : i->second) {
+				auto group = weak.lock();
+				if (!group)
+					continue;
+				group->remove(f);
+				if (group->fibers.empty()) {
+					timeouts->cancel(group->handle);
+					if (group->coalescing)
+						groups.erase(group->key);
+					finish(*group);
+				}
+			}
+			fiberTimeouts.erase(i);
+		}
 
+		bool pending() const { return timeouts && !timeouts->empty(); }
 
-	void onTimeout(float now, float delay, int recurrences,
-		std::shared_ptr<Fiber> f,
-		std::vector<Instruction> instr)
+	private:
+		// the events already made with the group's block still run
+		void finish(TimerGroup& group)
+		{
+			if (group.block != ~0u) {
+				vm->releaseBlockHandle(group.block);
+				group.block = ~0u;
+			}
+		}
+
+		bool keyFor(double deadline, double delay, int recurrence, const vector<Instruction>& instr, GroupKey& key) const
+		{
+			if (instr.empty() || instr.front().second.addr == ~0u || instr.back().second.addr == ~0u)
+				return false;
+			key.tick = timeouts->tickOf(deadline);
+			key.delay = delay;
+			key.recurrence = recurrence;
+			key.first = instr.front().second.addr;
+			key.last = instr.back().second.addr;
+			key.size = instr.size();
+			return true;
+		}
+
+		void schedule(const shared_ptr<TimerGroup>& group, double deadline, bool coalescable)
+		{
+			group->handle = timeouts->schedule(deadline, group);
+			if (coalescable) {
+				keyFor(deadline, group->delay, group->recurrence, *group->instructions, group->key);
+				group->coalescing = groups.emplace(group->key, group).second;
+			}
+		}
+
+		void track(Fiber* f, const shared_ptr<TimerGroup>& group)
+		{
+			auto& groups = fiberTimeouts[f];
+			if (groups.size() == groups.capacity()) {
+				// drop the groups that have finished
+				groups.erase(remove_if(groups.begin(), groups.end(),
+					[](const weak_ptr<TimerGroup>& i) { return i.expired(); }), groups.end());
+			}
+			groups.push_back(group);
+		}
+
+		VMContext* vm;
+
+		// millisecond ticks, timed from the first timeout
+		unique_ptr<TimeoutWheel> timeouts;
+
+		// groups that are still open to fibers starting a matching timeout
+		unordered_map<GroupKey, shared_ptr<TimerGroup>, GroupKeyHash> groups;
+
+		// so a fiber's timeouts can be cancelled without a scan
+		unordered_map<Fiber*, vector<weak_ptr<TimerGroup>>> fiberTimeouts;
+
+		// fired this update, reused from update to update
+		vector<LandruEvent> events;
+	};
+
+	const char* kPluginName = "time";
+
+	TimeInstance* instance(FnContext& run)
 	{
-		timeoutQueue.emplace(TimeoutTuple(now + delay, delay, f, instr, recurrences));
+		return static_cast<TimeInstance*>(run.vm->pluginInstance(kPluginName));
 	}
 
 }
@@ -89,27 +268,27 @@ namespace Landru {
         //-------------
         // Time Libary \__________________________________________
         RunState TimeLib::after(FnContext& run) {
-            vector<Instruction> instr = run.self->back<vector<Instruction>>(-2);
+            InstructionBlock instr = run.self->back<InstructionBlock>(-2);
             float delay = run.self->pop<float>();
             run.self->popVar(); // drop the instr
             int recurrences = 1;
-            onTimeout(float(run.vm->now()), delay, recurrences, run.vm->fiberPtr(run.self), instr);
+            instance(run)->onTimeout(run.vm->now(), delay, recurrences, run.vm->fiberPtr(run.self), instr);
 			return RunState::Continue;
         }
 		RunState TimeLib::every(FnContext& run) {
-            vector<Instruction> instr = run.self->back<vector<Instruction>>(-2);
+            InstructionBlock instr = run.self->back<InstructionBlock>(-2);
             float delay = run.self->pop<float>();
             run.self->popVar(); // drop the instr
             int recurrences = -1;
-            onTimeout(float(run.vm->now()), delay, recurrences, run.vm->fiberPtr(run.self), instr);
+            instance(run)->onTimeout(run.vm->now(), delay, recurrences, run.vm->fiberPtr(run.self), instr);
 			return RunState::Continue;
 		}
 		RunState TimeLib::recur(FnContext& run) {
-            vector<Instruction> instr = run.self->back<vector<Instruction>>(-3);
+            InstructionBlock instr = run.self->back<InstructionBlock>(-3);
             int recurrences = run.self->pop<int>();
             float delay = run.self->pop<float>();
             run.self->popVar(); // drop the instr
-            onTimeout(float(run.vm->now()), delay, recurrences, run.vm->fiberPtr(run.self), instr);
+            instance(run)->onTimeout(run.vm->now(), delay, recurrences, run.vm->fiberPtr(run.self), instr);
 			return RunState::Continue;
 		}
 
@@ -135,49 +314,42 @@ void landru_time_init(Landru::Library* lib)
 
 extern "C"
 LANDRUTIME_API
-RunState landru_time_update(double now, VMContext* vm)
+void* landru_time_createInstance(VMContext* vm)
 {
-    // check all timeouts and allow them to fire if they've expired
-    while (!timeoutQueue.empty()) {
-        auto curr = timeoutQueue.begin();
-        if (curr->timeout > now)
-            break;
-
-//			auto& testMe = _detail->timeoutQueue.top();
-//            if (testMe.timeout > now) {
-//                break;
-//            }
-        TimeoutTuple i = std::move(const_cast<TimeoutTuple&>(*curr));
-        timeoutQueue.erase(curr);
-
-//			TimeoutTuple i = std::move(const_cast<TimeoutTuple&>(timeoutQueue.top()));
-//            timeoutQueue.pop();
-
-        float t = i.timeout;
-        if (t <= now) {
-            auto& statements = i.instructions();
-            FnContext fn = {vm, i.fiber(), nullptr};
-            if (vm->traceEnabled)
-                for (auto& s : statements) {
-                    s.second.exec(fn);
-                    s.first(fn);
-                }
-            else
-                for (auto& s : statements) {
-                    s.first(fn);
-                }
-
-            int recurrence = i.recurrence;
-            if (recurrence > 1 || recurrence < 0) {
-                int newRecurrence = recurrence > 1 ? recurrence - 1 : -1;
-                float delay = i.delay;
-                timeoutQueue.emplace(TimeoutTuple(t + delay, delay, i.fiberPtr(), statements, newRecurrence));
-            }
-        }
-    }
+    return new TimeInstance(vm);
+}
+
+extern "C"
+LANDRUTIME_API
+void landru_time_destroyInstance(void* instance)
+{
+    delete static_cast<TimeInstance*>(instance);
+}
+
+extern "C"
+LANDRUTIME_API
+RunState landru_time_update(void* instance, double now, VMContext* vm)
+{
+    // for hosts that don't bind updateEvents
+    LandruEventSpan fired = static_cast<TimeInstance*>(instance)->update(now);
+    vm->postEvents(fired.events, fired.count);
     return RunState::Continue;
 }
 
+extern "C"
+LANDRUTIME_API
+LandruEventSpan landru_time_updateEvents(void* instance, double now, VMContext*)
+{
+    return static_cast<TimeInstance*>(instance)->update(now);
+}
+
+extern "C"
+LANDRUTIME_API
+int landru_time_protocol()
+{
+    return 2;
+}
+
 extern "C"
 LANDRUTIME_API
 void landru_time_finish(Landru::Library*)
@@ -186,42 +358,41 @@ void landru_time_finish(Landru::Library*)
 
 extern "C"
 LANDRUTIME_API
-void landru_time_fiberExpiring(Fiber* f)
+void landru_time_fiberExpiring(void* instance, Fiber* f)
 {
 //    called when Fibers are destroyed so that pending items like onWindowsClosed can be removed
+    static_cast<TimeInstance*>(instance)->cancelTimeouts(f);
 }
 
 extern "C"
 LANDRUTIME_API
-void landru_time_clearContinuations(Fiber* f, int level)
+void landru_time_clearContinuations(void* instance, Fiber* f, int level)
 {
-    for (multiset<TimeoutTuple, CompareTimeout>::iterator i = timeoutQueue.begin(); i != timeoutQueue.end(); ++i) {
-		if (i->fiber() == f) {
-            i = timeoutQueue.erase(i);
-            if (i == timeoutQueue.end())
-                break;
-        }
-    }
+    static_cast<TimeInstance*>(instance)->cancelTimeouts(f);
 }
 
 extern "C"
 LANDRUTIME_API
-bool landru_time_pendingContinuations(Fiber * f)
+bool landru_time_pendingContinuations(void* instance, Fiber * f)
 {
-	return !timeoutQueue.empty();
+	return static_cast<TimeInstance*>(instance)->pending();
 }
 
 void create_time_plugin(VMContext& vm)
 {
 	Landru::LandruRequire plugin;
-	plugin.clearContinuations = landru_time_clearContinuations;
-	plugin.fiberExpiring = landru_time_fiberExpiring;
+	plugin.createInstance = landru_time_createInstance;
+	plugin.destroyInstance = landru_time_destroyInstance;
+	plugin.instanceClearContinuations = landru_time_clearContinuations;
+	plugin.instanceFiberExpiring = landru_time_fiberExpiring;
 	plugin.finish = landru_time_finish;
 	plugin.init = landru_time_init;
-	plugin.name = "time";
-	plugin.pendingContinuations = landru_time_pendingContinuations;
-	plugin.update = landru_time_update;
-	vm.plugins.push_back(plugin);
+	plugin.name = kPluginName;
+	plugin.instancePendingContinuations = landru_time_pendingContinuations;
+	plugin.instanceUpdate = landru_time_update;
+	plugin.updateEvents = landru_time_updateEvents;
+	plugin.protocol = landru_time_protocol();
+	vm.addPlugin(plugin);
 }
 
 
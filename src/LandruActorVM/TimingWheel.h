@@ -0,0 +1,292 @@
+//
+//  TimingWheel.h
+//  Landru
+//
+//  Hierarchical timing wheel. Timers live in a slab and are threaded onto
+//  intrusive slot lists, so scheduling and cancelling are O(1) and a
+//  cancelled timer's storage is reused. Four levels of 256 slots cover 2^32
+//  ticks; timers further out are parked at the top level and cascaded down
+//  until they are in range.
+//
+//  Time is in double precision seconds. Timers fire in deadline tick order,
+//  no earlier than their deadline and at most one tick after it. Timers due
+//  on the same tick are expired as a batch, ordered by deadline and then by
+//  the order they were scheduled in.
+//
+//  Handles carry a generation, so a handle to a timer that has fired or been
+//  cancelled is harmlessly invalid, even once its slot has been reused. A
+//  timer in the batch being expired can still be cancelled by the callback
+//  for an earlier one; it is then skipped.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Landru {
+
+    template <typename T>
+    class TimingWheel
+    {
+    public:
+        struct Handle
+        {
+            uint32_t index = ~0u;
+            uint32_t generation = 0;
+        };
+
+        explicit TimingWheel(double tickSeconds = 1.e-3, double now = 0)
+        : _tick(tickSeconds), _origin(now)
+        {
+            _heads.assign(kLevels * kSlots, kNil);
+        }
+
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+        double tickSeconds() const { return _tick; }
+
+        // the time the wheel has been advanced to
+        double now() const { return _origin + _current * _tick; }
+
+        // the tick a timer with this deadline would expire on
+        uint64_t tickOf(double deadline) const
+        {
+            double ticks = std::ceil((deadline - _origin) / _tick);
+            uint64_t t = ticks > 0 ? static_cast<uint64_t>(ticks) : 0;
+            return t > _current ? t : _current + 1;     // the current tick has already expired
+        }
+
+        Handle schedule(double deadline, T value)
+        {
+            uint32_t index = allocate();
+            Node& n = _nodes[index];
+            n.value = std::move(value);
+            n.deadline = deadline;
+            n.sequence = _sequence++;
+            n.tick = tickOf(deadline);
+            link(index);
+            ++_size;
+            return Handle { index, n.generation };
+        }
+
+        bool valid(Handle h) const
+        {
+            return h.index < _nodes.size() && _nodes[h.index].generation == h.generation
+                && _nodes[h.index].slot != kFree;
+        }
+
+        T* get(Handle h) { return valid(h) ? &_nodes[h.index].value : nullptr; }
+
+        bool cancel(Handle h)
+        {
+            if (!valid(h))
+                return false;
+            Node& n = _nodes[h.index];
+            if (n.slot == kDetached) {
+                // advance owns the node until it reaches it in the batch
+                n.slot = kCancelled;
+                ++n.generation;
+                --_size;
+                return true;
+            }
+            unlink(h.index);
+            release(h.index);
+            return true;
+        }
+
+        // Expires every timer due by now. fn(Handle, T&, double deadline) is
+        // called for each; it may schedule and cancel timers, and timers it
+        // schedules for the past fire on a later advance.
+        template <typename Fn>
+        void advance(double now, Fn&& fn)
+        {
+            double ticks = std::floor((now - _origin) / _tick);
+            uint64_t target = ticks > 0 ? static_cast<uint64_t>(ticks) : 0;
+
+            while (_current < target) {
+                if (!_size) {
+                    _current = target;
+                    break;
+                }
+
+                ++_current;
+                for (int level = 1; level < kLevels; ++level) {
+                    if (_current & ((uint64_t(1) << (kBits * level)) - 1))
+                        break;
+                    cascade(level, (_current >> (kBits * level)) & kMask);
+                }
+
+                uint32_t& head = _heads[_current & kMask];
+                if (head == kNil)
+                    continue;
+
+                // detach the slot so that fn can schedule freely
+                _expiring.clear();
+                for (uint32_t i = head; i != kNil; ) {
+                    Node& n = _nodes[i];
+                    _expiring.push_back(Handle { i, n.generation });
+                    i = n.next;
+                    n.slot = kDetached;
+                    n.prev = n.next = kNil;
+                }
+                head = kNil;
+
+                std::sort(_expiring.begin(), _expiring.end(), [this](Handle a, Handle b) {
+                    const Node& na = _nodes[a.index];
+                    const Node& nb = _nodes[b.index];
+                    return na.deadline != nb.deadline ? na.deadline < nb.deadline : na.sequence < nb.sequence;
+                });
+
+                // fn may cancel timers later in the batch, or clear the wheel
+                for (size_t e = 0; e < _expiring.size(); ++e) {
+                    Handle h = _expiring[e];
+                    if (h.index >= _nodes.size())
+                        break;
+                    Node& n = _nodes[h.index];
+                    if (n.generation != h.generation) {
+                        if (n.slot == kCancelled)
+                            recycle(h.index);
+                        continue;
+                    }
+                    T value = std::move(n.value);
+                    double deadline = n.deadline;
+                    release(h.index);
+                    fn(h, value, deadline);
+                }
+            }
+        }
+
+        template <typename Fn>
+        void forEach(Fn&& fn)
+        {
+            for (uint32_t i = 0; i < _nodes.size(); ++i)
+                if (_nodes[i].slot < kLevels * kSlots)
+                    fn(Handle { i, _nodes[i].generation }, _nodes[i].value);
+        }
+
+        void clear()
+        {
+            _nodes.clear();
+            _expiring.clear();
+            _free = kNil;
+            _size = 0;
+            _heads.assign(kLevels * kSlots, kNil);
+        }
+
+    private:
+        static const int kBits = 8;
+        static const int kLevels = 4;
+        static const uint32_t kSlots = 1u << kBits;
+        static const uint64_t kMask = kSlots - 1;
+        static const uint32_t kNil = ~0u;
+        static const uint32_t kFree = ~0u;
+        static const uint32_t kDetached = ~0u - 1;     // in the batch being expired
+        static const uint32_t kCancelled = ~0u - 2;    // cancelled while detached
+
+        struct Node
+        {
+            T value;
+            double deadline;
+            uint64_t tick;
+            uint64_t sequence;
+            uint32_t next;
+            uint32_t prev;
+            uint32_t slot;
+            uint32_t generation;
+        };
+
+        uint32_t allocate()
+        {
+            if (_free != kNil) {
+                uint32_t i = _free;
+                _free = _nodes[i].next;
+                return i;
+            }
+            _nodes.push_back(Node { T(), 0, 0, 0, kNil, kNil, kFree, 0 });
+            return static_cast<uint32_t>(_nodes.size() - 1);
+        }
+
+        void release(uint32_t i)
+        {
+            ++_nodes[i].generation;
+            recycle(i);
+            --_size;
+        }
+
+        void recycle(uint32_t i)
+        {
+            Node& n = _nodes[i];
+            n.value = T();
+            n.slot = kFree;
+            n.prev = kNil;
+            n.next = _free;
+            _free = i;
+        }
+
+        uint32_t slotFor(uint64_t tick) const
+        {
+            uint64_t delta = tick ^ _current;
+            for (int level = 0; level < kLevels; ++level) {
+                if (delta < (uint64_t(1) << (kBits * (level + 1))))
+                    return level * kSlots + static_cast<uint32_t>((tick >> (kBits * level)) & kMask);
+            }
+            // out of range, park in the top level slot that cascades last
+            uint64_t top = (_current >> (kBits * (kLevels - 1))) - 1;
+            return (kLevels - 1) * kSlots + static_cast<uint32_t>(top & kMask);
+        }
+
+        void link(uint32_t i)
+        {
+            Node& n = _nodes[i];
+            n.slot = slotFor(n.tick);
+            uint32_t& head = _heads[n.slot];
+            n.prev = kNil;
+            n.next = head;
+            if (head != kNil)
+                _nodes[head].prev = i;
+            head = i;
+        }
+
+        void unlink(uint32_t i)
+        {
+            Node& n = _nodes[i];
+            if (n.prev != kNil)
+                _nodes[n.prev].next = n.next;
+            else
+                _heads[n.slot] = n.next;
+            if (n.next != kNil)
+                _nodes[n.next].prev = n.prev;
+        }
+
+        // redistributes a higher level slot as the lower levels reach it
+        void cascade(int level, uint64_t slot)
+        {
+            uint32_t& head = _heads[level * kSlots + static_cast<uint32_t>(slot)];
+            uint32_t i = head;
+            head = kNil;
+            while (i != kNil) {
+                uint32_t next = _nodes[i].next;
+                link(i);
+                i = next;
+            }
+        }
+
+        double _tick;
+        double _origin;
+        uint64_t _current = 0;
+        uint64_t _sequence = 0;
+        size_t _size = 0;
+        uint32_t _free = kNil;
+        std::vector<Node> _nodes;
+        std::vector<uint32_t> _heads;
+        std::vector<Handle> _expiring;
+    };
+
+    template <typename T>
+    const uint32_t TimingWheel<T>::kNil;
+
+} // Landru
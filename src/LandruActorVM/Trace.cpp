@@ -0,0 +1,105 @@
+//
+//  Trace.cpp
+//  Landru
+//
+
+#include "Trace.h"
+#include "DebugMap.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace Landru {
+
+    namespace {
+        const char kTraceMagic[4] = { 'L', 'T', 'R', 'C' };
+        const uint32_t kTraceVersion = 1;
+
+        struct TraceFileHeader
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t debugEntries;
+            uint32_t recordSize;
+            uint64_t recordCount;
+        };
+    }
+
+    TraceBuffer::TraceBuffer(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        _records.resize(size);
+        _mask = size - 1;
+    }
+
+    uint64_t traceTicks()
+    {
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    bool writeTraceFile(const char* path, const std::vector<TraceRecord>& records, const DebugMap& map)
+    {
+        FILE* f = fopen(path, "wb");
+        if (!f)
+            return false;
+
+        auto entries = map.entries();
+
+        TraceFileHeader header;
+        memcpy(header.magic, kTraceMagic, sizeof(kTraceMagic));
+        header.version = kTraceVersion;
+        header.debugEntries = static_cast<uint32_t>(entries.size());
+        header.recordSize = static_cast<uint32_t>(sizeof(TraceRecord));
+        header.recordCount = records.size();
+        fwrite(&header, sizeof(header), 1, f);
+
+        for (auto& e : entries) {
+            uint32_t len = static_cast<uint32_t>(e.second.length());
+            fwrite(&e.first, sizeof(uint32_t), 1, f);
+            fwrite(&len, sizeof(uint32_t), 1, f);
+            fwrite(e.second.data(), 1, len, f);
+        }
+
+        if (records.size())
+            fwrite(records.data(), sizeof(TraceRecord), records.size(), f);
+
+        fclose(f);
+        return true;
+    }
+
+    bool readTraceFile(const char* path, std::vector<TraceRecord>& records,
+                       std::vector<std::pair<uint32_t, std::string>>& debugEntries)
+    {
+        FILE* f = fopen(path, "rb");
+        if (!f)
+            return false;
+
+        TraceFileHeader header;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1
+               && !memcmp(header.magic, kTraceMagic, sizeof(kTraceMagic))
+               && header.version == kTraceVersion
+               && header.recordSize == sizeof(TraceRecord);
+
+        for (uint32_t i = 0; ok && i < header.debugEntries; ++i) {
+            uint32_t addr, len;
+            ok = fread(&addr, sizeof(uint32_t), 1, f) == 1 && fread(&len, sizeof(uint32_t), 1, f) == 1;
+            if (ok) {
+                std::string str(len, '\0');
+                ok = !len || fread(&str[0], 1, len, f) == len;
+                debugEntries.emplace_back(addr, std::move(str));
+            }
+        }
+
+        if (ok && header.recordCount) {
+            records.resize(static_cast<size_t>(header.recordCount));
+            ok = fread(records.data(), sizeof(TraceRecord), records.size(), f) == records.size();
+        }
+
+        fclose(f);
+        return ok;
+    }
+
+} // Landru
@@ -0,0 +1,86 @@
+//
+//  Trace.h
+//  Landru
+//
+//  Compact binary instruction trace. The VM writes one TraceRecord per
+//  executed instruction into a lock-free single producer, single consumer
+//  ring; a consumer drains it, or writes it to a file together with the
+//  DebugMap so that landru-trace can decode it offline.
+//
+//  Tracing is compiled in when LANDRU_ENABLE_TRACE is non-zero. With it off,
+//  the interpreter loops contain no trace checks at all.
+//
+
+#pragma once
+
+#ifndef LANDRU_ENABLE_TRACE
+#define LANDRU_ENABLE_TRACE 1
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Landru {
+
+    class DebugMap;
+
+    struct TraceRecord
+    {
+        uint64_t ticks;     // steady clock ticks when the instruction was dispatched
+        uint32_t addr;      // Meta::addr of the instruction
+        uint32_t fiber;     // truncated hash of the executing fiber
+    };
+
+    class TraceBuffer
+    {
+    public:
+        // capacity is rounded up to a power of two
+        explicit TraceBuffer(size_t capacity = 1 << 16);
+
+        // producer side; returns false and counts a drop if the ring is full
+        bool push(const TraceRecord& r)
+        {
+            uint64_t head = _head.load(std::memory_order_relaxed);
+            if (head - _tail.load(std::memory_order_acquire) > _mask) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            _records[head & _mask] = r;
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer side
+        template <typename Fn>
+        size_t drain(Fn&& fn)
+        {
+            uint64_t tail = _tail.load(std::memory_order_relaxed);
+            uint64_t head = _head.load(std::memory_order_acquire);
+            size_t count = 0;
+            for (; tail != head; ++tail, ++count)
+                fn(_records[tail & _mask]);
+            _tail.store(tail, std::memory_order_release);
+            return count;
+        }
+
+        uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    private:
+        std::vector<TraceRecord> _records;
+        uint64_t _mask;
+        std::atomic<uint64_t> _head { 0 };
+        std::atomic<uint64_t> _tail { 0 };
+        std::atomic<uint64_t> _dropped { 0 };
+    };
+
+    uint64_t traceTicks();
+
+    // trace files are a small header, the debug map, then the raw records
+    bool writeTraceFile(const char* path, const std::vector<TraceRecord>&, const DebugMap&);
+    bool readTraceFile(const char* path, std::vector<TraceRecord>&,
+                       std::vector<std::pair<uint32_t, std::string>>& debugEntries);
+
+} // Landru
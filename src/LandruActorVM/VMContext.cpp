@@ -9,12 +9,21 @@
 #include "LandruActorVM/VMContext.h"
 #include "Landru/Landru.h"
 
+#include "DebugMap.h"
 #include "Exception.h"
 #include "FnContext.h"
 #include "LandruActorVM/Fiber.h"
 #include "Library.h"
+#include "MachineDefinition.h"
+#include "MpscQueue.h"
+#include "NativeState.h"
+#include "Profiler.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
 #include <list>
 #include <map>
+#include <mutex>
 #include <queue>
 #include <set>
 #include <tuple>
@@ -27,11 +36,11 @@ namespace Landru {
     : _detail(new Detail())
     {}
 
-    OnEventEvaluator::OnEventEvaluator(std::shared_ptr<Fiber> f, std::vector<Instruction>& vi)
+    OnEventEvaluator::OnEventEvaluator(std::shared_ptr<Fiber> f, InstructionBlock vi)
     : _detail(new Detail())
     {
         _detail->fiber = f;
-        _detail->instructions = vi;
+        _detail->instructions = std::move(vi);
     }
 
     OnEventEvaluator::~OnEventEvaluator()
@@ -42,6 +51,14 @@ namespace Landru {
 
     typedef vector<OnEventEvaluator> MessageQueue;
 
+	// a batch of records posted by the host
+	struct VMContext::HostEvents
+	{
+		uint32_t type = 0;
+		size_t count = 0;
+		vector<float> fields;       // count records of the type's fields
+	};
+
     class VMContext::Detail {
     public:
         Detail() : now(0) {}
@@ -49,6 +66,8 @@ namespace Landru {
 		~Detail()
 		{
 			gotos.clear();
+			scheduled.clear();
+			suspended.clear();
 			messageQueue.clear();
 			pendingMessages.clear();
 			fibers.clear();
@@ -57,13 +76,101 @@ namespace Landru {
 
         double now;
 
+        uint64_t epoch = 0;     // incremented every update
+        uint32_t budgetInstructions = 0;
+        chrono::steady_clock::duration budgetTime = chrono::steady_clock::duration::zero();
+
         map<Id, shared_ptr<Fiber>> fibers;
 
         set<Id> pendingMessages;
         map<Id, MessageQueue> messageQueue;
 
 		std::deque<std::pair<std::shared_ptr<Fiber>, std::string>> gotos;
+		std::deque<std::pair<std::shared_ptr<Fiber>, InstructionBlock>> scheduled;
+
+		// plugin events, see LandruEvent
+		uint64_t nextFiberHandle = 0;
+		unordered_map<uint64_t, weak_ptr<Fiber>> fiberHandles;
+		vector<InstructionBlock> blocks;                        // by handle
+		vector<uint32_t> blockRefs;                             // by handle
+		unordered_map<const vector<Instruction>*, uint32_t> blockHandles;
+		vector<uint32_t> releasedBlocks;                        // freed at the end of the update
+		vector<uint32_t> freeBlocks;
+		MpscQueue<vector<LandruEvent>> posted;
+		vector<LandruEventSpan> spans;                          // returned by the plugins this update
+
+		// host events, see registerEventType
+		struct EventType
+		{
+			string name;
+			uint32_t fields = 0;
+			bool registered = false;                            // by the host, rather than only subscribed to
+			vector<pair<shared_ptr<Fiber>, InstructionBlock>> subscribers;
+			uint64_t unsubscribed = 0;                          // counts removals from subscribers
+		};
+		vector<EventType> eventTypes;                           // by type
+		unordered_map<string, uint32_t> eventTypeIds;
+
+		// Held to add event types or change their fields, and by readers of
+		// those on threads other than the one running the context
+		mutable mutex eventTypesLock;
+		MpscQueue<HostEvents> hostEvents;
+
+		uint32_t internEventType(const string& name)
+		{
+			auto i = eventTypeIds.find(name);
+			if (i != eventTypeIds.end())
+				return i->second;
+			lock_guard<mutex> lock(eventTypesLock);
+			uint32_t type = static_cast<uint32_t>(eventTypes.size());
+			eventTypes.emplace_back();
+			eventTypes.back().name = name;
+			eventTypeIds[name] = type;
+			return type;
+		}
+		vector<shared_ptr<Fiber>> suspended;
 		std::map<std::string, std::shared_ptr<MachineDefinition>> machineDefinitions;
+
+		// definitions replaced by a reload, kept while a fiber may still be
+		// running their instructions
+		vector<shared_ptr<MachineDefinition>> retired;
+
+		// The definitions, with those that have native states replaced by
+		// copies running them. Definitions may be shared with other contexts,
+		// so they aren't changed in place.
+		std::map<std::string, std::shared_ptr<MachineDefinition>>
+		useNativeStates(const std::map<std::string, std::shared_ptr<MachineDefinition>>& definitions,
+		                const vector<LandruRequire>& plugins, Library* libs)
+		{
+			NativeStates native;
+			for (auto & p : plugins)
+				if (p.nativeStates)
+					p.nativeStates(&native, libs);
+
+			if (native.empty())
+				return definitions;
+
+			std::map<std::string, std::shared_ptr<MachineDefinition>> result;
+			for (auto & m : definitions) {
+				shared_ptr<MachineDefinition> d = m.second;
+				for (auto & s : m.second->states) {
+					NativeStateFn fn = native.find(m.first, s.first);
+					if (!fn)
+						continue;
+					if (d == m.second)
+						d = make_shared<MachineDefinition>(*m.second);
+					string str = "native state " + m.first + "." + s.first;
+					State* state = d->states[s.first];
+					state->instructions.clear();
+					state->instructions.emplace_back(Instruction(fn, str.c_str()));
+				}
+				result[m.first] = d;
+			}
+			return result;
+		}
+
+		TraceBuffer trace;
+		Profiler profiler;
 	};
 
     VMContext::VMContext(Library* l)
@@ -76,11 +183,63 @@ namespace Landru {
 
     VMContext::~VMContext() 
 	{
+		for (auto & p : plugins)
+			if (p.instance && p.destroyInstance)
+				p.destroyInstance(p.instance);
     }
 
+	bool VMContext::addPlugin(const LandruRequire& plugin)
+	{
+		if (hasPlugin(plugin.name))
+			return false;
+		plugins.push_back(plugin);
+		LandruRequire& p = plugins.back();
+		p.instance = p.createInstance ? p.createInstance(this) : nullptr;
+		return true;
+	}
+
+	bool VMContext::hasPlugin(const std::string& name) const
+	{
+		for (auto & p : plugins)
+			if (p.name == name)
+				return true;
+		return false;
+	}
+
+	void* VMContext::pluginInstance(const std::string& name) const
+	{
+		for (auto & p : plugins)
+			if (p.name == name)
+				return p.instance;
+		return nullptr;
+	}
+
     void VMContext::setDefinitions(const std::map<std::string, std::shared_ptr<MachineDefinition>>& d)
     {
-        _detail->machineDefinitions = d;
+        _detail->machineDefinitions = _detail->useNativeStates(d, plugins, libs);
+    }
+
+    void VMContext::replaceDefinitions(const std::map<std::string, std::shared_ptr<MachineDefinition>>& definitions)
+    {
+        auto d = _detail->useNativeStates(definitions, plugins, libs);
+
+        // fibers hold their definition, so one no fiber holds has finished
+        auto & retired = _detail->retired;
+        retired.erase(remove_if(retired.begin(), retired.end(),
+            [](const shared_ptr<MachineDefinition>& m) { return m.use_count() == 1; }), retired.end());
+
+        for (auto & m : d) {
+            auto & current = _detail->machineDefinitions[m.first];
+            if (current)
+                retired.push_back(current);
+            current = m.second;
+        }
+
+        for (auto & f : _detail->fibers) {
+            auto m = d.find(f.second->machineDefinition->name);
+            if (m != d.end())
+                f.second->pendingDefinition = m->second;
+        }
     }
 
 	std::vector<std::string> VMContext::definitions() const
@@ -91,6 +250,12 @@ namespace Landru {
         return r;
     }
 
+    std::shared_ptr<MachineDefinition> VMContext::definition(const std::string& name) const
+    {
+        auto i = _detail->machineDefinitions.find(name);
+        return i != _detail->machineDefinitions.end() ? i->second : std::shared_ptr<MachineDefinition>();
+    }
+
     std::vector<std::shared_ptr<Fiber>> VMContext::fibers() const
     {
         vector<shared_ptr<Fiber>> r;
@@ -105,8 +270,16 @@ namespace Landru {
 
     bool VMContext::deferredMessagesPending() const
 	{
+		if (suspendedFibersPending() || postedEventsPending())
+			return true;
+
+		// fibers waiting on the host
+		for (auto & t : _detail->eventTypes)
+			if (!t.subscribers.empty())
+				return true;
+
 		for (auto & p : plugins)
-			if (p.pendingContinuations && p.pendingContinuations(nullptr))
+			if (p.callPendingContinuations(nullptr))
 				return true;
 
 		return false;
@@ -139,12 +312,51 @@ namespace Landru {
 			}
 		}
 
-		for (auto & p : plugins) {
-			if (p.clearContinuations)
-				p.clearContinuations(f, level);
+		for (auto & t : _detail->eventTypes) {
+			auto & s = t.subscribers;
+			auto end = remove_if(s.begin(), s.end(),
+				[f](const pair<shared_ptr<Fiber>, InstructionBlock>& i) { return i.first.get() == f; });
+			if (end != s.end()) {
+				s.erase(end, s.end());
+				++t.unsubscribed;
+			}
 		}
+
+		for (auto & p : plugins)
+			p.callClearContinuations(f, level);
 	}
 
+    void VMContext::traceInstruction(const Meta& meta, const Fiber* f)
+    {
+        TraceRecord r;
+        r.ticks = traceTicks();
+        r.addr = meta.addr;
+        r.fiber = static_cast<uint32_t>(std::hash<const Fiber*>{}(f));
+        _detail->trace.push(r);
+
+        if (breakPoint == meta.addr) {
+            const char* str = DebugMap::shared().lookup(meta.addr);
+            cerr << "Break hit at " << meta.addr << ": " << (str ? str : "") << endl;
+        }
+    }
+
+    TraceBuffer& VMContext::traceBuffer()
+    {
+        return _detail->trace;
+    }
+
+    bool VMContext::writeTrace(const char* path)
+    {
+        vector<TraceRecord> records;
+        _detail->trace.drain([&records](const TraceRecord& r) { records.push_back(r); });
+        return writeTraceFile(path, records, DebugMap::shared());
+    }
+
+    Profiler& VMContext::profiler()
+    {
+        return _detail->profiler;
+    }
+
     void VMContext::instantiateLibs()
     {
     }
@@ -152,6 +364,7 @@ namespace Landru {
     void VMContext::update(double now)
     {
         _detail->now = now;
+        ++_detail->epoch;
 
         // launch all machines that were requested
         while (!launchQueue.empty())
@@ -163,6 +376,8 @@ namespace Landru {
 				if (m != _detail->machineDefinitions.end()) {
 					std::shared_ptr<Landru::Fiber> f = std::make_shared<Landru::Fiber>(m->second, this);
 					_detail->fibers[f->id()] = f;
+					f->handle = ++_detail->nextFiberHandle;
+					_detail->fiberHandles[f->handle] = f;
 					_detail->messageQueue[f->id()] = vector<OnEventEvaluator>();   //// @TODO emplace queues only when needed at first access
 					try {
 						FnContext fn(this, f.get(), nullptr);
@@ -174,6 +389,7 @@ namespace Landru {
 						auto i = _detail->fibers.find(f->id());
 						if (i != _detail->fibers.end())
 							_detail->fibers.erase(i);
+						_detail->fiberHandles.erase(f->handle);
 					}
 				}
 				else {
@@ -182,9 +398,47 @@ namespace Landru {
 			}
         }
 
+		// resume the fibers that yielded during the last update
+		if (!_detail->suspended.empty()) {
+			vector<shared_ptr<Fiber>> resuming;
+			swap(resuming, _detail->suspended);
+			for (auto & f : resuming) {
+				f->suspended = false;
+				if (f->frames.empty() || _detail->fibers.find(f->id()) == _detail->fibers.end())
+					continue;
+				FnContext fn(this, f.get(), nullptr);
+				fn.resume();
+			}
+		}
+
+		_detail->spans.clear();
 		for (auto & p : plugins) {
-			if (p.update)
-				p.update(now, this);
+			if (p.updateEvents) {
+				LandruEventSpan span = p.updateEvents(p.instance, now, this);
+				if (span.count)
+					_detail->spans.push_back(span);
+			}
+			else if (p.hasUpdate())
+				p.callUpdate(now, this);
+		}
+
+		// run the events the plugins returned, then those posted since the last update
+		for (auto & span : _detail->spans)
+			runEvents(span.events, span.count);
+		vector<LandruEvent> posted;
+		while (_detail->posted.pop(posted))
+			runEvents(posted.data(), posted.size());
+		freeReleasedBlocks();
+		HostEvents hostEvents;
+		while (_detail->hostEvents.pop(hostEvents))
+			runHostEvents(hostEvents);
+
+		// fire the on statements the plugins scheduled
+		while (!_detail->scheduled.empty()) {
+			auto s = std::move(_detail->scheduled.front());
+			_detail->scheduled.pop_front();
+			FnContext fn(this, s.first.get(), nullptr);
+			fn.run(s.second);
 		}
 
         // send all pending messages
@@ -216,12 +470,238 @@ namespace Landru {
 
 	void VMContext::finalizeGotos()
 	{
+		// a fiber that has used up its slice changes state on the next
+		// update, so states that go to each other can't monopolize an update
+		std::deque<std::pair<std::shared_ptr<Fiber>, std::string>> deferred;
 		while (_detail->gotos.begin() != _detail->gotos.end()) {
 			auto i = _detail->gotos.front();
+			if (overBudget(i.first.get())) {
+				deferred.push_back(i);
+				_detail->gotos.pop_front();
+				continue;
+			}
 			FnContext run = { this, i.first.get(), nullptr };
 			i.first->gotoState(run, i.second.c_str(), true);
 			_detail->gotos.pop_front();
 		}
+		swap(_detail->gotos, deferred);
+	}
+
+	void VMContext::schedule(std::shared_ptr<Fiber> f, const std::vector<Instruction>& instructions)
+	{
+		if (f)
+			_detail->scheduled.emplace_back(f, make_shared<const vector<Instruction>>(instructions));
+	}
+
+	void VMContext::schedule(std::shared_ptr<Fiber> f, InstructionBlock instructions)
+	{
+		if (f && instructions)
+			_detail->scheduled.emplace_back(std::move(f), std::move(instructions));
+	}
+
+	uint64_t VMContext::fiberHandle(const Fiber* f) const
+	{
+		return f->handle;
+	}
+
+	uint32_t VMContext::blockHandle(const InstructionBlock& block)
+	{
+		auto i = _detail->blockHandles.find(block.get());
+		if (i != _detail->blockHandles.end()) {
+			++_detail->blockRefs[i->second];
+			return i->second;
+		}
+		uint32_t handle;
+		if (!_detail->freeBlocks.empty()) {
+			handle = _detail->freeBlocks.back();
+			_detail->freeBlocks.pop_back();
+			_detail->blocks[handle] = block;
+			_detail->blockRefs[handle] = 1;
+		}
+		else {
+			handle = static_cast<uint32_t>(_detail->blocks.size());
+			_detail->blocks.push_back(block);
+			_detail->blockRefs.push_back(1);
+		}
+		_detail->blockHandles[block.get()] = handle;
+		return handle;
+	}
+
+	void VMContext::releaseBlockHandle(uint32_t handle)
+	{
+		if (handle >= _detail->blocks.size() || !_detail->blockRefs[handle])
+			return;
+		if (!--_detail->blockRefs[handle])
+			_detail->releasedBlocks.push_back(handle);
+	}
+
+	void VMContext::freeReleasedBlocks()
+	{
+		for (uint32_t handle : _detail->releasedBlocks) {
+			// it may have been handed out again since
+			InstructionBlock& block = _detail->blocks[handle];
+			if (!block || _detail->blockRefs[handle])
+				continue;
+			_detail->blockHandles.erase(block.get());
+			block.reset();
+			_detail->freeBlocks.push_back(handle);
+		}
+		_detail->releasedBlocks.clear();
+	}
+
+	void VMContext::postEvents(const LandruEvent* events, size_t count)
+	{
+		if (count)
+			_detail->posted.push(vector<LandruEvent>(events, events + count));
+	}
+
+	bool VMContext::postedEventsPending() const
+	{
+		return !_detail->posted.empty() || !_detail->hostEvents.empty();
+	}
+
+	uint32_t VMContext::registerEventType(const string& name, uint32_t fields)
+	{
+		uint32_t type = _detail->internEventType(name);
+		auto & t = _detail->eventTypes[type];
+		if (t.registered && t.fields != fields)
+			VM_RAISE("Event type " << name << " registered with " << t.fields << " fields, not " << fields);
+		lock_guard<mutex> lock(_detail->eventTypesLock);
+		t.fields = fields;
+		t.registered = true;
+		return type;
+	}
+
+	uint32_t VMContext::eventType(const string& name) const
+	{
+		lock_guard<mutex> lock(_detail->eventTypesLock);
+		auto i = _detail->eventTypeIds.find(name);
+		return i == _detail->eventTypeIds.end() ? kNoEventType : i->second;
+	}
+
+	void VMContext::subscribe(const string& eventType, shared_ptr<Fiber> f, InstructionBlock block)
+	{
+		uint32_t type = _detail->internEventType(eventType);
+		_detail->eventTypes[type].subscribers.emplace_back(std::move(f), std::move(block));
+	}
+
+	bool VMContext::postHostEvents(uint32_t type, const float* records, size_t count)
+	{
+		uint32_t fields;
+		{
+			lock_guard<mutex> lock(_detail->eventTypesLock);
+			if (type >= _detail->eventTypes.size() || !_detail->eventTypes[type].registered)
+				return false;
+			fields = _detail->eventTypes[type].fields;
+		}
+		if (!count)
+			return true;
+		HostEvents e;
+		e.type = type;
+		e.count = count;
+		e.fields.assign(records, records + count * fields);
+		_detail->hostEvents.push(std::move(e));
+		return true;
+	}
+
+	void VMContext::runHostEvents(const HostEvents& e)
+	{
+		// a copy, because the statements may subscribe
+		auto subscribers = _detail->eventTypes[e.type].subscribers;
+		uint32_t fields = _detail->eventTypes[e.type].fields;
+		uint64_t unsubscribed = _detail->eventTypes[e.type].unsubscribed;
+
+		// or unsubscribe, by leaving the state, so a subscription is checked
+		// again before each delivery once any has been removed. A fiber whose
+		// statements went to another state is leaving, although its
+		// subscriptions are only removed once the goto runs, so it gets none
+		// of the batch's remaining records.
+		vector<Fiber*> leaving;
+		auto subscribed = [this, &e, &leaving, unsubscribed](const pair<shared_ptr<Fiber>, InstructionBlock>& s) {
+			if (find(leaving.begin(), leaving.end(), s.first.get()) != leaving.end())
+				return false;
+			auto & t = _detail->eventTypes[e.type];
+			if (t.unsubscribed == unsubscribed)
+				return true;
+			for (auto & i : t.subscribers)
+				if (i.first == s.first && i.second == s.second)
+					return true;
+			return false;
+		};
+
+		for (auto & s : subscribers) {
+			Fiber* f = s.first.get();
+			const float* record = e.fields.data();
+			for (size_t r = 0; r < e.count && subscribed(s); ++r, record += fields) {
+				for (uint32_t v = 0; v < fields; ++v)
+					f->push<float>(record[v]);
+				FnContext fn(this, f, nullptr);
+				if (fn.run(s.second) == RunState::Goto)
+					leaving.push_back(f);
+			}
+		}
+	}
+
+	void VMContext::runEvents(const LandruEvent* events, size_t count)
+	{
+		auto & handles = _detail->fiberHandles;
+		auto & blocks = _detail->blocks;
+		for (size_t i = 0; i < count; ++i) {
+			const LandruEvent& e = events[i];
+			auto h = handles.find(e.fiber);
+			if (h == handles.end())
+				continue;
+			shared_ptr<Fiber> f = h->second.lock();
+			if (!f) {
+				handles.erase(h);
+				continue;
+			}
+			if (e.block >= blocks.size() || !blocks[e.block])
+				VM_RAISE("Plugin event for unknown block " << e.block);
+
+			for (uint32_t v = 0; v < e.count && v < 4; ++v)
+				f->push<float>(e.payload[v]);
+			FnContext fn(this, f.get(), nullptr);
+			fn.run(blocks[e.block]);
+		}
+	}
+
+	void VMContext::suspend(Fiber* f)
+	{
+		if (f->suspended)
+			return;
+		f->suspended = true;
+		_detail->suspended.push_back(fiberPtr(f));
+	}
+
+	bool VMContext::suspendedFibersPending() const
+	{
+		return !_detail->suspended.empty() || !_detail->gotos.empty();
+	}
+
+	void VMContext::setFiberBudget(uint32_t instructions, double seconds)
+	{
+		_detail->budgetInstructions = instructions;
+		_detail->budgetTime = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds > 0 ? seconds : 0));
+	}
+
+	void VMContext::beginSlice(Fiber* f)
+	{
+		if (f->sliceEpoch == _detail->epoch)
+			return;
+		f->sliceEpoch = _detail->epoch;
+		f->sliceInstructions = 0;
+		if (_detail->budgetTime.count())
+			f->sliceStart = chrono::steady_clock::now();
+	}
+
+	bool VMContext::overBudget(const Fiber* f) const
+	{
+		if (f->sliceEpoch != _detail->epoch)
+			return false;
+		if (_detail->budgetInstructions && f->sliceInstructions >= _detail->budgetInstructions)
+			return true;
+		return _detail->budgetTime.count() && chrono::steady_clock::now() - f->sliceStart >= _detail->budgetTime;
 	}
 
 	std::shared_ptr<Fiber> VMContext::fiberPtr(Fiber* f)
@@ -275,6 +755,86 @@ void landruVMContextSetTraceEnabled(LandruVMContext_t* vmc_, bool t)
         vmc->traceEnabled = t;
 }
 
+extern "C"
+void landruSetDebugInfoEnabled(bool enabled)
+{
+    Landru::DebugMap::shared().setEnabled(enabled);
+}
+
+extern "C"
+bool landruVMContextWriteTrace(LandruVMContext_t* vmc_, char const*const path)
+{
+    Landru::VMContext* vmc = reinterpret_cast<Landru::VMContext*>(vmc_);
+    if (!vmc || !path)
+        return false;
+    return vmc->writeTrace(path);
+}
+
+extern "C"
+void landruVMContextSetFiberBudget(LandruVMContext_t* vmc_, int instructions, int microseconds)
+{
+    Landru::VMContext* vmc = reinterpret_cast<Landru::VMContext*>(vmc_);
+    if (vmc)
+        vmc->setFiberBudget(instructions > 0 ? uint32_t(instructions) : 0, microseconds > 0 ? microseconds * 1.e-6 : 0);
+}
+
+extern "C"
+void landruVMContextStartProfiler(LandruVMContext_t* vmc_, int sampleIntervalMicroseconds)
+{
+    Landru::VMContext* vmc = reinterpret_cast<Landru::VMContext*>(vmc_);
+    if (vmc)
+        vmc->profiler().start(sampleIntervalMicroseconds);
+}
+
+extern "C"
+void landruVMContextStopProfiler(LandruVMContext_t* vmc_)
+{
+    Landru::VMContext* vmc = reinterpret_cast<Landru::VMContext*>(vmc_);
+    if (vmc)
+        vmc->profiler().stop();
+}
+
+extern "C"
+bool landruVMContextWriteProfile(LandruVMContext_t* vmc_, char const*const path)
+{
+    Landru::VMContext* vmc = reinterpret_cast<Landru::VMContext*>(vmc_);
+    if (!vmc || !path)
+        return false;
+    return vmc->profiler().writeCollapsed(path, Landru::DebugMap::shared());
+}
+
+extern "C"
+void landruVMContextPrintProfile(LandruVMContext_t* vmc_, int count)
+{
+    Landru::VMContext* vmc = reinterpret_cast<Landru::VMContext*>(vmc_);
+    if (vmc && count > 0)
+        vmc->profiler().printTop(stdout, static_cast<size_t>(count), Landru::DebugMap::shared());
+}
+
+extern "C"
+int landruRegisterEventType(LandruVMContext_t* vmc_, char const*const name, int fields)
+{
+    Landru::VMContext* vmc = reinterpret_cast<Landru::VMContext*>(vmc_);
+    if (!vmc || !name || fields < 0)
+        return -1;
+    try {
+        return static_cast<int>(vmc->registerEventType(name, static_cast<uint32_t>(fields)));
+    }
+    catch (Landru::Exception & exc) {
+        std::cerr << exc.s << std::endl;
+        return -1;
+    }
+}
+
+extern "C"
+bool landruPostEvents(LandruVMContext_t* vmc_, int eventType, const void* records, size_t count)
+{
+    Landru::VMContext* vmc = reinterpret_cast<Landru::VMContext*>(vmc_);
+    if (!vmc || eventType < 0 || (count && !records))
+        return false;
+    return vmc->postHostEvents(static_cast<uint32_t>(eventType), static_cast<const float*>(records), count);
+}
+
 extern "C"
 void landruLaunchMachine(LandruVMContext_t* vmc_, char const*const name)
 {
@@ -10,7 +10,9 @@
 
 #include "ConcurrentQueue.h"
 #include "FnContext.h"
+#include "Profiler.h"
 #include "State.h"
+#include "Trace.h"
 #include "WiresTypedData.h"
 
 #include <map>
@@ -23,18 +25,64 @@ namespace Landru {
     class Library;
     class MachineDefinition;
     class Fiber;
+    class NativeStates;
     class Property;
     class VMContext;
 
+	// An on statement fired by a plugin, plugin ABI version 2. The block
+	// runs on the fiber after the payload values are pushed on its stack,
+	// in order. Fibers and blocks are referred to by handles made by the
+	// VMContext, so that events are plain data and can be made on any
+	// thread; an event for a fiber that no longer exists is dropped.
+	struct LandruEvent
+	{
+		uint64_t fiber;			// VMContext::fiberHandle
+		uint32_t block;			// VMContext::blockHandle
+		uint32_t count;			// payload values used
+		float payload[4];
+	};
+
+	struct LandruEventSpan
+	{
+		const LandruEvent* events;
+		size_t count;
+	};
+
+	// A plugin's functions are found by name, landru_<name>_init and so on,
+	// and its version by the optional landru_<name>_protocol export; it is
+	// version 1 without one.
+	//
+	// Continuations and other run time state belong to a plugin instance;
+	// createInstance is called for each VMContext the plugin is added to.
+	// A version 2 plugin's update, fiberExpiring, clearContinuations and
+	// pendingContinuations are passed the instance, so that VMContexts
+	// running on different threads share nothing, and are bound to the
+	// instance fields. A version 1 plugin's keep their original signatures.
+	// A plugin without state may omit createInstance, and is passed a null
+	// instance.
+	//
+	// A version 2 plugin may also export updateEvents in place of update. It
+	// returns the events that fired as a span, which the VMContext runs in
+	// one pass once all the plugins have updated; the span must stay valid
+	// until the plugin's next updateEvents. Work done on other threads is
+	// handed back with VMContext::postEvents.
 	class LandruRequire
 	{
 	public:
 		typedef void(*InitFn)(Landru::Library*);
+		typedef void*(*CreateInstanceFn)(Landru::VMContext*);
+		typedef void(*DestroyInstanceFn)(void* instance);
 		typedef RunState(*UpdateFn)(double, Landru::VMContext*);
 		typedef void(*FinishFn)(Landru::Library*);
 		typedef void(*FiberExpiringFn)(Landru::Fiber*);
 		typedef void(*ClearContinuationsFn)(Landru::Fiber*, int level);
 		typedef bool(*PendingContinuationsFn)(Landru::Fiber*);
+		typedef RunState(*InstanceUpdateFn)(void* instance, double, Landru::VMContext*);
+		typedef void(*InstanceFiberExpiringFn)(void* instance, Landru::Fiber*);
+		typedef void(*InstanceClearContinuationsFn)(void* instance, Landru::Fiber*, int level);
+		typedef bool(*InstancePendingContinuationsFn)(void* instance, Landru::Fiber*);
+		typedef void(*NativeStatesFn)(Landru::NativeStates*, Landru::Library*);
+		typedef LandruEventSpan(*UpdateEventsFn)(void* instance, double, Landru::VMContext*);
 
 		explicit LandruRequire() {}
 		explicit LandruRequire(const LandruRequire & rh)
@@ -47,24 +95,71 @@ namespace Landru {
 			name = rh.name;
 			plugin = rh.plugin;
 			init = rh.init;
+			createInstance = rh.createInstance;
+			destroyInstance = rh.destroyInstance;
+			instance = rh.instance;
 			update = rh.update;
 			finish = rh.finish;
 			fiberExpiring = rh.fiberExpiring;
 			clearContinuations = rh.clearContinuations;
 			pendingContinuations = rh.pendingContinuations;
+			instanceUpdate = rh.instanceUpdate;
+			instanceFiberExpiring = rh.instanceFiberExpiring;
+			instanceClearContinuations = rh.instanceClearContinuations;
+			instancePendingContinuations = rh.instancePendingContinuations;
+			nativeStates = rh.nativeStates;
+			updateEvents = rh.updateEvents;
+			protocol = rh.protocol;
 			return *this;
 		}
 
 		std::string name;
 		void* plugin = nullptr;
 		InitFn init = nullptr;
+		CreateInstanceFn createInstance = nullptr;
+		DestroyInstanceFn destroyInstance = nullptr;
+		void* instance = nullptr;				// owned by the VMContext
 		UpdateFn update = nullptr;
 		FinishFn finish = nullptr;
 		FiberExpiringFn fiberExpiring = nullptr;
 		ClearContinuationsFn clearContinuations = nullptr;
 		PendingContinuationsFn pendingContinuations = nullptr;
+		InstanceUpdateFn instanceUpdate = nullptr;						// version 2
+		InstanceFiberExpiringFn instanceFiberExpiring = nullptr;			// version 2
+		InstanceClearContinuationsFn instanceClearContinuations = nullptr;	// version 2
+		InstancePendingContinuationsFn instancePendingContinuations = nullptr;	// version 2
+		NativeStatesFn nativeStates = nullptr;	// only provided by plugins generated by landruc --emit-cpp
+		UpdateEventsFn updateEvents = nullptr;	// version 2
+		int protocol = 1;						// plugin ABI version, from the optional _protocol export
 
 		RunState runState = RunState::Continue;
+
+		// call whichever version of the callback the plugin provides
+		bool hasUpdate() const { return instanceUpdate || update; }
+		RunState callUpdate(double now, Landru::VMContext* vm) const
+		{
+			return instanceUpdate ? instanceUpdate(instance, now, vm) : update(now, vm);
+		}
+		void callFiberExpiring(Landru::Fiber* f) const
+		{
+			if (instanceFiberExpiring)
+				instanceFiberExpiring(instance, f);
+			else if (fiberExpiring)
+				fiberExpiring(f);
+		}
+		void callClearContinuations(Landru::Fiber* f, int level) const
+		{
+			if (instanceClearContinuations)
+				instanceClearContinuations(instance, f, level);
+			else if (clearContinuations)
+				clearContinuations(f, level);
+		}
+		bool callPendingContinuations(Landru::Fiber* f) const
+		{
+			if (instancePendingContinuations)
+				return instancePendingContinuations(instance, f);
+			return pendingContinuations && pendingContinuations(f);
+		}
 	};
 
 
@@ -76,12 +171,12 @@ namespace Landru {
 		{
 		public:
 			std::shared_ptr<Fiber> fiber;
-			std::vector<Instruction> instructions;
+			InstructionBlock instructions;
 		};
         Detail* _detail;
 
         friend class VMContext;
-        OnEventEvaluator(std::shared_ptr<Fiber>, std::vector<Instruction>&);
+        OnEventEvaluator(std::shared_ptr<Fiber>, InstructionBlock);
 
     public:
         OnEventEvaluator();
@@ -99,7 +194,7 @@ namespace Landru {
 			return *this;
 		}
 
-		std::vector<Instruction>& instructions() { return _detail->instructions;  }
+		const InstructionBlock& instructions() const { return _detail->instructions; }
 		Fiber* fiber() const { return _detail->fiber.get(); }
 		std::shared_ptr<Fiber> fiberPtr() const { return _detail->fiber; }
     };
@@ -108,6 +203,10 @@ namespace Landru {
     {
         class Detail;
         std::unique_ptr<Detail> _detail;
+		void runEvents(const LandruEvent*, size_t count);
+		void freeReleasedBlocks();
+		struct HostEvents;
+		void runHostEvents(const HostEvents&);
 
     public:
 		const float TIME_QUANTA = 1.e-4f;
@@ -123,15 +222,31 @@ namespace Landru {
 		Library* libs;							// holds all vtables
 		std::vector<LandruRequire> plugins;		// holds the implementations
 
+		// creates the plugin's instance for this context; returns false if
+		// a plugin of the same name was already added
+		bool addPlugin(const LandruRequire&);
+		bool hasPlugin(const std::string& name) const;
+		void* pluginInstance(const std::string& name) const;
+
 		//--------------\_____________________________________________________
 		// Update
 		bool traceEnabled;
 		uint32_t breakPoint;
 		void update(double now);
 
+		//--------------\_____________________________________________________
+		// Tracing
+		void traceInstruction(const Meta&, const Fiber*);
+		TraceBuffer& traceBuffer();
+		bool writeTrace(const char* path); // drains the trace buffer to a file
+
+		//--------------\_____________________________________________________
+		// Profiling
+		Profiler& profiler();
+
 		//--------------\_____________________________________________________
 		// Events
-		OnEventEvaluator registerOnEvent(const Fiber& self, std::vector<Instruction> instr);
+		OnEventEvaluator registerOnEvent(const Fiber& self, InstructionBlock instr);
 
         bool deferredMessagesPending() const;
         bool undeferredMessagesPending() const;
@@ -148,25 +263,87 @@ namespace Landru {
 		void enqueueGoto(Fiber * f, const std::string & state);
 		void finalizeGotos();
 
+		// Runs instructions on a fiber after the plugins have updated, rather
+		// than inline beneath the plugin's update. Plugins use this to fire on
+		// statements.
+		void schedule(std::shared_ptr<Fiber>, const std::vector<Instruction>&);
+		// shares the block rather than copying it
+		void schedule(std::shared_ptr<Fiber>, InstructionBlock);
+
+		// Handles for LandruEvents. A fiber's handle is never reused. A block
+		// is retained by the context while it has a handle; each blockHandle
+		// call adds a reference to the handle, and is balanced by a
+		// releaseBlockHandle once no more events will be made with it. The
+		// block outlives its last release until the end of the update, so
+		// that events already returned or posted still run. Make and release
+		// handles on the thread running the context.
+		uint64_t fiberHandle(const Fiber*) const;
+		uint32_t blockHandle(const InstructionBlock&);
+		void releaseBlockHandle(uint32_t);
+
+		// Queues events to run on the next update. Safe to call from any
+		// thread, without locking.
+		void postEvents(const LandruEvent*, size_t count);
+		bool postedEventsPending() const;
+
+		// Events posted by the host, delivered to on host.event clauses. A
+		// type's records are each its number of float fields, and every
+		// record runs the statements of every clause subscribed to the type,
+		// with the record's fields pushed in order. Events are routed a
+		// batch at a time, fiber by fiber, and statements that go to another
+		// state end the batch for their fiber. Register types on the thread
+		// running the context; events may be posted from any thread.
+		static const uint32_t kNoEventType = ~0u;
+		uint32_t registerEventType(const std::string& name, uint32_t fields);
+		uint32_t eventType(const std::string& name) const;
+		void subscribe(const std::string& eventType, std::shared_ptr<Fiber>, InstructionBlock);
+		// false if the type isn't registered
+		bool postHostEvents(uint32_t type, const float* records, size_t count);
+
+		// called by FnContext when a fiber yields, the fiber is resumed on the next update
+		void suspend(Fiber*);
+		bool suspendedFibersPending() const;
+
+		// A fiber that runs more than the given number of instructions, or
+		// for longer than the given time, in a single update yields at its
+		// next loop back-edge or state change and resumes on the next update.
+		// Yielded fibers resume in the order they yielded. Zero disables a
+		// limit; both are disabled by default.
+		void setFiberBudget(uint32_t instructions, double seconds);
+		void beginSlice(Fiber*);	// called by FnContext as a fiber starts running
+		bool overBudget(const Fiber*) const;
+
+		// states provided natively by a plugin replace the interpreted ones
 		void setDefinitions(const std::map<std::string, std::shared_ptr<MachineDefinition>>&);
 
+		// Hot reload. The definitions replace those of the same name, and
+		// are used by machines launched from now on. Running fibers of a
+		// replaced machine change to the new definition at their next goto,
+		// keeping the values of properties whose name and type are unchanged.
+		void replaceDefinitions(const std::map<std::string, std::shared_ptr<MachineDefinition>>&);
+
 		std::vector<std::string> definitions() const;
+		std::shared_ptr<MachineDefinition> definition(const std::string& name) const;
 		std::vector<std::shared_ptr<Fiber>> fibers() const;
 
 		//--------------\_____________________________________________________
 		// Properties
 		typedef size_t LandruIndex;
-		LandruIndex propertyIndex(const std::string & str, LandruIndex parent = 0)
+		static LandruIndex propertyIndex(const std::string & str, LandruIndex parent = 0)
 		{
 			return std::hash<std::string>{}(str) ^ (parent << 1);
 		}
 
 		std::unordered_map<LandruIndex, std::shared_ptr<Landru::Property>> properties;
 
-		// &&& @todo replace str with LandruIndex
 		std::shared_ptr<Landru::Property> findGlobal(const std::string & str)
 		{
-			LandruIndex i = propertyIndex(str, 0);
+			return findGlobal(propertyIndex(str, 0));
+		}
+
+		// by propertyIndex(name, 0), which assembled code computes once
+		std::shared_ptr<Landru::Property> findGlobal(LandruIndex i) const
+		{
 			std::unordered_map<LandruIndex, std::shared_ptr<Landru::Property>>::const_iterator j = properties.find(i);
 			if (j != properties.end())
 				return j->second;
@@ -197,6 +374,11 @@ namespace Landru {
 			properties[i] = p;
 		}
 
+		void removeInstance(const Fiber * f, const std::string & str)
+		{
+			properties.erase(propertyIndex(str, std::hash<const Fiber *>{}(f)));
+		}
+
 		void removeInstances(const Fiber * f);
 	};
 
@@ -7,6 +7,11 @@
 #define ASSEMBLER_TRACE(a)
 
 #include "AssemblerBase.h"
+#include "Optimizer.h"
+#include "Reachability.h"
+#include "TypeInference.h"
+#include "LandruActorVM/DebugMap.h"
+#include "LandruActorVM/Library.h"
 #include "LandruCompiler/AST.h"
 #include "LandruCompiler/lcRaiseError.h"
 #include "LandruCompiler/Parser.h"
@@ -19,7 +24,10 @@
 #include "LabText/TextScanner.hpp"
 
 #include <string.h>
+#include <algorithm>
+#include <exception>
 #include <map>
+#include <thread>
 
 using namespace std;
 #ifdef LANDRU_HAVE_BSON
@@ -35,6 +43,34 @@ namespace Landru {
     AssemblerBase::~AssemblerBase() {
     }
 
+    namespace {
+        // instructions created while a node is assembled are attributed to
+        // its source line, and the enclosing statement's line is restored
+        // for whatever the parent emits afterwards
+        class LineScope {
+        public:
+            LineScope(int& current, int line) : _current(current), _prev(current) {
+                if (line && line != current) {
+                    current = line;
+                    DebugMap::shared().setLine(line);
+                }
+            }
+            ~LineScope() {
+                if (_current != _prev) {
+                    _current = _prev;
+                    DebugMap::shared().setLine(_prev);
+                }
+            }
+        private:
+            int& _current;
+            int _prev;
+        };
+    }
+
+    AssemblerBase::NumericType AssemblerBase::opType(const ASTNode* op) {
+        return op->str1 == "int" ? NumericType::Int : NumericType::Float;
+    }
+
     bool AssemblerBase::isLocalVar(const char* name) const {
         for (auto scope : scopedVariables)
             for (auto var : scope)
@@ -45,6 +81,7 @@ namespace Landru {
 
 
 void AssemblerBase::assembleNode(ASTNode* root) {
+    LineScope line(_line, root->line);
     switch (root->token) {
         case kTokenProgram:
             ASSEMBLER_TRACE(kTokenProgram);
@@ -109,6 +146,7 @@ void AssemblerBase::assembleNode(ASTNode* root) {
 
         case kTokenFunction:
             ASSEMBLER_TRACE(kTokenFunction);
+            beginFunction(root->str2.c_str());
             for (ASTConstIter i = root->children.begin(); i != root->children.end(); ++i)
                 assembleNode(*i);
             callFunction(root->str2.c_str());
@@ -237,14 +275,14 @@ void AssemblerBase::assembleNode(ASTNode* root) {
             break;
         }
 
-        case kTokenOpAdd: ASSEMBLER_TRACE(kTokenOpAdd); opAdd(); break;
-        case kTokenOpSubtract: ASSEMBLER_TRACE(kTokenOpSubtract); opSubtract(); break;
-        case kTokenOpMultiply: ASSEMBLER_TRACE(kTokenOpMultiply); opMultiply(); break;
-        case kTokenOpDivide: ASSEMBLER_TRACE(kTokenOpDivide); opDivide(); break;
-        case kTokenOpNegate: ASSEMBLER_TRACE(kTokenOpNegate); opNegate(); break;
-        case kTokenOpModulus: ASSEMBLER_TRACE(kTokenOpModulus); opModulus(); break;
-        case kTokenOpGreaterThan: ASSEMBLER_TRACE(kTokenOpGreaterThan); opGreaterThan(); break;
-        case kTokenOpLessThan: ASSEMBLER_TRACE(kTokenOpLessThan); opLessThan(); break;
+        case kTokenOpAdd: ASSEMBLER_TRACE(kTokenOpAdd); opAdd(opType(root)); break;
+        case kTokenOpSubtract: ASSEMBLER_TRACE(kTokenOpSubtract); opSubtract(opType(root)); break;
+        case kTokenOpMultiply: ASSEMBLER_TRACE(kTokenOpMultiply); opMultiply(opType(root)); break;
+        case kTokenOpDivide: ASSEMBLER_TRACE(kTokenOpDivide); opDivide(opType(root)); break;
+        case kTokenOpNegate: ASSEMBLER_TRACE(kTokenOpNegate); opNegate(opType(root)); break;
+        case kTokenOpModulus: ASSEMBLER_TRACE(kTokenOpModulus); opModulus(opType(root)); break;
+        case kTokenOpGreaterThan: ASSEMBLER_TRACE(kTokenOpGreaterThan); opGreaterThan(opType(root)); break;
+        case kTokenOpLessThan: ASSEMBLER_TRACE(kTokenOpLessThan); opLessThan(opType(root)); break;
 
         default:
             lcRaiseError("Compile Error: unknown node encountered\n", 0, 0);
@@ -320,6 +358,8 @@ void AssemblerBase::assembleStatements(ASTNode* root) {
 }
 
 void AssemblerBase::assembleState(ASTNode* root) {
+    _line = root->line;
+    DebugMap::shared().setLocation(_machineName, root->str2, _line);
     beginState(root->str2.c_str());   // this will update the program index
 
     if (root->token != kTokenState) {
@@ -366,6 +406,8 @@ void AssemblerBase::assembleDeclarations(ASTNode* root)
 			}
 	}
 
+	_line = root->line;
+	DebugMap::shared().setLocation(_machineName, "__auto__", _line);
 	beginState("__auto__");
 	for (auto i : declares)
 		for (auto j : i->children)
@@ -375,6 +417,14 @@ void AssemblerBase::assembleDeclarations(ASTNode* root)
 
 	void AssemblerBase::assembleMachine(ASTNode* root)
 	{
+		// property names are scoped to their machine, so that a machine
+		// assembles the same whichever machines were assembled before it
+		selfVarNames.clear();
+		sharedVars.clear();
+
+		_machineName = root->str2;
+		_line = root->line;
+		DebugMap::shared().setLocation(_machineName, "", _line);
 		beginMachine(root->str2.c_str());
 
 		assembleDeclarations(root);
@@ -400,6 +450,10 @@ void AssemblerBase::assembleDeclarations(ASTNode* root)
 			assembleState(*i);
 		}
 		endMachine();
+
+		_machineName.clear();
+		_line = 0;
+		DebugMap::shared().setLocation(_machineName, "", 0);
 	}
 
 
@@ -419,11 +473,47 @@ vector<string> AssemblerBase::requires2(ASTNode* root)
     return result;
 }
 
+uint64_t AssemblerBase::sourceHash(const ASTNode* machine) const
+{
+    auto h = _sourceHashes.find(machine->str2);
+    return h == _sourceHashes.end() ? machine->contentHash() : h->second;
+}
+
 void AssemblerBase::assemble(ASTNode* root)
+{
+    assembleProgram(root, nullptr);
+}
+
+void AssemblerBase::assemble(ASTNode* root, const std::set<std::string>& machines)
+{
+    assembleProgram(root, &machines);
+}
+
+void AssemblerBase::assembleProgram(ASTNode* root, const std::set<std::string>* machines)
 {
     //landruPrintRawAST(rootNode);
     //landruPrintAST(root);
 
+    // machines are hashed before inference and optimization annotate them,
+    // so that a reparse of the same text hashes the same
+    std::map<const ASTNode*, uint64_t> hashes;
+    for (auto i : root->children)
+        if (i->token == kTokenMachine && (!machines || machines->count(i->str2)))
+            hashes[i] = sourceHash(i);
+
+    // what can't be reached isn't inferred, optimized or assembled
+    if (_optLevel >= 3) {
+        Reachability reachability(_rootMachines);
+        reachability.strip(root);
+        _warnings.insert(_warnings.end(), reachability.warnings().begin(), reachability.warnings().end());
+    }
+
+    TypeInference types(library());
+    types.infer(root);
+
+    Optimizer optimizer(_optLevel);
+    optimizer.optimize(root);
+
 	{   // gather all machine-scoped declarations
 		std::vector<ASTNode*> declarations;
 
@@ -520,13 +610,11 @@ void AssemblerBase::assemble(ASTNode* root)
 	}
 
     // assemble all the machines
-	for (auto i : root->children) {
-		if (i->token == kTokenMachine) {
-            startAssembling();  // reset the assembler so that it is ready to compile something new
-            assembleNode(i);
-            finalizeAssembling(); // the assembler needs to record its results in finalize
-        }
-    }
+    std::vector<ASTNode*> programMachines;
+	for (auto i : root->children)
+		if (i->token == kTokenMachine && hashes.count(i))
+            programMachines.push_back(i);
+    assembleMachines(programMachines, hashes);
 
     if (false) {
         FILE* f = fopen("/Users/dp/lasm.txt", "at");
@@ -536,5 +624,68 @@ void AssemblerBase::assemble(ASTNode* root)
     }
 }
 
+namespace {
+    // fewer than this many machines per thread aren't worth starting a thread for
+    const size_t kMachinesPerThread = 16;
+}
+
+void AssemblerBase::assembleMachines(const std::vector<ASTNode*>& machines, const std::map<const ASTNode*, uint64_t>& hashes)
+{
+    auto assembleOne = [&hashes](AssemblerBase& a, ASTNode* machine) {
+        a._machineHash = hashes.at(machine);
+        a.startAssembling();  // reset the assembler so that it is ready to compile something new
+        a.assembleNode(machine);
+        a.finalizeAssembling(); // the assembler needs to record its results in finalize
+    };
+
+    size_t threads = _threads > 0 ? size_t(_threads) : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, machines.size() / kMachinesPerThread);
+
+    std::vector<std::unique_ptr<AssemblerBase>> assemblers;
+    Library* lib = library();
+    if (threads > 1 && lib && lib->frozen() && !DebugMap::shared().enabled()) {
+        for (size_t t = 0; t < threads; ++t) {
+            std::unique_ptr<AssemblerBase> a = machineAssembler();
+            if (!a)
+                break;
+            assemblers.push_back(std::move(a));
+        }
+    }
+    if (assemblers.size() < 2) {
+        for (auto m : machines)
+            assembleOne(*this, m);
+        return;
+    }
+
+    // each assembler takes a contiguous run of the machines, in order, and
+    // stops at the first that fails
+    size_t count = assemblers.size();
+    std::vector<std::exception_ptr> errors(count);
+    auto work = [&](size_t t) {
+        try {
+            for (size_t i = t * machines.size() / count, end = (t + 1) * machines.size() / count; i < end; ++i)
+                assembleOne(*assemblers[t], machines[i]);
+        }
+        catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < count; ++t)
+        workers.emplace_back(work, t);
+    work(0);
+    for (auto & w : workers)
+        w.join();
+
+    // merged in program order, up to and including the first machine that
+    // failed, leaving the same definitions as assembling in order would
+    for (size_t t = 0; t < count; ++t) {
+        mergeMachines(*assemblers[t]);
+        if (errors[t])
+            std::rethrow_exception(errors[t]);
+    }
+}
+
 } // Landru
 
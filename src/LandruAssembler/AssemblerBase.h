@@ -13,6 +13,7 @@
  */
 
 #include <stdio.h>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <set>
@@ -29,6 +30,7 @@ namespace Lab {
 namespace Landru {
 
     class ASTNode;
+    class Library;
 
 	class AssemblerBase {
 	public:
@@ -49,6 +51,8 @@ namespace Landru {
         virtual void startAssembling() = 0;
         virtual void finalizeAssembling() = 0;
 
+        // called before the parameters of a function call are assembled
+        virtual void beginFunction(const char*) {}
         virtual void callFunction(const char* fnName) = 0;
         virtual void storeToVar(const char* varName) = 0;
     	virtual void initializeSharedVarIfNecessary(const char * varName) = 0;
@@ -91,14 +95,17 @@ namespace Landru {
 		virtual void ifEq0() = 0;
 		virtual void ifNotEq0() = 0;
 
-        virtual void opAdd() = 0;
-        virtual void opSubtract() = 0;
-        virtual void opMultiply() = 0;
-        virtual void opDivide() = 0;
-        virtual void opNegate() = 0;
-        virtual void opModulus() = 0;
-        virtual void opGreaterThan() = 0;
-        virtual void opLessThan() = 0;
+        // the operand type of an op as annotated by TypeInference. Comparisons
+        // push a float regardless of their operand type.
+        enum class NumericType { Float, Int };
+        virtual void opAdd(NumericType) = 0;
+        virtual void opSubtract(NumericType) = 0;
+        virtual void opMultiply(NumericType) = 0;
+        virtual void opDivide(NumericType) = 0;
+        virtual void opNegate(NumericType) = 0;
+        virtual void opModulus(NumericType) = 0;
+        virtual void opGreaterThan(NumericType) = 0;
+        virtual void opLessThan(NumericType) = 0;
 
 		// variables
 		virtual void addSharedVariable(const char* name, const char* type) = 0;
@@ -139,7 +146,55 @@ namespace Landru {
         // assembler
         void assemble(ASTNode* root);
 
+        // As assemble, but only the named machines, for hot reload. The
+        // program's requires and globals are assembled as usual.
+        void assemble(ASTNode* root, const std::set<std::string>& machines);
+
+        // resolves library function signatures for type inference, may be null
+        virtual Library* library() const { return nullptr; }
+
+        // 0 disables optimization, see Optimizer.h for the AST levels
+        void setOptLevel(int level) { _optLevel = level; }
+        int optLevel() const { return _optLevel; }
+
+        // Machines are assembled on up to this many threads, or one per core
+        // if 0, once the requires and globals they share are assembled. They
+        // are assembled on the calling thread, in order, by assemblers that
+        // don't provide machineAssembler, against a library that isn't
+        // frozen, or while the DebugMap is enabled, since it tracks a single
+        // source location. Instructions are numbered in program order only
+        // when assembled on one thread.
+        void setThreads(int threads) { _threads = threads; }
+        int threads() const { return _threads; }
+
+        // The source hashes of machines whose tree has already been through
+        // inference and optimization, such as one loaded from a module, and
+        // so no longer hashes as it was parsed.
+        void setSourceHashes(const std::map<std::string, uint64_t>& hashes) { _sourceHashes = hashes; }
+
+        // ASTNode::contentHash of the machine as parsed
+        uint64_t sourceHash(const ASTNode* machine) const;
+
+        // The machines the host launches, from which the rest of the program
+        // is reached when opt level 3 strips what can't be, see Reachability.h
+        void setRootMachines(const std::set<std::string>& machines) { _rootMachines = machines; }
+        const std::set<std::string>& rootMachines() const { return _rootMachines; }
+
+        // problems that didn't stop the program assembling, such as code
+        // stripped as unreachable
+        const std::vector<std::string>& warnings() const { return _warnings; }
+
     protected:
+        // An assembler of the same kind that shares this one's requires and
+        // globals, and assembles machines into a context of its own on
+        // another thread, or null if machines must be assembled in order.
+        virtual std::unique_ptr<AssemblerBase> machineAssembler() { return nullptr; }
+
+        // adds the machines assembled by a machineAssembler to this one's
+        virtual void mergeMachines(AssemblerBase&) {}
+
+        void assembleProgram(ASTNode* root, const std::set<std::string>* machines);
+        void assembleMachines(const std::vector<ASTNode*>& machines, const std::map<const ASTNode*, uint64_t>& hashes);
         void assembleMachine(ASTNode* root);
         void assembleDeclarations(ASTNode* root);
         void assembleState(ASTNode* root);
@@ -147,6 +202,7 @@ namespace Landru {
         void assembleNode(ASTNode* root);
 
         bool isLocalVar(const char* name) const;
+        static NumericType opType(const ASTNode* op);
 
         std::vector<std::string> states;
         std::map<std::string, std::string> _requires;
@@ -155,6 +211,19 @@ namespace Landru {
 		std::map<std::string, std::shared_ptr<Landru::Property>> globals;
 
         std::vector<std::vector<std::pair<std::string, std::string>>> scopedVariables; // stack of local variable scopes
+
+        int _optLevel = 1;
+        int _threads = 0;
+        std::set<std::string> _rootMachines = { "main" };
+        std::vector<std::string> _warnings;
+
+        // source location for the DebugMap
+        std::string _machineName;
+        int _line = 0;
+
+        // ASTNode::contentHash of the machine being assembled, as parsed
+        uint64_t _machineHash = 0;
+        std::map<std::string, uint64_t> _sourceHashes;
 	};
 
 } // Landru
@@ -0,0 +1,570 @@
+//
+//  CppAssembler.cpp
+//  Landru
+//
+
+#include "CppAssembler.h"
+#include "LandruActorVM/Library.h"
+#include "LandruActorVM/Property.h"
+#include "LabText/TextScanner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+namespace Landru {
+
+    namespace {
+
+        string indent(const string& code)
+        {
+            string result;
+            size_t start = 0;
+            while (start < code.length()) {
+                size_t end = code.find('\n', start);
+                if (end == string::npos)
+                    end = code.length();
+                if (end > start)
+                    result += "    ";
+                result += code.substr(start, end - start) + "\n";
+                start = end + 1;
+            }
+            return result;
+        }
+
+        string cppString(const string& s)
+        {
+            string result = "\"";
+            for (char c : s) {
+                switch (c) {
+                    case '"':  result += "\\\""; break;
+                    case '\\': result += "\\\\"; break;
+                    case '\n': result += "\\n"; break;
+                    case '\r': result += "\\r"; break;
+                    case '\t': result += "\\t"; break;
+                    default:
+                        if ((unsigned char) c < 0x20) {
+                            char buff[8];
+                            snprintf(buff, sizeof(buff), "\\%03o", (unsigned char) c);
+                            result += buff;
+                        }
+                        else
+                            result += c;
+                }
+            }
+            return result + "\"";
+        }
+
+        // hex float literals round trip exactly
+        string cppFloat(float f)
+        {
+            if (std::isnan(f))
+                return "std::numeric_limits<float>::quiet_NaN()";
+            if (std::isinf(f))
+                return f < 0 ? "-std::numeric_limits<float>::infinity()" : "std::numeric_limits<float>::infinity()";
+            char buff[64];
+            snprintf(buff, sizeof(buff), "%af", f);
+            return buff;
+        }
+
+        string identifier(const string& s)
+        {
+            string result;
+            for (char c : s)
+                result += ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) ? c : '_';
+            return result;
+        }
+
+    } // anon
+
+    //-------------------
+    // assembler context \______________________________________________
+
+    class CppAssembler::Context {
+    public:
+        Library* libs = nullptr;
+        map<string, string> requireAliases;
+        map<string, string> globalTypes;
+        map<string, string> propertyTypes;     // properties of the current machine
+        vector<string> slots;                  // its properties in MachineDefinition slot order
+        string machine;
+        string state;
+
+        vector<string> code;                   // code being generated, innermost block last
+
+        struct Conditional {
+            string test;
+            string code;
+            bool contra = false;
+        };
+        vector<Conditional> conditionals;
+
+        vector<pair<string, string>> localVariables;
+        vector<int> localVariableState;
+
+        vector<tuple<string, string, string>> callSites;   // library, vtable, function
+        vector<string> functions;                          // finished definitions, innermost first
+        vector<tuple<string, string, string>> registrations;  // machine, state, function
+        int functionCount = 0;
+
+        Context(Library* l) : libs(l) {}
+
+        void emit(const string& line) {
+            code.back() += line + "\n";
+        }
+
+        // native states can't be suspended part way through, so they run
+        // through a yield
+        void emitCall(const string& expr) {
+            emit("if ((rs = " + expr + ") != RunState::Continue && rs != RunState::Yield) return rs;");
+        }
+
+        void emitBinaryOp(const string& expr) {
+            emit("{ float v2 = popFloat(run); float v1 = popFloat(run); pushFloat(run, " + expr + "); }");
+        }
+
+        // push is pushInt for arithmetic, and pushFloat for comparisons
+        void emitIntBinaryOp(const string& push, const string& expr) {
+            emit("{ int v2 = popInt(run); int v1 = popInt(run); " + push + "(run, " + expr + "); }");
+        }
+
+        string function(const string& body) {
+            string name = identifier(machine + "_" + state) + "_" + to_string(functionCount++);
+            functions.push_back("RunState " + name + "(FnContext& run)\n{\n"
+                                "    RunState rs = RunState::Continue;\n" +
+                                indent(body) +
+                                "    return rs;\n}\n");
+            return name;
+        }
+
+        int callSite(const string& library, const string& vtable, const string& fn) {
+            auto site = make_tuple(library, vtable, fn);
+            for (size_t i = 0; i < callSites.size(); ++i)
+                if (callSites[i] == site)
+                    return int(i);
+            callSites.push_back(site);
+            return int(callSites.size()) - 1;
+        }
+
+        int localVariableIndex(const char* name) const {
+            // same indexing as the ActorAssembler, so that locals line up
+            for (int i = int(localVariables.size()) - 1; i >= 0; --i)
+                if (localVariables[i].first == name)
+                    return i;
+            return -1;
+        }
+
+        void beginConditional(const char* test) {
+            conditionals.emplace_back();
+            conditionals.back().test = test;
+            code.emplace_back();
+        }
+    };
+
+    CppAssembler::CppAssembler(Library* l) : _context(new Context(l)) {}
+    CppAssembler::~CppAssembler() {}
+
+    Library* CppAssembler::library() const { return _context->libs; }
+
+    string CppAssembler::source(const string& module, const string& sourceName) const
+    {
+        stringstream s;
+        s << "//\n"
+             "// Generated by landruc --emit-cpp from " << sourceName << "\n"
+             "// Build as the plugin landru_" << module << " and load it alongside the\n"
+             "// interpreted program to run these states natively.\n"
+             "//\n\n"
+             "#include \"LandruActorVM/NativeState.h\"\n\n"
+             "#include <cmath>\n"
+             "#include <limits>\n\n"
+             "using namespace Landru;\n"
+             "using namespace Landru::Native;\n\n"
+             "namespace {\n\n";
+
+        size_t count = _context->callSites.size();
+        s << "const CallSite callSites[] = {\n";
+        for (auto& i : _context->callSites)
+            s << "    { " << cppString(get<0>(i)) << ", " << cppString(get<1>(i)) << ", " << cppString(get<2>(i)) << " },\n";
+        if (!count)
+            s << "    { \"\", \"\", \"\" },\n";
+        s << "};\n"
+             "ActorFn fns[" << (count ? count : 1) << "];\n\n";
+
+        for (auto& f : _context->functions)
+            s << f << "\n";
+
+        s << "} // anon\n\n"
+             "extern \"C\"\n"
+             "LANDRU_NATIVE_API\n"
+             "void landru_" << identifier(module) << "_nativeStates(NativeStates* states, Library* library)\n"
+             "{\n"
+             "    resolve(library, callSites, fns, " << count << ");\n";
+        for (auto& r : _context->registrations)
+            s << "    states->add(" << cppString(get<0>(r)) << ", " << cppString(get<1>(r)) << ", " << get<2>(r) << ");\n";
+        s << "}\n";
+        return s.str();
+    }
+
+    void CppAssembler::beginMachine(const char* name) {
+        _context->machine = name;
+        _context->propertyTypes.clear();
+        _context->slots.clear();
+    }
+
+    void CppAssembler::endMachine() {
+        if (!_context->code.empty())
+            AB_RAISE("badly formed state " << _context->state);
+        if (!_context->conditionals.empty())
+            AB_RAISE("badly formed conditional");
+    }
+
+    void CppAssembler::beginState(const char* name) {
+        _context->state = name;
+        _context->code.emplace_back();
+    }
+
+    void CppAssembler::endState() {
+        string body = _context->code.back();
+        _context->code.pop_back();
+        string fn = _context->function(body);
+        _context->registrations.emplace_back(_context->machine, _context->state, fn);
+    }
+
+    void CppAssembler::ifEq()     { _context->beginConditional("test1 == test2"); }
+    void CppAssembler::ifLte0()   { _context->beginConditional("test <= 0"); }
+    void CppAssembler::ifGte0()   { _context->beginConditional("test >= 0"); }
+    void CppAssembler::ifLt0()    { _context->beginConditional("test < 0"); }
+    void CppAssembler::ifGt0()    { _context->beginConditional("test > 0"); }
+    void CppAssembler::ifEq0()    { _context->beginConditional("test == 0"); }
+    void CppAssembler::ifNotEq0() { _context->beginConditional("test != 0"); }
+
+    void CppAssembler::beginContraConditionalClause() {
+        _context->conditionals.back().code = _context->code.back();
+        _context->conditionals.back().contra = true;
+        _context->code.back().clear();
+    }
+
+    void CppAssembler::endConditionalClause() {
+        Context::Conditional c = _context->conditionals.back();
+        _context->conditionals.pop_back();
+        string contra;
+        if (c.contra)
+            contra = _context->code.back();
+        else
+            c.code = _context->code.back();
+        _context->code.pop_back();
+
+        _context->emit("{");
+        if (c.test == "test1 == test2")
+            _context->emit("    float test1 = popFloat(run);\n    float test2 = popFloat(run);");
+        else
+            _context->emit("    float test = popFloat(run);");
+        _context->emit("    if (" + c.test + ") {");
+        _context->code.back() += indent(indent(c.code));
+        _context->emit("    }");
+        if (contra.length()) {
+            _context->emit("    else {");
+            _context->code.back() += indent(indent(contra));
+            _context->emit("    }");
+        }
+        _context->emit("}");
+    }
+
+    void CppAssembler::beginForEach(const char* name, const char* type) {
+        _context->localVariables.emplace_back(make_pair(name, type));
+        _context->code.emplace_back();
+    }
+
+    void CppAssembler::endForEach() {
+        string body = _context->code.back();
+        _context->code.pop_back();
+        string fn = _context->function(body);
+        _context->emitCall("forEach(run, " + fn + ")");
+        _context->localVariables.pop_back();
+    }
+
+    void CppAssembler::beginOn() {
+        _context->code.emplace_back();  // the on clause
+    }
+
+    void CppAssembler::beginOnStatements() {
+        _context->code.emplace_back();  // the statements to run when the clause fires
+    }
+
+    void CppAssembler::endOnStatements() {
+        string statements = _context->code.back();
+        _context->code.pop_back();
+        string clause = _context->code.back();
+        _context->code.pop_back();
+        string fn = _context->function(statements);
+        _context->emit("pushOnStatements(run, " + fn + ");");
+        _context->code.back() += clause;
+    }
+
+    void CppAssembler::beginLocalVariableScope() {
+        _context->localVariableState.emplace_back(0);
+    }
+
+    void CppAssembler::addLocalVariable(const char* name, const char* type) {
+        _context->localVariables.emplace_back(make_pair(name, type));
+        _context->emit("addLocal(run, " + cppString(name) + ", " + cppString(type) + ");");
+    }
+
+    void CppAssembler::endLocalVariableScope() {
+        int localsCount = _context->localVariableState.back();
+        _context->localVariableState.pop_back();
+        for (int i = 0; i < localsCount; ++i)
+            _context->localVariables.pop_back();
+        if (localsCount > 0)
+            _context->emit("popLocals(run, " + to_string(localsCount) + ");");
+    }
+
+    void CppAssembler::addRequire(const char* name, const char* module) {
+        _context->requireAliases[name] = module;
+    }
+
+    std::vector<std::string> CppAssembler::requires() {
+        std::vector<std::string> r;
+        for (auto i : _context->requireAliases)
+            r.push_back(i.second);
+        return r;
+    }
+
+    void CppAssembler::callFunction(const char* fnName)
+    {
+        string f(fnName);
+        vector<string> parts = TextScanner::Split(f, string("."));
+        if (parts.size() == 0)
+            AB_RAISE("Invalid function name" << f);
+
+        // resolve the call the same way as ActorAssembler::callFunction, but
+        // record where the function lives instead of binding it
+        if (parts.size() == 1) {
+            Library::Vtable const*const lib = _context->libs->findVtable("fiber");
+            if (!lib || !lib->function(parts[0].c_str()))
+                AB_RAISE("Function named \"" << parts[0] << "\" does not exist on library: fiber");
+            int site = _context->callSite("", "fiber", parts[0]);
+            _context->emitCall("fns[" + to_string(site) + "](run)");
+            return;
+        }
+
+        auto property = _context->propertyTypes.find(parts[0]);
+        bool isProperty = property != _context->propertyTypes.end();
+        if (!isProperty && _context->requireAliases.find(parts[0]) != _context->requireAliases.end()) {
+            string library;
+            string vtable = parts[0];
+            if (parts.size() > 2) {
+                for (size_t i = 0; i < parts.size() - 1; ++i)
+                    library += (i ? "." : "") + parts[i];
+                vtable = parts[parts.size() - 2];
+            }
+            int site = _context->callSite(library, vtable, parts.back());
+            _context->emitCall("fns[" + to_string(site) + "](run)");
+            return;
+        }
+
+        string type;
+        if (isProperty)
+            type = property->second;
+        else {
+            auto global = _context->globalTypes.find(parts[0]);
+            if (global == _context->globalTypes.end())
+                AB_RAISE("Unknown identifier " << parts[0] << " while parsing " << fnName);
+            type = global->second;
+        }
+
+        vector<string> typeParts = TextScanner::Split(type, ".");
+        int site = typeParts.size() < 2 ?
+            _context->callSite("", Library::stdTypeVtable(type), parts[1]) :
+            _context->callSite(typeParts[0], typeParts[1], parts[1]);
+        if (isProperty) {
+            // the property lives in the same slot on every fiber of this machine
+            int slot = int(find(_context->slots.begin(), _context->slots.end(), parts[0]) - _context->slots.begin());
+            _context->emitCall("callOnSlot(run, fns[" + to_string(site) + "], " + to_string(slot) + ")");
+        }
+        else
+            _context->emitCall("callOnProperty(run, fns[" + to_string(site) + "], " + cppString(parts[0]) + ")");
+    }
+
+    void CppAssembler::beginFunction(const char* fnName)
+    {
+        // std type methods take their receiver as the first argument, as in
+        // ActorAssembler::beginFunction
+        vector<string> parts = TextScanner::Split(string(fnName), string("."));
+        if (parts.size() != 2)
+            return;
+
+        auto property = _context->propertyTypes.find(parts[0]);
+        if (property != _context->propertyTypes.end()) {
+            if (property->second.find('.') == string::npos)
+                _context->emit("pushInstance(run, " + cppString(parts[0]) + ");");
+            return;
+        }
+        if (_context->requireAliases.find(parts[0]) != _context->requireAliases.end())
+            return;
+        auto global = _context->globalTypes.find(parts[0]);
+        if (global != _context->globalTypes.end() && global->second.find('.') == string::npos)
+            _context->emit("pushGlobal(run, " + cppString(parts[0]) + ");");
+    }
+
+    void CppAssembler::storeToVar(const char* name)
+    {
+        int localIndex = _context->localVariableIndex(name);
+        if (localIndex >= 0)
+            _context->emit("storeLocal(run, " + to_string(localIndex) + ");");
+        else if (_context->propertyTypes.find(name) != _context->propertyTypes.end())
+            _context->emit("storeInstance(run, " + cppString(name) + ");");
+        else if (globals.find(name) != globals.end())
+            _context->emit("storeGlobal(run, " + cppString(name) + ");");
+        else
+            AB_RAISE("Couldn't find variable: " << string(name));
+    }
+
+    void CppAssembler::initializeSharedVarIfNecessary(const char* name)
+    {
+        if (_context->propertyTypes.find(name) == _context->propertyTypes.end())
+            AB_RAISE("Couldn't find shared variable: " << string(name));
+        _context->emit("initializeShared(run, " + cppString(name) + ");");
+    }
+
+    void CppAssembler::addGlobal(const char* name, const char* type)
+    {
+        std::shared_ptr<Property> prop = std::make_shared<Property>(TypeFactory());
+        prop->name.assign(name);
+        prop->type.assign(type);
+        prop->visibility = Property::Visibility::Global;
+        globals[name] = prop;
+        _context->globalTypes[name] = type;
+    }
+
+#ifdef LANDRU_HAVE_BSON
+    void CppAssembler::addGlobalBson(const char* name, std::shared_ptr<Lab::Bson>)
+    {
+        addGlobal(name, "bson");
+    }
+#endif
+
+    void CppAssembler::addGlobalString(const char* name, const char*) { addGlobal(name, "string"); }
+    void CppAssembler::addGlobalInt(const char* name, int) { addGlobal(name, "int"); }
+    void CppAssembler::addGlobalFloat(const char* name, float) { addGlobal(name, "float"); }
+
+    void CppAssembler::addSharedVariable(const char* name, const char* type) {
+        addInstanceVariable(name, type);
+    }
+
+    void CppAssembler::addInstanceVariable(const char* name, const char* type) {
+        // slots are assigned in order of first declaration, as by MachineDefinition::addProperty
+        if (_context->propertyTypes.find(name) == _context->propertyTypes.end())
+            _context->slots.push_back(name);
+        _context->propertyTypes[name] = type;
+    }
+
+    void CppAssembler::pushConstant(int i) {
+        _context->emit("pushInt(run, " + to_string(i) + ");");
+    }
+
+    void CppAssembler::pushFloatConstant(float f) {
+        _context->emit("pushFloat(run, " + cppFloat(f) + ");");
+    }
+
+    void CppAssembler::pushStringConstant(const char* str) {
+        _context->emit("pushString(run, " + cppString(str) + ");");
+    }
+
+    void CppAssembler::pushRangedRandom(float r1, float r2) {
+        _context->emit("pushRangedRandom(run, " + cppFloat(r1) + ", " + cppFloat(r2) + ");");
+    }
+
+    void CppAssembler::pushInstanceVar(const char* name) {
+        if (_context->propertyTypes.find(name) == _context->propertyTypes.end())
+            AB_RAISE("Instance variable " << name << " not found on machine" << _context->machine);
+        _context->emit("pushInstance(run, " + cppString(name) + ");");
+    }
+
+    void CppAssembler::pushSharedVar(const char* name) {
+        if (_context->propertyTypes.find(name) == _context->propertyTypes.end())
+            AB_RAISE("Shared variable " << name << " not found on machine" << _context->machine);
+        _context->emit("pushInstance(run, " + cppString(name) + ");");
+    }
+
+    void CppAssembler::pushLocalVar(const char* name) {
+        int var = _context->localVariableIndex(name);
+        if (var < 0)
+            AB_RAISE("Unknown local variable " << name << " on machine" << _context->machine);
+        _context->emit("pushLocal(run, " + to_string(var) + ");");
+    }
+
+    void CppAssembler::pushGlobalVar(const char* name) {
+        if (globals.find(name) == globals.end())
+            AB_RAISE("Global variable " << name << " not found");
+        _context->emit("pushGlobal(run, " + cppString(name) + ");");
+    }
+
+    void CppAssembler::pushInstanceVarReference(const char* name) {
+        if (_context->propertyTypes.find(name) == _context->propertyTypes.end())
+            AB_RAISE("Instance variable " << name << " not found on machine" << _context->machine);
+        _context->emit("pushInstanceReference(run, " + cppString(name) + ");");
+    }
+
+    void CppAssembler::pushGlobalVarReference(const char* name) {
+        if (globals.find(name) == globals.end())
+            AB_RAISE("Global variable " << name << " not found");
+        _context->emit("pushGlobalReference(run, " + cppString(name) + ");");
+    }
+
+    void CppAssembler::pushSharedVarReference(const char* name) {
+        AB_RAISE("pushSharedVarReference not implemented" << name);
+    }
+
+    void CppAssembler::opAdd(NumericType t) {
+        if (t == NumericType::Int) _context->emitIntBinaryOp("pushInt", "v1 + v2");
+        else _context->emitBinaryOp("v1 + v2");
+    }
+    void CppAssembler::opSubtract(NumericType t) {
+        if (t == NumericType::Int) _context->emitIntBinaryOp("pushInt", "v1 - v2");
+        else _context->emitBinaryOp("v1 - v2");
+    }
+    void CppAssembler::opMultiply(NumericType t) {
+        if (t == NumericType::Int) _context->emitIntBinaryOp("pushInt", "v1 * v2");
+        else _context->emitBinaryOp("v1 * v2");
+    }
+    void CppAssembler::opDivide(NumericType t) {
+        if (t == NumericType::Int) _context->emitIntBinaryOp("pushInt", "divideInt(v1, v2)");
+        else _context->emitBinaryOp("v1 / v2");
+    }
+    void CppAssembler::opModulus(NumericType t) {
+        if (t == NumericType::Int) _context->emitIntBinaryOp("pushInt", "modulusInt(v1, v2)");
+        else _context->emitBinaryOp("fmodf(v1, v2)");
+    }
+    void CppAssembler::opGreaterThan(NumericType t) {
+        if (t == NumericType::Int) _context->emitIntBinaryOp("pushFloat", "v1 > v2 ? 1.f : 0.f");
+        else _context->emitBinaryOp("v1 > v2 ? 1.f : 0.f");
+    }
+    void CppAssembler::opLessThan(NumericType t) {
+        if (t == NumericType::Int) _context->emitIntBinaryOp("pushFloat", "v1 < v2 ? 1.f : 0.f");
+        else _context->emitBinaryOp("v1 < v2 ? 1.f : 0.f");
+    }
+
+    void CppAssembler::opNegate(NumericType t) {
+        if (t == NumericType::Int)
+            _context->emit("pushInt(run, -popInt(run));");
+        else
+            _context->emit("pushFloat(run, -popFloat(run));");
+    }
+
+    void CppAssembler::launchMachine() {
+        _context->emit("launchMachine(run);");
+    }
+
+    void CppAssembler::gotoState(const char* stateName) {
+        _context->emit("return gotoState(run, " + cppString(stateName) + ");");
+    }
+
+} // Landru
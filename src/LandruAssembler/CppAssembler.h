@@ -0,0 +1,119 @@
+//
+//  CppAssembler.h
+//  Landru
+//
+//  Translates the states of every machine into C++ functions built on the
+//  runtime functions in LandruActorVM/NativeState.h. The result is a single
+//  translation unit that, compiled into the plugin landru_<module>, exports
+//  landru_<module>_nativeStates. See landruc --emit-cpp.
+//
+
+#pragma once
+
+#include "LandruAssembler/AssemblerBase.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Landru {
+
+    class Library;
+
+    class CppAssembler : public AssemblerBase {
+        class Context;
+        std::unique_ptr<Context> _context;
+    public:
+        CppAssembler(Library*);
+        virtual ~CppAssembler();
+
+        // the generated translation unit
+        std::string source(const std::string& module, const std::string& sourceName) const;
+
+        virtual Library* library() const override;
+
+        virtual void startAssembling() override {}
+        virtual void finalizeAssembling() override {}
+
+        virtual void beginFunction(const char* fnName) override;
+        virtual void callFunction(const char* fnName) override;
+        virtual void storeToVar(const char* varName) override;
+        virtual void initializeSharedVarIfNecessary(const char * varName) override;
+
+        virtual void pushGlobalVar(const char* varName) override;
+        virtual void pushInstanceVar(const char* varName) override;
+        virtual void pushLocalVar(const char* varName) override;
+        virtual void pushSharedVar(const char* varName) override;
+
+        virtual void pushInstanceVarReference(const char* varName) override;
+        virtual void pushGlobalVarReference(const char* varName) override;
+        virtual void pushSharedVarReference(const char* varName) override;
+
+        virtual void pushConstant(int) override;
+        virtual void pushFloatConstant(float) override;
+        virtual void pushRangedRandom(float r1, float r2) override;
+        virtual void pushStringConstant(const char* str) override;
+
+        virtual void paramsStart() override {}
+        virtual void paramsEnd() override {}
+
+        virtual void beginForEach(const char* name, const char* type) override;
+        virtual void endForEach() override;
+
+        virtual void beginOn() override;
+        virtual void beginOnStatements() override;
+        virtual void endOnStatements() override;
+
+        virtual void beginConditionalClause() override {}
+        virtual void beginContraConditionalClause() override;
+        virtual void endConditionalClause() override;
+
+        virtual void gotoState(const char* stateName) override;
+        virtual void launchMachine() override;
+        virtual void ifEq() override;
+        virtual void ifLte0() override;
+        virtual void ifGte0() override;
+        virtual void ifLt0() override;
+        virtual void ifGt0() override;
+        virtual void ifEq0() override;
+        virtual void ifNotEq0() override;
+
+        virtual void opAdd(NumericType) override;
+        virtual void opSubtract(NumericType) override;
+        virtual void opMultiply(NumericType) override;
+        virtual void opDivide(NumericType) override;
+        virtual void opNegate(NumericType) override;
+        virtual void opModulus(NumericType) override;
+        virtual void opGreaterThan(NumericType) override;
+        virtual void opLessThan(NumericType) override;
+
+        virtual void addSharedVariable(const char* name, const char* type) override;
+        virtual void addInstanceVariable(const char* name, const char* type) override;
+
+        virtual void beginLocalVariableScope() override;
+        virtual void addLocalVariable(const char* name, const char* type) override;
+        virtual void endLocalVariableScope() override;
+
+        virtual void addRequire(const char* name, const char* module) override;
+        virtual void addGlobal(const char* name, const char* type) override;
+#ifdef LANDRU_HAVE_BSON
+        virtual void addGlobalBson(const char* name, std::shared_ptr<Lab::Bson>) override;
+#endif
+        virtual void addGlobalString(const char* name, const char* value) override;
+        virtual void addGlobalInt(const char* name, int value) override;
+        virtual void addGlobalFloat(const char* name, float value) override;
+
+        virtual std::vector<std::string> requires() override;
+
+        virtual void beginMachine(const char* name) override;
+        virtual void endMachine() override;
+
+        virtual void beginState(const char* name) override;
+        virtual void endState() override;
+
+        virtual void disassemble(const std::string&, FILE*) override {}
+
+        virtual void dotChain() override {}
+    };
+
+} // Landru
@@ -8,6 +8,7 @@
 
 #include "Landru/Landru.h"
 #include "LandruActorAssembler.h"
+#include "Reachability.h"
 #include "LandruActorVM/Fiber.h"
 #include "LandruActorVM/Generator.h"
 #include "LandruActorVM/Library.h"
@@ -17,6 +18,8 @@
 #include "LandruActorVM/StdLib/StdLib.h"
 #include "LandruActorVM/VMContext.h"
 #include "LandruActorVM/WiresTypedData.h"
+#include "LandruActorVM/Exception.h"
+#include "LandruCompiler/AST.h"
 #include "LabText/TextScanner.hpp"
 
 #ifdef LANDRU_HAVE_BSON
@@ -27,10 +30,12 @@
 #include <cassert>
 #include <cmath>
 #include <exception>
+#include <functional>
 #include <string>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <set>
 #include <vector>
 #include <cstdlib>
 
@@ -39,6 +44,62 @@ using Lab::Bson;
 
 namespace Landru {
 
+	namespace {
+		// the name of a for-each loop's variable, as a local
+		const string kGeneratorLocal("gen");
+
+		// same conversion rules as Fiber::pop<float>
+		float floatValue(const shared_ptr<Wires::TypedData>& data) {
+			if (!data)
+				VM_RAISE("nullptr on stack (variable not found?)");
+			if (data->type() == typeid(float))
+				return reinterpret_cast<Wires::Data<float>*>(data.get())->value();
+			Wires::Data<float>* val = dynamic_cast<Wires::Data<float>*>(data.get());
+			if (!val)
+				VM_RAISE("Wrong type on stack to pop");
+			return val->value();
+		}
+
+		// continues with block in the same trampoline loop, see FnContext::run
+		RunState enterBlock(FnContext& run, const vector<Instruction>& block) {
+			if (!block.empty())
+				run.self->enter(block);
+			return RunState::Continue;
+		}
+
+		// an op on operands TypeInference proved are ints. The result is an
+		// int for arithmetic, and a float for comparisons.
+		template <typename Op>
+		Instruction intBinaryOp(const char* name, Op op) {
+			return Instruction([op](FnContext& run)->RunState {
+				int v2 = run.self->pop<int>();
+				int v1 = run.self->pop<int>();
+				run.self->push(op(v1, v2));
+				return RunState::Continue;
+			}, name);
+		}
+
+		// Inline cache for a call site that names a global property. The
+		// property is resolved the first time the site runs in a VMContext, and
+		// again only if it runs in another one, or the global was rebound to
+		// data of a different type.
+		// A global, looked up in the running context by an index computed
+		// once. Instructions are shared by every context running the
+		// definition, so nothing about a context is kept here.
+		struct GlobalProperty {
+			GlobalProperty(const string& name) : name(name), index(VMContext::propertyIndex(name, 0)) {}
+
+			shared_ptr<Property> property(FnContext& run) const {
+				shared_ptr<Property> property = run.vm->findGlobal(index);
+				if (!property || !property->data)
+					VM_RAISE("Couldn't find property: " << name);
+				return property;
+			}
+
+			string name;
+			VMContext::LandruIndex index;
+		};
+	}
 
 	//-------------------
 	// assembler context \______________________________________________
@@ -70,10 +131,154 @@ namespace Landru {
 		};
 		vector<shared_ptr<Conditional>> currConditional;
 
+		// properties are searched before require aliases, and globals after
+		bool isPropertyCall(const string& name, const map<string, shared_ptr<Property>>& globals) const {
+			if (currMachineDefinition->properties.find(name) != currMachineDefinition->properties.end())
+				return true;
+			return requireAliases.find(name) == requireAliases.end() && globals.find(name) != globals.end();
+		}
+
+		// a method call on a machine property or global, such as buffer.play
+		struct PropertyMethod {
+			string type;                                    // declared type of the property
+			int slot = -1;                                  // fiber property slot, or -1 for a global
+			bool stdType = false;                           // int, float, string, which take the receiver as their first argument
+			Library::Vtable::Entry const* entry = nullptr;
+		};
+
+		void resolvePropertyMethod(const vector<string>& parts, const map<string, shared_ptr<Property>>& globals, PropertyMethod& method) {
+			string f = parts[0] + "." + parts[1];
+			auto machineProperty = currMachineDefinition->properties.find(parts[0]);
+			if (machineProperty == currMachineDefinition->properties.end()) {
+				auto globalProperty = globals.find(parts[0]);
+				if (globalProperty == globals.end())
+					AB_RAISE("Property " << parts[0] << " not found for function call " << f);
+				method.type = globalProperty->second->type;
+			}
+			else {
+				method.type = machineProperty->second->type;
+				method.slot = currMachineDefinition->slot(parts[0]);
+			}
+
+			vector<string> typeParts = TextScanner::Split(method.type, string("."));
+			Library::Vtable const* lib = nullptr;
+			if (typeParts.size() == 1) {
+				// a std type, whose functions are registered on the root library
+				method.stdType = true;
+				lib = libs->findVtable(Library::stdTypeVtable(method.type));
+			}
+			else if (typeParts.size() == 2) {
+				// a library type, eg audio.buffer
+				for (auto& i : libs->libraries)
+					if (i.name == typeParts[0]) {
+						lib = i.findVtable(typeParts[1].c_str());
+						break;
+					}
+			}
+			if (!lib)
+				AB_RAISE("No library named " << typeParts[0] << " exists for function call " << f << " on property of type " << method.type);
+
+			method.entry = lib->function(parts[1].c_str());
+			if (!method.entry)
+				AB_RAISE("Function " << parts[1] << " does not exist on library: " << method.type);
+		}
+
 		vector<pair<string, string>> localVariables; // vector[name-> name,type]
 		vector<int> localVariableState;
 		//
 
+		// peephole state for superinstructions. Instructions that push a float
+		// without side effects record a function that computes that float, so
+		// that push, push, op (and op, store) sequences can be fused into a
+		// single instruction that never boxes its intermediate values.
+		//
+		typedef function<float(FnContext&)> ValueFn;
+		enum class ValueKind { none, local, constant, computed };
+		struct Emitted {
+			uint32_t addr = ~0u;
+			ValueKind kind = ValueKind::none;
+			ValueFn value;
+		};
+		Emitted recent[2];
+		size_t instructionCount = 0;
+		bool fuse = true;
+
+		void emit(Instruction&& i, ValueKind kind, ValueFn value) {
+			uint32_t addr = i.second.addr;
+			currInstr.back()->emplace_back(std::move(i));
+			recent[0] = std::move(recent[1]);
+			recent[1].addr = addr;
+			recent[1].kind = kind;
+			recent[1].value = std::move(value);
+		}
+
+		// the record for the instruction `back` places from the end of the
+		// current block, or nullptr if it wasn't emitted through emit
+		const Emitted* emitted(int back) const {
+			const vector<Instruction>& block = *currInstr.back();
+			const Emitted& e = recent[1 - back];
+			if (!fuse || e.kind == ValueKind::none || block.size() < size_t(back + 1))
+				return nullptr;
+			return block[block.size() - 1 - back].second.addr == e.addr ? &e : nullptr;
+		}
+
+		bool fuseBinaryOp(const char* name, float (*op)(float, float)) {
+			const Emitted* a = emitted(1);
+			const Emitted* b = emitted(0);
+			if (!a || !b)
+				return false;
+
+			ValueFn va = a->value;
+			ValueFn vb = b->value;
+			ValueFn value = [va, vb, op](FnContext& run)->float { return op(va(run), vb(run)); };
+			currInstr.back()->pop_back();
+			currInstr.back()->pop_back();
+			recent[0] = Emitted();
+			recent[1] = Emitted();
+			emit(Instruction([value](FnContext& run)->RunState
+			{
+				run.self->push<float>(value(run));
+				return RunState::Continue;
+			}, name), ValueKind::computed, value);
+			return true;
+		}
+
+		bool fuseUnaryOp(const char* name, float (*op)(float)) {
+			const Emitted* a = emitted(0);
+			if (!a)
+				return false;
+
+			ValueFn va = a->value;
+			ValueFn value = [va, op](FnContext& run)->float { return op(va(run)); };
+			currInstr.back()->pop_back();
+			recent[1] = Emitted();
+			emit(Instruction([value](FnContext& run)->RunState
+			{
+				run.self->push<float>(value(run));
+				return RunState::Continue;
+			}, name), ValueKind::computed, value);
+			return true;
+		}
+
+		// a plain pushed local is assigned by reference, so only freshly
+		// computed values and constants can be stored directly
+		bool fuseStoreToLocal(int localIndex, const string& str) {
+			const Emitted* a = emitted(0);
+			if (!a || a->kind == ValueKind::local)
+				return false;
+
+			ValueFn value = a->value;
+			currInstr.back()->pop_back();
+			recent[1] = Emitted();
+			currInstr.back()->emplace_back(Instruction([localIndex, value](FnContext& run)->RunState
+			{
+				shared_ptr<Wires::TypedData> data = make_shared<Wires::Data<float>>(value(run));
+				run.self->locals[localIndex]->assign(data, true);
+				return RunState::Continue;
+			}, (str + " (fused)").c_str()));
+			return true;
+		}
+
 		Context(Library* l) : libs(l) {}
 		~Context() {}
 
@@ -100,6 +305,7 @@ namespace Landru {
 		}
 
 		void endState() {
+			instructionCount += currState.back()->instructions.size();
 			currState.pop_back();
 			currInstr.pop_back();
 		}
@@ -137,10 +343,62 @@ namespace Landru {
 		return globals;
 	}
 
+	size_t ActorAssembler::instructionCount() const {
+		return _context->instructionCount;
+	}
+
+	void ActorAssembler::startAssembling() {
+		_context->fuse = optLevel() > 0;
+	}
+
 
 
 	void ActorAssembler::beginMachine(const char* name) {
 		_context->beginMachine(name);
+		_context->currMachineDefinition->sourceHash = _machineHash;
+	}
+
+	size_t ActorAssembler::reload(ASTNode* root, VMContext* vm) {
+		// a machine stripped as unreachable isn't a change
+		Reachability reachability(rootMachines());
+		if (optLevel() >= 3)
+			reachability.analyze(root);
+
+		std::set<std::string> changed;
+		for (auto i : root->children) {
+			if (i->token != kTokenMachine)
+				continue;
+			if (optLevel() >= 3 && !reachability.reachable(i->str2))
+				continue;
+			shared_ptr<MachineDefinition> current = vm->definition(i->str2);
+			if (!current || current->sourceHash != sourceHash(i))
+				changed.insert(i->str2);
+		}
+		if (changed.empty())
+			return 0;
+
+		assemble(root, changed);
+		vm->replaceDefinitions(_context->machineDefinitions);
+		for (auto & g : globals)
+			if (!vm->findGlobal(g.first))
+				vm->storeGlobal(g.first, g.second);
+		return changed.size();
+	}
+
+	std::unique_ptr<AssemblerBase> ActorAssembler::machineAssembler() {
+		std::unique_ptr<ActorAssembler> a(new ActorAssembler(_context->libs));
+		a->_context->requireAliases = _context->requireAliases;
+		a->_requires = _requires;
+		a->globals = globals;
+		a->setOptLevel(optLevel());
+		return a;
+	}
+
+	void ActorAssembler::mergeMachines(AssemblerBase& from) {
+		Context& assembled = *static_cast<ActorAssembler&>(from)._context;
+		for (auto & d : assembled.machineDefinitions)
+			_context->machineDefinitions[d.first] = d.second;
+		_context->instructionCount += assembled.instructionCount;
 	}
 
 	void ActorAssembler::endMachine() {
@@ -167,6 +425,7 @@ namespace Landru {
 		_context->currInstr.pop_back();
 		shared_ptr<Context::Conditional> conditional = _context->currConditional.back();
 		_context->currConditional.pop_back();
+		_context->instructionCount += conditional->conditionalInstructions.size() + conditional->contraConditionalInstructions.size();
 		switch (conditional->op) {
 		case Context::Conditional::Op::unknown:
 			break;
@@ -175,246 +434,57 @@ namespace Landru {
 				float test1 = run.self->pop<float>();
 				float test2 = run.self->pop<float>();
 
-				RunState runstate = RunState::Continue;
-				if (run.vm->traceEnabled) {
-					if (test1 == test2) {
-						for (auto& i : conditional->conditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-				}
-				else {
-					if (test1 == test2) {
-						for (auto& i : conditional->conditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-				}
-				return runstate;
+				if (test1 == test2)
+					return enterBlock(run, conditional->conditionalInstructions);
+				return enterBlock(run, conditional->contraConditionalInstructions);
 			}, "Op::Eq"));
 			break;
 		case Context::Conditional::Op::eq0:
 			_context->currInstr.back()->emplace_back(Instruction([conditional](FnContext& run)->RunState {
-				RunState runstate = RunState::Continue;
 				float test = run.self->pop<float>();
-				if (run.vm->traceEnabled) {
-					if (test == 0) {
-						for (auto& i : conditional->conditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-				}
-				else {
-					if (test == 0) {
-						for (auto& i : conditional->conditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-				}
-				return runstate;
+				if (test == 0)
+					return enterBlock(run, conditional->conditionalInstructions);
+				return enterBlock(run, conditional->contraConditionalInstructions);
 			}, "Op::Eq0"));
 			break;
 		case Context::Conditional::Op::lte0:
 			_context->currInstr.back()->emplace_back(Instruction([conditional](FnContext& run)->RunState {
-				RunState runstate = RunState::Continue;
 				float test = run.self->pop<float>();
-				if (run.vm->traceEnabled) {
-					if (test <= 0) {
-						for (auto& i : conditional->conditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-				}
-				else {
-					if (test <= 0) {
-						for (auto& i : conditional->conditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-				}
-				return runstate;
+				if (test <= 0)
+					return enterBlock(run, conditional->conditionalInstructions);
+				return enterBlock(run, conditional->contraConditionalInstructions);
 			}, "Op::lte0"));
 			break;
 		case Context::Conditional::Op::gte0:
 			_context->currInstr.back()->emplace_back(Instruction([conditional](FnContext& run)->RunState {
-				RunState runstate = RunState::Continue;
 				float test = run.self->pop<float>();
-				if (run.vm->traceEnabled) {
-					if (test >= 0) {
-						for (auto& i : conditional->conditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-				}
-				else {
-					if (test >= 0) {
-						for (auto& i : conditional->conditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-				}
-				return runstate;
+				if (test >= 0)
+					return enterBlock(run, conditional->conditionalInstructions);
+				return enterBlock(run, conditional->contraConditionalInstructions);
 			}, "Op::gte0"));
 			break;
 		case Context::Conditional::Op::lt0:
 			_context->currInstr.back()->emplace_back(Instruction([conditional](FnContext& run)->RunState {
-				RunState runstate = RunState::Continue;
 				float test = run.self->pop<float>();
-				if (run.vm->traceEnabled) {
-					if (test < 0) {
-						for (auto& i : conditional->conditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-				}
-				else {
-					if (test < 0) {
-						for (auto& i : conditional->conditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-				}
-				return runstate;
+				if (test < 0)
+					return enterBlock(run, conditional->conditionalInstructions);
+				return enterBlock(run, conditional->contraConditionalInstructions);
 			}, "Op::lte0"));
 			break;
 		case Context::Conditional::Op::gt0:
 			_context->currInstr.back()->emplace_back(Instruction([conditional](FnContext& run)->RunState {
-				RunState runstate = RunState::Continue;
 				float test = run.self->pop<float>();
-				if (run.vm->traceEnabled) {
-					if (test > 0) {
-						for (auto& i : conditional->conditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-				}
-				else {
-					if (test > 0) {
-						for (auto& i : conditional->conditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-				}
-				return runstate;
+				if (test > 0)
+					return enterBlock(run, conditional->conditionalInstructions);
+				return enterBlock(run, conditional->contraConditionalInstructions);
 			}, "Op::gte0"));
 			break;
 		case Context::Conditional::Op::neq0:
 			_context->currInstr.back()->emplace_back(Instruction([conditional](FnContext& run)->RunState {
-				RunState runstate = RunState::Continue;
 				float test = run.self->pop<float>();
-				if (run.vm->traceEnabled) {
-					if (test != 0) {
-						for (auto& i : conditional->conditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions) {
-							i.second.exec(run);
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-						}
-					}
-				}
-				else {
-					if (test != 0) {
-						for (auto& i : conditional->conditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-					else {
-						for (auto i : conditional->contraConditionalInstructions)
-							if ((runstate = i.first(run)) != RunState::Continue)
-								break;
-					}
-				}
-				return runstate;
+				if (test != 0)
+					return enterBlock(run, conditional->conditionalInstructions);
+				return enterBlock(run, conditional->contraConditionalInstructions);
 			}, "Op::neq0"));
 			break;
 		}
@@ -435,36 +505,73 @@ namespace Landru {
 		shared_ptr<Context::Conditional> conditional = _context->currConditional.back();
 		_context->currConditional.pop_back();
 		_context->currInstr.pop_back();
+
+		// the back-edge is a yield point, so a long loop can't hold the VM
+		// beyond the fiber's budget
+		conditional->conditionalInstructions.emplace_back(Instruction([](FnContext& run)->RunState
+		{
+			return run.vm->overBudget(run.self) ? RunState::Yield : RunState::Continue;
+		}, "loop back-edge"));
+
+		_context->instructionCount += conditional->conditionalInstructions.size();
 		_context->currInstr.back()->emplace_back(Instruction([conditional](FnContext& run)->RunState
 		{
-			RunState runstate = RunState::Continue;
 			auto genVarPtr = run.self->popVar();
 			auto generatorVar = reinterpret_cast<Wires::Data<shared_ptr<Generator>>*>(genVarPtr.get());
 			auto generator = generatorVar->value();
 
-			auto factory = run.vm->libs->findFactory(generator->typeName());
-			auto local = factory();
-			auto var = run.self->push_local(std::string("gen"), std::string(generator->typeName()), factory, local);
+			generator->begin();
+			if (generator->done())
+				return RunState::Continue;
 
-			for (generator->begin(); !generator->done(); generator->next())
-			{
-				generator->generate(var.get());
-				if (run.vm->traceEnabled) {
-					for (auto& i : conditional->conditionalInstructions) {
-						i.second.exec(run);
-						if ((runstate = i.first(run)) != RunState::Continue)
-							break;
+			// the generator's type is only known at run time
+			const TypeFactory& factory = run.vm->libs->factory(generator->typeName());
+			auto local = factory();
+			size_t locals = run.self->locals.size();
+			auto var = run.self->push_local(kGeneratorLocal, generator->typeName(), factory, local);
+
+			// reals are stepped without calls into the generator when it allows
+			if (var->type() == typeid(float)) {
+				auto cursor = make_shared<RealCursor>();
+				if (cursor->begin(generator)) {
+					auto real = static_cast<Wires::Data<float>*>(var.get());
+					float value;
+					if (!cursor->next(value)) {
+						run.self->pop_local();
+						return RunState::Continue;
 					}
+					real->Wires::Data<float>::setValue(value);
+					run.self->enter(conditional->conditionalInstructions, [cursor, real](FnContext& run)->bool
+					{
+						float value;
+						if (cursor->next(value)) {
+							real->Wires::Data<float>::setValue(value);
+							return true;
+						}
+						run.self->pop_local(); // discard the local variable
+						return false;
+					});
+					run.self->frames.back().locals = locals;
+					return RunState::Continue;
 				}
-				else
-					for (auto& i : conditional->conditionalInstructions)
-						if ((runstate = i.first(run)) != RunState::Continue)
-							break;
-				generator->finalize(run);
 			}
 
-			run.self->pop_local(); // discard the local variable
-			return runstate;
+			generator->generate(var.get());
+
+			// the body runs as a frame that repeats until the generator is done
+			run.self->enter(conditional->conditionalInstructions, [generator, var](FnContext& run)->bool
+			{
+				generator->finalize(run);
+				generator->next();
+				if (!generator->done()) {
+					generator->generate(var.get());
+					return true;
+				}
+				run.self->pop_local(); // discard the local variable
+				return false;
+			});
+			run.self->frames.back().locals = locals;
+			return RunState::Continue;
 		}, "endForEach"));
 		_context->localVariables.pop_back();
 	}
@@ -489,25 +596,19 @@ namespace Landru {
 		shared_ptr<Context::Conditional> onStatement = _context->currConditional.back();
 		_context->currConditional.pop_back();
 		_context->currInstr.pop_back();
-		_context->currInstr.back()->emplace_back(Instruction([onStatement, onStatements](FnContext& run)->RunState
+		_context->instructionCount += onStatements->conditionalInstructions.size() + onStatement->conditionalInstructions.size();
+
+		// the statements are boxed once, so that running the on clause only
+		// shares them with whatever registers the handler
+		InstructionBlock block = make_shared<const vector<Instruction>>(std::move(onStatements->conditionalInstructions));
+		shared_ptr<Wires::TypedData> boxed = make_shared<Wires::Data<InstructionBlock>>(block);
+		_context->currInstr.back()->emplace_back(Instruction([onStatement, boxed](FnContext& run)->RunState
 		{
-			RunState runstate = RunState::Continue;
 			// push the statements to execute if the on fires
-			run.self->stack.back().emplace_back(make_shared<Wires::Data<vector<Instruction>>>(onStatements->conditionalInstructions));
+			run.self->pushVar(boxed);
 
 			// the on-statement must consume the on-statements
-			if (run.vm->traceEnabled) {
-				for (auto& i : onStatement->conditionalInstructions) {
-					i.second.exec(run);
-					if ((runstate = i.first(run)) != RunState::Continue)
-						break;
-				}
-			}
-			else
-				for (auto& i : onStatement->conditionalInstructions)
-					if ((runstate = i.first(run)) != RunState::Continue)
-						break;
-			return runstate;
+			return enterBlock(run, onStatement->conditionalInstructions);
 		}, "endOn"));
 	}
 
@@ -526,10 +627,16 @@ namespace Landru {
 	{
 		string nStr(name);
 		string tStr(type);
+		// resolved now, and by name if the context runs another library
+		Library* lib = _context->libs;
+		Library::TypeId typeId = lib->typeId(type);
+		if (typeId == Library::kNoType)
+			lib->factory(type); // raises if there is no such type
 		_context->localVariables.emplace_back(make_pair(name, type));
-		_context->currInstr.back()->emplace_back(Instruction([nStr, tStr](FnContext& run)->RunState
+		_context->currInstr.back()->emplace_back(Instruction([nStr, tStr, lib, typeId](FnContext& run)->RunState
 		{
-			auto factory = run.vm->libs->findFactory(tStr.c_str());
+			const TypeFactory& factory = run.vm->libs == lib && typeId != Library::kNoType ?
+				lib->factory(typeId) : run.vm->libs->factory(tStr.c_str());
 			auto local = factory();
 			run.self->push_local(nStr, tStr, factory, local);
 			return RunState::Continue;
@@ -543,6 +650,9 @@ namespace Landru {
 		for (int i = 0; i < localsCount; ++i)
 			_context->localVariables.pop_back();
 
+		if (localsCount == 0 && optLevel() > 0)
+			return;
+
 		_context->currInstr.back()->emplace_back(Instruction([localsCount](FnContext& run)->RunState
 		{
 			for (int i = 0; i < localsCount; ++i)
@@ -581,7 +691,7 @@ namespace Landru {
 		int index = 0;
 
 		while (index < parts.size() - 1) {
-			if (_context->currMachineDefinition->properties.find(parts[index]) != _context->currMachineDefinition->properties.end()) {
+			if (_context->isPropertyCall(parts[index], globals)) {
 				callOn = CallOn::callOnProperty;
 				break;
 			}
@@ -589,10 +699,6 @@ namespace Landru {
 				callOn = CallOn::callOnRequire;
 				break;
 			}
-			if (globals.find(parts[index]) != globals.end()) {
-				callOn = CallOn::callOnProperty;
-				break;
-			}
 			AB_RAISE("Unknown identifier " << parts[index] << " while parsing " << fnName);
 		}
 
@@ -681,72 +787,66 @@ namespace Landru {
 			break;
 		}
 
-		case CallOn::callOnProperty:
-			auto machineProperty = _context->currMachineDefinition->properties.find(parts[0]);
-			string type;
-			if (machineProperty == _context->currMachineDefinition->properties.end()) {
-				auto globalProperty = globals.find(parts[0]);
-				if (globalProperty == globals.end())
-					AB_RAISE("Property " << parts[0] << " not found for function call " << f);
-				type = globalProperty->second->type;
-			}
-			else
-				type = machineProperty->second->type;
-
-			vector<string> typeParts = TextScanner::Split(type, ".");
+		case CallOn::callOnProperty: {
+			Context::PropertyMethod method;
+			_context->resolvePropertyMethod(parts, globals, method);
 
-			if (typeParts.size() == 0) {
-				// type must be a std type
-				Library::Vtable const*const lib = _context->libs->findVtable(typeParts[0].c_str());
-				if (!lib) {
-					AB_RAISE("No std library named " << typeParts[0] << " exists for function call " << f << " on property of type " << type);
-				}
-				AB_RAISE("@TODO callOnProperty");
-				_context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
+			auto fn = method.entry->fn;
+			string str = "library call on property '" + parts[0] + "' to " + method.type + "." + parts[1];
+			int slot = method.slot;
+			if (slot >= 0) {
+				// the property lives in the same slot on every fiber of this machine
+				_context->currInstr.back()->emplace_back(Instruction([slot, fn](FnContext& run)->RunState
 				{
-					// we know what the lambda to call is, but we're going to have to look up the property named parts[0] at runtime
-					// call function on require parts[index] and then clear the params
-					// &&& @TODO
-					return RunState::UndefinedBehavior;
-				}, "callOnStdProperty"));
+					FnContext fnRun(run);
+					fnRun.var = run.self->properties[slot]->data.get();
+					return fn(fnRun);
+				}, str.c_str()));
 			}
 			else {
-				bool found = false;
-				for (auto& i : _context->libs->libraries) {
-					if (i.name == typeParts[0]) {
-						// found the right library, find the vtable on the library, eg audio.buffer
-						Library::Vtable const*const lib = i.findVtable(typeParts[1].c_str());
-						if (!lib)
-							AB_RAISE("No library named " << typeParts[0] << " exists for function call " << f << " on property of type " << type);
-						auto fnEntry = lib->function(parts[1].c_str());
-						if (!fnEntry)
-							AB_RAISE("Function " << parts[1] << " does not exist on library: " << parts[0]);
-
-						auto fn = fnEntry->fn;
-						string str = "library call on property '" + parts[0] + "' to " + type + "." + parts[1];
-						string propertyName = parts[0];
-						string libName = i.name;
-						_context->currInstr.back()->emplace_back(Instruction([propertyName, libName, fn](FnContext& run)->RunState
-						{
-							FnContext fnRun(run);
-							auto property = run.vm->findInstance(run.self, propertyName);
-							if (!property) {
-								property = run.vm->findGlobal(propertyName);
-								if (!property)
-									VM_RAISE("Couldn't find property: " << propertyName);
-							}
-							fnRun.var = property->data.get();
-							return fn(fnRun);
-						}, str.c_str()));
-						found = true;
-						break;
-					}
-				}
-				if (!found)
-					AB_RAISE("No library named " << typeParts[0] << " exists for function call " << f << " on property of type " << type);
+				GlobalProperty global(parts[0]);
+				_context->currInstr.back()->emplace_back(Instruction([global, fn](FnContext& run)->RunState
+				{
+					FnContext fnRun(run);
+					fnRun.var = global.property(run)->data.get();
+					return fn(fnRun);
+				}, str.c_str()));
 			}
 			break;
 		}
+		}
+	}
+
+	void ActorAssembler::beginFunction(const char* fnName)
+	{
+		// std type methods such as x.add(1) on an int take their receiver as
+		// the first argument, so it must be pushed before the parameters
+		vector<string> parts = TextScanner::Split(string(fnName), string("."));
+		if (parts.size() != 2 || !_context->isPropertyCall(parts[0], globals))
+			return;
+
+		Context::PropertyMethod method;
+		_context->resolvePropertyMethod(parts, globals, method);
+		if (!method.stdType)
+			return;
+
+		string str = "push receiver " + parts[0];
+		int slot = method.slot;
+		if (slot >= 0) {
+			_context->currInstr.back()->emplace_back(Instruction([slot](FnContext& run)->RunState
+			{
+				run.self->stack.back().emplace_back(run.self->properties[slot]->data);
+				return RunState::Continue;
+			}, str.c_str()));
+		}
+		else {
+			GlobalProperty global(parts[0]);
+			_context->currInstr.back()->emplace_back(Instruction([global](FnContext& run)->RunState
+			{
+				run.self->stack.back().emplace_back(global.property(run)->data);
+				return RunState::Continue;
+			}, str.c_str()));
+		}
 	}
 
 	void ActorAssembler::storeToVar(const char *name)
@@ -757,6 +857,9 @@ namespace Landru {
 
 		// prefer the local scope
 		int localIndex = _context->localVariableIndex(name);
+		if (localIndex >= 0 && _context->fuseStoreToLocal(localIndex, str))
+			return;
+
 		if (localIndex >= 0)
 		{
 			_context->currInstr.back()->emplace_back(Instruction([localIndex](FnContext& run)->RunState
@@ -874,7 +977,7 @@ namespace Landru {
         prop->name.assign(name);
         prop->type.assign(type);
         prop->visibility = Property::Visibility::Shared;
-        _context->currMachineDefinition->properties[name] = prop;
+        _context->currMachineDefinition->addProperty(name, prop);
     }
 
     void ActorAssembler::addInstanceVariable(const char *name, const char *type) {
@@ -883,7 +986,7 @@ namespace Landru {
         prop->name.assign(name);
         prop->type.assign(type);
         prop->visibility = Property::Visibility::ActorLocal;
-        _context->currMachineDefinition->properties[name] = prop;
+        _context->currMachineDefinition->addProperty(name, prop);
     }
 
     void ActorAssembler::pushConstant(int i) {
@@ -900,11 +1003,11 @@ namespace Landru {
         string str("push float constant: ");
         str += buff;
 		string s(str);
-        _context->currInstr.back()->emplace_back(Instruction([f, s](FnContext& run)->RunState
+        _context->emit(Instruction([f, s](FnContext& run)->RunState
 		{
             run.self->stack.back().emplace_back(make_shared<Wires::Data<float>>(f));
 			return RunState::Continue;
-		}, str.c_str()));
+		}, str.c_str()), Context::ValueKind::constant, [f](FnContext&)->float { return f; });
     }
 
     void ActorAssembler::pushStringConstant(const char *str) {
@@ -945,11 +1048,13 @@ namespace Landru {
         int var = _context->localVariableIndex(varName);
         if (var < 0)
             AB_RAISE("Unknown local variable " << varName << " on machine" << _context->currMachineDefinition->name);
-        _context->currInstr.back()->emplace_back(Instruction([var](FnContext& run)->RunState
+        _context->emit(Instruction([var](FnContext& run)->RunState
 		{
             run.self->stack.back().emplace_back(run.self->locals[var]->data);
 			return RunState::Continue;
-		}, "pushLocalVar"));
+		}, "pushLocalVar"), Context::ValueKind::local, [var](FnContext& run)->float {
+			return floatValue(run.self->locals[var]->data);
+		});
     }
 
     void ActorAssembler::pushSharedVar(const char* name) {
@@ -1053,7 +1158,14 @@ namespace Landru {
         _context->currConditional.back()->op = Context::Conditional::Op::neq0;
     }
 
-    void ActorAssembler::opAdd() {
+    void ActorAssembler::opAdd(NumericType type) {
+        if (type == NumericType::Int) {
+            _context->currInstr.back()->emplace_back(intBinaryOp("opAdd int", [](int v1, int v2) { return v1 + v2; }));
+            return;
+        }
+        if (_context->fuseBinaryOp("opAdd", [](float v1, float v2) { return v1 + v2; }))
+            return;
+
         _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
 		{
             float v2 = run.self->pop<float>();
@@ -1063,7 +1175,14 @@ namespace Landru {
 		}, "opAdd"));
     }
 
-    void ActorAssembler::opSubtract() {
+    void ActorAssembler::opSubtract(NumericType type) {
+        if (type == NumericType::Int) {
+            _context->currInstr.back()->emplace_back(intBinaryOp("opSubtract int", [](int v1, int v2) { return v1 - v2; }));
+            return;
+        }
+        if (_context->fuseBinaryOp("opSubtract", [](float v1, float v2) { return v1 - v2; }))
+            return;
+
         _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
 		{
             float v2 = run.self->pop<float>();
@@ -1073,7 +1192,14 @@ namespace Landru {
 		}, "opSubtract"));
     }
 
-    void ActorAssembler::opMultiply() {
+    void ActorAssembler::opMultiply(NumericType type) {
+        if (type == NumericType::Int) {
+            _context->currInstr.back()->emplace_back(intBinaryOp("opMultiply int", [](int v1, int v2) { return v1 * v2; }));
+            return;
+        }
+        if (_context->fuseBinaryOp("opMultiply", [](float v1, float v2) { return v1 * v2; }))
+            return;
+
         _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
 		{
             float v2 = run.self->pop<float>();
@@ -1083,7 +1209,18 @@ namespace Landru {
 		}, "opMultiply"));
     }
 
-    void ActorAssembler::opDivide() {
+    void ActorAssembler::opDivide(NumericType type) {
+        if (type == NumericType::Int) {
+            _context->currInstr.back()->emplace_back(intBinaryOp("opDivide int", [](int v1, int v2) {
+                if (!v2)
+                    VM_RAISE("Integer division by zero");
+                return v1 / v2;
+            }));
+            return;
+        }
+        if (_context->fuseBinaryOp("opDivide", [](float v1, float v2) { return v1 / v2; }))
+            return;
+
         _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState {
             float v2 = run.self->pop<float>();
             float v1 = run.self->pop<float>();
@@ -1092,7 +1229,18 @@ namespace Landru {
 		}, "opDivide"));
     }
 
-    void ActorAssembler::opNegate() {
+    void ActorAssembler::opNegate(NumericType type) {
+        if (type == NumericType::Int) {
+            _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
+            {
+                run.self->push<int>(-run.self->pop<int>());
+                return RunState::Continue;
+            }, "opNegate int"));
+            return;
+        }
+        if (_context->fuseUnaryOp("opNegate", [](float v1) { return -v1; }))
+            return;
+
         _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
 		{
             float v1 = run.self->pop<float>();
@@ -1101,7 +1249,18 @@ namespace Landru {
 		}, "opNegate"));
     }
 
-    void ActorAssembler::opModulus() {
+    void ActorAssembler::opModulus(NumericType type) {
+        if (type == NumericType::Int) {
+            _context->currInstr.back()->emplace_back(intBinaryOp("opModulus int", [](int v1, int v2) {
+                if (!v2)
+                    VM_RAISE("Integer modulus by zero");
+                return v1 % v2;
+            }));
+            return;
+        }
+        if (_context->fuseBinaryOp("opModulus", [](float v1, float v2) { return fmodf(v1, v2); }))
+            return;
+
         _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
 		{
             float v2 = run.self->pop<float>();
@@ -1111,7 +1270,14 @@ namespace Landru {
 		}, "opModulus"));
     }
 
-    void ActorAssembler::opGreaterThan() {
+    void ActorAssembler::opGreaterThan(NumericType type) {
+        if (type == NumericType::Int) {
+            _context->currInstr.back()->emplace_back(intBinaryOp("opGreaterThan int", [](int v1, int v2) { return v1 > v2 ? 1.f : 0.f; }));
+            return;
+        }
+        if (_context->fuseBinaryOp("opGreaterThan", [](float v1, float v2) { return v1 > v2 ? 1.f : 0.f; }))
+            return;
+
         _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
 		{
             float v2 = run.self->pop<float>();
@@ -1121,7 +1287,14 @@ namespace Landru {
 		}, "opGreaterThan"));
     }
 
-    void ActorAssembler::opLessThan() {
+    void ActorAssembler::opLessThan(NumericType type) {
+        if (type == NumericType::Int) {
+            _context->currInstr.back()->emplace_back(intBinaryOp("opLessThan int", [](int v1, int v2) { return v1 < v2 ? 1.f : 0.f; }));
+            return;
+        }
+        if (_context->fuseBinaryOp("opLessThan", [](float v1, float v2) { return v1 < v2 ? 1.f : 0.f; }))
+            return;
+
         _context->currInstr.back()->emplace_back(Instruction([](FnContext& run)->RunState
 		{
             float v2 = run.self->pop<float>();
@@ -1172,6 +1345,20 @@ void landruAssemble(LandruAssembler_t* laa_, LandruNode_t* rootNode)
     laa->assemble(reinterpret_cast<Landru::ASTNode*>(rootNode));
 }
 
+extern "C"
+int landruReloadMachines(LandruLibrary_t* lib_, LandruVMContext_t* ctx_, LandruNode_t* rootNode)
+{
+	Landru::VMContext* ctx = reinterpret_cast<Landru::VMContext*>(ctx_);
+	Landru::ActorAssembler laa(reinterpret_cast<Landru::Library*>(lib_));
+	try {
+		return static_cast<int>(laa.reload(reinterpret_cast<Landru::ASTNode*>(rootNode), ctx));
+	}
+	catch (const std::exception& exc) {
+		std::cerr << "Reload failed: " << exc.what() << std::endl;
+		return -1;
+	}
+}
+
 extern "C"
 void landruInitializeContext(LandruAssembler_t* laa_, LandruVMContext_t* ctx_)
 {
@@ -23,6 +23,7 @@ namespace Landru {
 
     class Library;
     class MachineDefinition;
+    class VMContext;
 
     class ActorAssembler : public AssemblerBase {
         class Context;
@@ -31,14 +32,26 @@ namespace Landru {
         ActorAssembler(Library*);
         virtual ~ActorAssembler();
 
-        Library* library() const;
+        virtual Library* library() const override;
 
         const std::map<std::string, std::shared_ptr<MachineDefinition>>& assembledMachineDefinitions() const;
 		const std::map<std::string, std::shared_ptr<Landru::Property>>& ActorAssembler::assembledGlobalVariables() const;
 
-        virtual void startAssembling() override {}
+        // number of instructions emitted so far, including nested blocks
+        size_t instructionCount() const;
+
+        // Hot reload. Assembles the machines of a newly parsed program whose
+        // text differs from the definitions the context is running, and
+        // replaces them in the context, see VMContext::replaceDefinitions.
+        // Globals the context doesn't have yet are added. Returns the
+        // number of machines replaced. Throws if the program doesn't
+        // assemble, leaving the context as it was.
+        size_t reload(ASTNode* root, VMContext*);
+
+        virtual void startAssembling() override;
         virtual void finalizeAssembling() override {}
 
+        virtual void beginFunction(const char* fnName) override;
         virtual void callFunction(const char* fnName) override;
         virtual void storeToVar(const char* varName) override;
      	virtual void initializeSharedVarIfNecessary(const char * varName) override;
@@ -82,14 +95,14 @@ namespace Landru {
         virtual void ifEq0() override;
         virtual void ifNotEq0() override;
 
-        virtual void opAdd() override;
-        virtual void opSubtract() override;
-        virtual void opMultiply() override;
-        virtual void opDivide() override;
-        virtual void opNegate() override;
-        virtual void opModulus() override;
-        virtual void opGreaterThan() override;
-        virtual void opLessThan() override;
+        virtual void opAdd(NumericType) override;
+        virtual void opSubtract(NumericType) override;
+        virtual void opMultiply(NumericType) override;
+        virtual void opDivide(NumericType) override;
+        virtual void opNegate(NumericType) override;
+        virtual void opModulus(NumericType) override;
+        virtual void opGreaterThan(NumericType) override;
+        virtual void opLessThan(NumericType) override;
 
         // variables
         virtual void addSharedVariable(const char* name, const char* type) override;
@@ -123,6 +136,10 @@ namespace Landru {
 
         // dot chain means let the runtime know that the next function will be invoked on the stack top object
         virtual void dotChain() override {}
+
+    protected:
+        virtual std::unique_ptr<AssemblerBase> machineAssembler() override;
+        virtual void mergeMachines(AssemblerBase&) override;
     };
 
 
@@ -439,40 +439,42 @@ namespace Landru {
         }
     }
 
-    void Assembler::opAdd()
+    // the legacy VM's arithmetic converts its operands at runtime, so the
+    // inferred operand type isn't needed
+    void Assembler::opAdd(NumericType)
     {
         program.push_back(Instructions::iOpAdd);
     }
 
-    void Assembler::opSubtract()
+    void Assembler::opSubtract(NumericType)
     {
         program.push_back(Instructions::iOpSubtract);
     }
 
-    void Assembler::opMultiply()
+    void Assembler::opMultiply(NumericType)
     {
         program.push_back(Instructions::iOpMultiply);
     }
 
-    void Assembler::opDivide()
+    void Assembler::opDivide(NumericType)
     {
         program.push_back(Instructions::iOpDivide);
     }
 
-    void Assembler::opNegate()
+    void Assembler::opNegate(NumericType)
     {
         program.push_back(Instructions::iOpNegate);
     }
 
-    void Assembler::opModulus()
+    void Assembler::opModulus(NumericType)
     {
         program.push_back(Instructions::iOpModulus);
     }
 
-    void Assembler::opGreaterThan() {
+    void Assembler::opGreaterThan(NumericType) {
         program.push_back(Instructions::iOpGreaterThan);
     }
-    void Assembler::opLessThan() {
+    void Assembler::opLessThan(NumericType) {
         program.push_back(Instructions::iOpLessThan);
     }
 
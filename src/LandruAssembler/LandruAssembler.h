@@ -153,14 +153,14 @@ namespace Landru {
 		virtual void ifEq0() override;
 		virtual void ifNotEq0() override;
 
-        virtual void opAdd() override;
-        virtual void opSubtract() override;
-        virtual void opMultiply() override;
-        virtual void opDivide() override;
-        virtual void opNegate() override;
-        virtual void opModulus() override;
-        virtual void opGreaterThan() override;
-        virtual void opLessThan() override;
+        virtual void opAdd(NumericType) override;
+        virtual void opSubtract(NumericType) override;
+        virtual void opMultiply(NumericType) override;
+        virtual void opDivide(NumericType) override;
+        virtual void opNegate(NumericType) override;
+        virtual void opModulus(NumericType) override;
+        virtual void opGreaterThan(NumericType) override;
+        virtual void opLessThan(NumericType) override;
 
 		virtual void beginState(const char* name) override;
         virtual void endState() override;
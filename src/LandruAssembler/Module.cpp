@@ -0,0 +1,405 @@
+//
+//  Module.cpp
+//  Landru
+//
+
+#include "Module.h"
+#include "Optimizer.h"
+#include "Landru/defines.h"
+#include "LandruActorVM/MachineDefinition.h"
+#include "LandruActorVM/Property.h"
+#include "LandruCompiler/AST.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(LANDRU_OS_WINDOWS)
+ #include <Windows.h>
+#else
+ #include <fcntl.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace Landru {
+
+    using namespace ModuleFormat;
+
+    namespace {
+
+        // FNV-1a
+        const uint64_t kHashBasis = 14695981039346656037ull;
+        const uint64_t kHashPrime = 1099511628211ull;
+
+        uint64_t hashBytes(uint64_t h, const void* data, size_t length)
+        {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < length; ++i)
+                h = (h ^ p[i]) * kHashPrime;
+            return h;
+        }
+
+#define TOKEN_DECL(a,b) #a,
+        const char* const kTokenNames[] = {
+#include "LandruCompiler/TokenDefs.h"
+        };
+#undef TOKEN_DECL
+
+        const uint32_t kTokenCount = sizeof(kTokenNames) / sizeof(kTokenNames[0]);
+
+        uint64_t tokenHash()
+        {
+            uint64_t h = kHashBasis;
+            for (auto name : kTokenNames)
+                h = hashBytes(h, name, strlen(name) + 1);
+            return h;
+        }
+
+        // interns strings and lays out the tables of a module
+        class Writer
+        {
+        public:
+            Writer()
+            {
+                strings.push_back({ 0, 0 });
+                stringData.push_back('\0');
+            }
+
+            uint32_t intern(const char* str, size_t length)
+            {
+                if (!length)
+                    return 0;
+                auto i = _interned.find(string(str, length));
+                if (i != _interned.end())
+                    return i->second;
+                uint32_t index = static_cast<uint32_t>(strings.size());
+                strings.push_back({ static_cast<uint32_t>(stringData.size()), static_cast<uint32_t>(length) });
+                stringData.insert(stringData.end(), str, str + length);
+                stringData.push_back('\0');
+                _interned.emplace(string(str, length), index);
+                return index;
+            }
+
+            uint32_t intern(const ASTString& s) { return intern(s.c_str(), s.length()); }
+            uint32_t intern(const string& s) { return intern(s.data(), s.length()); }
+
+            // appends a table to the file, eight byte aligned
+            template <typename T>
+            Table append(vector<char>& file, const vector<T>& records)
+            {
+                file.resize((file.size() + 7) & ~size_t(7));
+                Table t = { static_cast<uint32_t>(file.size()), static_cast<uint32_t>(records.size()) };
+                const char* data = reinterpret_cast<const char*>(records.data());
+                file.insert(file.end(), data, data + records.size() * sizeof(T));
+                return t;
+            }
+
+            vector<String> strings;
+            vector<char> stringData;
+
+        private:
+            unordered_map<string, uint32_t> _interned;
+        };
+
+        bool inBounds(const Table& t, size_t recordSize, size_t alignment, size_t fileSize)
+        {
+            return t.offset % alignment == 0
+                && t.offset >= sizeof(Header)
+                && uint64_t(t.offset) + uint64_t(t.count) * recordSize <= fileSize;
+        }
+
+    } // anon
+
+    bool writeModule(const char* path, const ASTNode* root,
+                     const map<string, shared_ptr<MachineDefinition>>& definitions,
+                     int optLevel)
+    {
+        Writer w;
+
+        // breadth first, so that each node's children follow it in a run
+        vector<const ASTNode*> order(1, root);
+        unordered_map<const ASTNode*, uint32_t> index;
+        vector<Node> nodes;
+        for (size_t i = 0; i < order.size(); ++i) {
+            const ASTNode* n = order[i];
+            index[n] = static_cast<uint32_t>(i);
+            Node r;
+            r.token = n->token;
+            r.useMask = n->useMask;
+            r.str1 = w.intern(n->str1);
+            r.str2 = w.intern(n->str2);
+            r.floatVal1 = n->floatVal1;
+            r.floatVal2 = n->floatVal2;
+            r.intVal = n->intVal;
+            r.line = n->line;
+            r.firstChild = static_cast<uint32_t>(order.size());
+            r.childCount = static_cast<uint32_t>(n->children.size());
+            for (auto c : n->children)
+                order.push_back(c);
+            nodes.push_back(r);
+        }
+
+        vector<Machine> machines;
+        vector<ModuleFormat::State> states;
+        vector<ModuleFormat::Property> properties;
+        vector<Require> requires;
+        for (auto i : root->children) {
+            if (i->token == kTokenGlobalVariable && i->children.size() && i->children.front()->token == kTokenRequire) {
+                requires.push_back({ w.intern(i->str2), w.intern(i->children.front()->str2) });
+                continue;
+            }
+            if (i->token != kTokenMachine)
+                continue;
+
+            Machine m;
+            m.name = w.intern(i->str2);
+            m.node = index[i];
+            m.sourceHash = 0;
+            m.firstState = static_cast<uint32_t>(states.size());
+            m.firstProperty = static_cast<uint32_t>(properties.size());
+            for (auto s : i->children)
+                if (s->token == kTokenState)
+                    states.push_back({ w.intern(s->str2), index[s] });
+
+            auto d = definitions.find(i->str2);
+            if (d != definitions.end()) {
+                m.sourceHash = d->second->sourceHash;
+                for (auto & slot : d->second->slots) {
+                    const Landru::Property* p = d->second->properties.at(slot);
+                    properties.push_back({ w.intern(slot), w.intern(p->type), static_cast<uint32_t>(p->visibility), 0 });
+                }
+            }
+            m.stateCount = static_cast<uint32_t>(states.size()) - m.firstState;
+            m.propertyCount = static_cast<uint32_t>(properties.size()) - m.firstProperty;
+            machines.push_back(m);
+        }
+
+        Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.byteOrder = kByteOrder;
+        // levels past the last run as the last
+        header.optLevel = static_cast<uint32_t>(optLevel < 0 ? 0 : optLevel > Optimizer::kMaxLevel ? Optimizer::kMaxLevel : optLevel);
+        header.tokenHash = tokenHash();
+
+        vector<char> file(sizeof(Header));
+        header.strings = w.append(file, w.strings);
+        header.stringData = w.append(file, w.stringData);
+        header.nodes = w.append(file, nodes);
+        header.machines = w.append(file, machines);
+        header.states = w.append(file, states);
+        header.properties = w.append(file, properties);
+        header.requires = w.append(file, requires);
+        header.fileSize = file.size();
+        header.contentHash = hashBytes(kHashBasis, file.data() + sizeof(Header), file.size() - sizeof(Header));
+        memcpy(file.data(), &header, sizeof(header));
+
+        FILE* f = fopen(path, "wb");
+        if (!f)
+            return false;
+        bool ok = fwrite(file.data(), 1, file.size(), f) == file.size();
+        return fclose(f) == 0 && ok;
+    }
+
+
+    class Module::Mapping
+    {
+    public:
+        ~Mapping()
+        {
+#if defined(LANDRU_OS_WINDOWS)
+            if (data)
+                UnmapViewOfFile(data);
+            if (mapping)
+                CloseHandle(mapping);
+#else
+            if (data)
+                munmap(const_cast<char*>(data), size);
+#endif
+        }
+
+        bool open(const char* path)
+        {
+#if defined(LANDRU_OS_WINDOWS)
+            HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER fileSize;
+            if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+                size = static_cast<size_t>(fileSize.QuadPart);
+                mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping)
+                    data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            }
+            CloseHandle(file);
+#else
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat s;
+            if (fstat(fd, &s) == 0 && s.st_size > 0) {
+                size = static_cast<size_t>(s.st_size);
+                void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED)
+                    data = static_cast<const char*>(p);
+            }
+            close(fd);
+#endif
+            return data != nullptr;
+        }
+
+        const char* data = nullptr;
+        size_t size = 0;
+#if defined(LANDRU_OS_WINDOWS)
+        HANDLE mapping = nullptr;
+#endif
+    };
+
+    bool Module::open(const char* path, string& error)
+    {
+        auto mapping = make_shared<Mapping>();
+        if (!mapping->open(path)) {
+            error = string("could not map ") + path;
+            return false;
+        }
+        _mapping = mapping;
+        _data = mapping->data;
+        _size = mapping->size;
+        _header = reinterpret_cast<const Header*>(_data);
+        if (!check(error)) {
+            _mapping.reset();
+            _data = nullptr;
+            _size = 0;
+            _header = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    bool Module::check(string& error) const
+    {
+        if (_size < sizeof(Header) || memcmp(_header->magic, kMagic, sizeof(kMagic))) {
+            error = "not a Landru module";
+            return false;
+        }
+        if (_header->version != kVersion || _header->byteOrder != kByteOrder || _header->tokenHash != tokenHash()
+            || _header->optLevel > uint32_t(Optimizer::kMaxLevel)) {
+            error = "the module was written by a different version of Landru";
+            return false;
+        }
+        if (_header->fileSize != _size
+            || hashBytes(kHashBasis, _data + sizeof(Header), _size - sizeof(Header)) != _header->contentHash) {
+            error = "the module is truncated or corrupt";
+            return false;
+        }
+
+        const Header& h = *_header;
+        bool ok = inBounds(h.strings, sizeof(String), alignof(String), _size)
+               && inBounds(h.stringData, 1, 1, _size)
+               && inBounds(h.nodes, sizeof(Node), alignof(Node), _size)
+               && inBounds(h.machines, sizeof(Machine), alignof(Machine), _size)
+               && inBounds(h.states, sizeof(ModuleFormat::State), alignof(ModuleFormat::State), _size)
+               && inBounds(h.properties, sizeof(ModuleFormat::Property), alignof(ModuleFormat::Property), _size)
+               && inBounds(h.requires, sizeof(Require), alignof(Require), _size)
+               && h.strings.count > 0 && h.nodes.count > 0;
+
+        // every string is NUL terminated within the string data
+        const String* strings = table<String>(h.strings);
+        const char* stringData = _data + h.stringData.offset;
+        for (uint32_t i = 0; ok && i < h.strings.count; ++i)
+            ok = uint64_t(strings[i].offset) + strings[i].length < h.stringData.count
+              && stringData[strings[i].offset + strings[i].length] == '\0';
+
+        // the nodes form a tree laid out breadth first from the program
+        const Node* nodes = table<Node>(h.nodes);
+        ok = ok && nodes[0].token == kTokenProgram;
+        uint64_t next = 1;
+        for (uint32_t i = 0; ok && i < h.nodes.count; ++i) {
+            const Node& n = nodes[i];
+            ok = n.token < kTokenCount && n.useMask <= ASTNode::kStr2
+              && n.str1 < h.strings.count && n.str2 < h.strings.count
+              && (!n.childCount || n.firstChild == next);
+            next += n.childCount;
+        }
+        ok = ok && next == h.nodes.count;
+
+        const Machine* machines = table<Machine>(h.machines);
+        for (uint32_t i = 0; ok && i < h.machines.count; ++i)
+            ok = machines[i].name < h.strings.count && machines[i].node < h.nodes.count
+              && uint64_t(machines[i].firstState) + machines[i].stateCount <= h.states.count
+              && uint64_t(machines[i].firstProperty) + machines[i].propertyCount <= h.properties.count;
+        const ModuleFormat::State* states = table<ModuleFormat::State>(h.states);
+        for (uint32_t i = 0; ok && i < h.states.count; ++i)
+            ok = states[i].name < h.strings.count && states[i].node < h.nodes.count;
+        const ModuleFormat::Property* properties = table<ModuleFormat::Property>(h.properties);
+        for (uint32_t i = 0; ok && i < h.properties.count; ++i)
+            ok = properties[i].name < h.strings.count && properties[i].type < h.strings.count;
+        const Require* requires = table<Require>(h.requires);
+        for (uint32_t i = 0; ok && i < h.requires.count; ++i)
+            ok = requires[i].name < h.strings.count && requires[i].module < h.strings.count;
+
+        if (!ok)
+            error = "the module's tables are malformed";
+        return ok;
+    }
+
+    const char* Module::stringAt(uint32_t index) const
+    {
+        return _data + _header->stringData.offset + table<String>(_header->strings)[index].offset;
+    }
+
+    ASTNode* Module::createRoot() const
+    {
+        const String* strings = table<String>(_header->strings);
+        auto str = [this, strings](uint32_t i) { return ASTString(stringAt(i), strings[i].length); };
+
+        ASTArena* arena = new ASTArena();
+        arena->retain(_mapping);
+
+        const Node* records = table<Node>(_header->nodes);
+        vector<ASTNode*> nodes(_header->nodes.count);
+        for (uint32_t i = 0; i < _header->nodes.count; ++i) {
+            const Node& r = records[i];
+            ASTNode* n = arena->node(static_cast<TokenId>(r.token));
+            n->useMask = static_cast<ASTNode::UseMask>(r.useMask);
+            n->str1 = str(r.str1);
+            n->str2 = str(r.str2);
+            n->floatVal1 = r.floatVal1;
+            n->floatVal2 = r.floatVal2;
+            n->intVal = r.intVal;
+            n->line = r.line;
+            nodes[i] = n;
+        }
+        for (uint32_t i = 0; i < _header->nodes.count; ++i) {
+            const Node& r = records[i];
+            nodes[i]->children.reserve(r.childCount);
+            for (uint32_t c = 0; c < r.childCount; ++c)
+                nodes[i]->children.push_back(nodes[r.firstChild + c]);
+        }
+        return nodes[0];
+    }
+
+    vector<std::string> Module::requires() const
+    {
+        vector<std::string> result;
+        const Require* requires = table<Require>(_header->requires);
+        for (uint32_t i = 0; i < _header->requires.count; ++i)
+            result.push_back(stringAt(requires[i].module));
+        return result;
+    }
+
+    map<std::string, uint64_t> Module::sourceHashes() const
+    {
+        map<std::string, uint64_t> result;
+        const Machine* machines = table<Machine>(_header->machines);
+        for (uint32_t i = 0; i < _header->machines.count; ++i)
+            result[stringAt(machines[i].name)] = machines[i].sourceHash;
+        return result;
+    }
+
+} // Landru
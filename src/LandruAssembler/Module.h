@@ -0,0 +1,166 @@
+//
+//  Module.h
+//  Landru
+//
+//  Precompiled modules, the .lmod files written by landruc --compile-only.
+//  A module holds a program as the assembler leaves it, type checked and
+//  optimized, with tables of its machines, their states and property
+//  layouts, and the plugins it requires. Assembled states are closures
+//  that can't be written out, so a module stores the tree they are
+//  assembled from; loading one skips reading, lexing, parsing and
+//  optimizing the source.
+//
+//  A module is a header followed by tables of fixed size records, in the
+//  byte order of the machine that wrote it, addressed by offset from the
+//  start of the file so that it can be used straight from a read only
+//  mapping. Strings are interned once each, NUL terminated, and the
+//  loaded tree points into the mapping rather than copying them.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Landru {
+
+    class ASTNode;
+    class MachineDefinition;
+
+    namespace ModuleFormat {
+
+        const char kMagic[4] = { 'L', 'M', 'O', 'D' };
+        const uint32_t kVersion = 1;
+        const uint32_t kByteOrder = 0x01020304;
+
+        struct Table
+        {
+            uint32_t offset;
+            uint32_t count;
+        };
+
+        struct Header
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t byteOrder;
+            uint32_t optLevel;      // of the optimizer run on the tree, at most Optimizer::kMaxLevel
+            uint64_t tokenHash;     // of the token names, modules are invalidated by a change to TokenDefs.h
+            uint64_t contentHash;   // FNV-1a of everything after the header
+            uint64_t fileSize;
+            Table strings;          // String
+            Table stringData;       // bytes
+            Table nodes;            // Node, the root first
+            Table machines;         // Machine
+            Table states;           // State
+            Table properties;       // Property
+            Table requires;         // Require
+        };
+
+        // strings are indices into the string table, 0 is the empty string
+        struct String
+        {
+            uint32_t offset;        // into stringData
+            uint32_t length;
+        };
+
+        // Nodes are in breadth first order, so that a node's children are
+        // consecutive and follow it.
+        struct Node
+        {
+            uint32_t token;
+            uint32_t useMask;
+            uint32_t str1;
+            uint32_t str2;
+            float floatVal1;
+            float floatVal2;
+            int32_t intVal;
+            int32_t line;
+            uint32_t firstChild;
+            uint32_t childCount;
+        };
+
+        struct Machine
+        {
+            uint32_t name;
+            uint32_t node;
+            uint64_t sourceHash;    // ASTNode::contentHash as parsed, for hot reload
+            uint32_t firstState;
+            uint32_t stateCount;
+            uint32_t firstProperty;
+            uint32_t propertyCount;
+        };
+
+        struct State
+        {
+            uint32_t name;
+            uint32_t node;
+        };
+
+        // in slot order
+        struct Property
+        {
+            uint32_t name;
+            uint32_t type;
+            uint32_t visibility;    // Property::Visibility
+            uint32_t reserved;
+        };
+
+        struct Require
+        {
+            uint32_t name;          // of the global
+            uint32_t module;
+        };
+
+    } // ModuleFormat
+
+    // Writes root, which has been assembled, with the machine definitions
+    // that were assembled from it. Returns false if the file couldn't be
+    // written.
+    bool writeModule(const char* path, const ASTNode* root,
+                     const std::map<std::string, std::shared_ptr<MachineDefinition>>& definitions,
+                     int optLevel);
+
+    class Module
+    {
+    public:
+        Module() = default;
+
+        // Maps the module at path and checks it, returning false with the
+        // reason if it isn't a readable module of this version.
+        bool open(const char* path, std::string& error);
+
+        // The program as a new tree in an arena of its own, to be freed by
+        // ASTArena::releaseRoot. Its strings point into the mapping, which
+        // the arena keeps open.
+        ASTNode* createRoot() const;
+
+        // the modules required, as AssemblerBase::requires2
+        std::vector<std::string> requires() const;
+
+        // by machine name, for AssemblerBase::setSourceHashes
+        std::map<std::string, uint64_t> sourceHashes() const;
+
+        const ModuleFormat::Header& header() const { return *_header; }
+        const char* stringAt(uint32_t index) const;
+
+        template <typename T>
+        const T* table(const ModuleFormat::Table& t) const
+        {
+            return reinterpret_cast<const T*>(_data + t.offset);
+        }
+
+    private:
+        class Mapping;
+        bool check(std::string& error) const;
+
+        std::shared_ptr<Mapping> _mapping;
+        const char* _data = nullptr;
+        size_t _size = 0;
+        const ModuleFormat::Header* _header = nullptr;
+    };
+
+} // Landru
@@ -0,0 +1,240 @@
+//
+//  Optimizer.cpp
+//  Landru
+//
+
+#include "Optimizer.h"
+#include "LandruCompiler/AST.h"
+
+#include <cmath>
+#include <set>
+#include <string>
+
+using namespace std;
+
+namespace Landru {
+
+    namespace {
+
+        bool isFloatLiteral(const ASTNode* n)
+        {
+            return n->token == kTokenFloatLiteral;
+        }
+
+        bool isIntLiteral(const ASTNode* n)
+        {
+            return n->token == kTokenIntLiteral;
+        }
+
+        bool isBinaryOp(TokenId t)
+        {
+            switch (t) {
+                case kTokenOpAdd: case kTokenOpSubtract: case kTokenOpMultiply: case kTokenOpDivide:
+                case kTokenOpModulus: case kTokenOpGreaterThan: case kTokenOpLessThan:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // must match the runtime semantics of the op instructions in ActorAssembler
+        float fold(TokenId t, float v1, float v2)
+        {
+            switch (t) {
+                case kTokenOpAdd:           return v1 + v2;
+                case kTokenOpSubtract:      return v1 - v2;
+                case kTokenOpMultiply:      return v1 * v2;
+                case kTokenOpDivide:        return v1 / v2;
+                case kTokenOpModulus:       return fmodf(v1, v2);
+                case kTokenOpGreaterThan:   return v1 > v2 ? 1.f : 0.f;
+                case kTokenOpLessThan:      return v1 < v2 ? 1.f : 0.f;
+                default:                    return 0.f;
+            }
+        }
+
+        // ops that TypeInference specialized for ints; division and modulus
+        // by zero are left to raise at runtime
+        bool foldInt(TokenId t, int v1, int v2, ASTNode* result)
+        {
+            switch (t) {
+                case kTokenOpAdd:           result->intVal = v1 + v2; return true;
+                case kTokenOpSubtract:      result->intVal = v1 - v2; return true;
+                case kTokenOpMultiply:      result->intVal = v1 * v2; return true;
+                case kTokenOpDivide:        if (!v2) return false; result->intVal = v1 / v2; return true;
+                case kTokenOpModulus:       if (!v2) return false; result->intVal = v1 % v2; return true;
+                case kTokenOpGreaterThan:
+                case kTokenOpLessThan:
+                    result->floatVal1 = (t == kTokenOpGreaterThan ? v1 > v2 : v1 < v2) ? 1.f : 0.f;
+                    result->token = kTokenFloatLiteral;
+                    result->useMask = ASTNode::kFloat;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool namesVariable(const string& str, const string& name)
+        {
+            return str == name || (str.length() > name.length() && !str.compare(0, name.length(), name) && str[name.length()] == '.');
+        }
+
+        // true if anything in the subtree reads, writes, or redeclares name
+        bool mentions(const ASTNode* n, const string& name)
+        {
+            switch (n->token) {
+                case kTokenGetVariable: case kTokenGetVariableReference:
+                case kTokenAssignment: case kTokenInitialAssignment:
+                case kTokenFunction: case kTokenLocalVariable: case kTokenParam: case kTokenFor:
+                    if (namesVariable(n->str2, name))
+                        return true;
+                    break;
+                default:
+                    break;
+            }
+            for (auto i : n->children)
+                if (mentions(i, name))
+                    return true;
+            return false;
+        }
+
+        // true if evaluating the subtree can have no effect other than pushing values
+        bool isPure(const ASTNode* n)
+        {
+            switch (n->token) {
+                case kTokenFloatLiteral: case kTokenIntLiteral: case kTokenStringLiteral:
+                case kTokenTrue: case kTokenFalse: case kTokenGetVariable: case kTokenParameters:
+                case kTokenOpAdd: case kTokenOpSubtract: case kTokenOpMultiply: case kTokenOpDivide:
+                case kTokenOpNegate: case kTokenOpModulus: case kTokenOpGreaterThan: case kTokenOpLessThan:
+                    break;
+                default:
+                    return false;
+            }
+            for (auto i : n->children)
+                if (!isPure(i))
+                    return false;
+            return true;
+        }
+
+        bool isPureAssignment(const ASTNode* assignment)
+        {
+            for (auto i : assignment->children)
+                if (!isPure(i))
+                    return false;
+            return true;
+        }
+
+        bool rhsMentions(const ASTNode* assignment, const string& name)
+        {
+            for (auto i : assignment->children)
+                if (mentions(i, name))
+                    return true;
+            return false;
+        }
+
+        // A store is dead if a later statement in the same block overwrites the
+        // variable before anything reads it. Anything other than a plain
+        // assignment that mentions the variable, or any goto, ends the search.
+        bool isDeadStore(const ASTChildren& statements, size_t index, const string& name)
+        {
+            for (size_t j = index + 1; j < statements.size(); ++j) {
+                const ASTNode* s = statements[j];
+                if (s->token == kTokenGoto)
+                    return false;
+                if (s->token == kTokenAssignment && s->str2 == name)
+                    return !rhsMentions(s, name);
+                if (mentions(s, name))
+                    return false;
+            }
+            return false;
+        }
+
+    } // anon
+
+    void Optimizer::optimize(ASTNode* root)
+    {
+        if (_level <= 0 || !root)
+            return;
+
+        foldConstants(root);
+        if (_level >= 2)
+            eliminateDeadStores(root);
+    }
+
+    void Optimizer::foldConstants(ASTNode* node)
+    {
+        for (auto i : node->children)
+            foldConstants(i);
+
+        // expressions are stored as sibling nodes in reverse polish order, so
+        // literal literal op, and literal negate, can be collapsed in place
+        auto& c = node->children;
+        for (size_t i = 0; i < c.size(); ++i) {
+            TokenId t = c[i]->token;
+            if (isBinaryOp(t) && i >= 2 && isFloatLiteral(c[i - 2]) && isFloatLiteral(c[i - 1])) {
+                c[i - 2]->floatVal1 = fold(t, c[i - 2]->floatVal1, c[i - 1]->floatVal1);
+                c.erase(c.begin() + (i - 1), c.begin() + (i + 1));
+                i -= 2;
+                ++_foldedConstants;
+            }
+            else if (isBinaryOp(t) && i >= 2 && c[i]->str1 == "int" && isIntLiteral(c[i - 2]) && isIntLiteral(c[i - 1]) &&
+                     foldInt(t, c[i - 2]->intVal, c[i - 1]->intVal, c[i - 2]))
+            {
+                c.erase(c.begin() + (i - 1), c.begin() + (i + 1));
+                i -= 2;
+                ++_foldedConstants;
+            }
+            else if (t == kTokenOpNegate && i >= 1 && c[i]->str1 == "int" && isIntLiteral(c[i - 1])) {
+                c[i - 1]->intVal = -c[i - 1]->intVal;
+                c.erase(c.begin() + i);
+                i -= 1;
+                ++_foldedConstants;
+            }
+            else if (t == kTokenOpNegate && i >= 1 && isFloatLiteral(c[i - 1])) {
+                c[i - 1]->floatVal1 = -c[i - 1]->floatVal1;
+                c.erase(c.begin() + i);
+                i -= 1;
+                ++_foldedConstants;
+            }
+        }
+    }
+
+    void Optimizer::eliminateDeadStores(ASTNode* node)
+    {
+        for (auto i : node->children)
+            eliminateDeadStores(i);
+
+        if (node->token != kTokenStatements)
+            return;
+
+        // only locals declared in this block are considered; anything else
+        // may be observed by another fiber or a continuation
+        set<string> locals;
+        auto& c = node->children;
+        size_t i = 0;
+        while (i < c.size()) {
+            ASTNode* s = c[i];
+            if (s->token == kTokenLocalVariable) {
+                for (auto var : s->children) {
+                    if (var->token != kTokenLocalVariable)
+                        continue;
+                    locals.insert(var->str2);
+                    if (!var->children.empty() && var->children.front()->token == kTokenAssignment &&
+                        isPureAssignment(var->children.front()) && isDeadStore(c, i, var->str2))
+                    {
+                        var->children.erase(var->children.begin());
+                        ++_deadStores;
+                    }
+                }
+            }
+            else if (s->token == kTokenAssignment && locals.count(s->str2) &&
+                     isPureAssignment(s) && isDeadStore(c, i, s->str2))
+            {
+                c.erase(c.begin() + i);
+                ++_deadStores;
+                continue;
+            }
+            ++i;
+        }
+    }
+
+} // Landru
@@ -0,0 +1,42 @@
+//
+//  Optimizer.h
+//  Landru
+//
+//  AST to AST optimizations run by AssemblerBase::assemble before any code
+//  is generated.
+//
+//  level 1  folds arithmetic on float literals, and on int literals where
+//           TypeInference specialized the op
+//  level 2  also removes stores to locals that are overwritten before use
+//  level 3  also strips the states and machines that can't be reached,
+//           which AssemblerBase does before inference, see Reachability.h
+//
+
+#pragma once
+
+namespace Landru {
+
+    class ASTNode;
+
+    class Optimizer
+    {
+    public:
+        static const int kMaxLevel = 3;
+
+        explicit Optimizer(int level) : _level(level) {}
+
+        void optimize(ASTNode* root);
+
+        int foldedConstants() const { return _foldedConstants; }
+        int deadStores() const { return _deadStores; }
+
+    private:
+        void foldConstants(ASTNode*);
+        void eliminateDeadStores(ASTNode*);
+
+        int _level;
+        int _foldedConstants = 0;
+        int _deadStores = 0;
+    };
+
+} // Landru
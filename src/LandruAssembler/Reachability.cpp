@@ -0,0 +1,147 @@
+//
+//  Reachability.cpp
+//  Landru
+//
+
+#include "Reachability.h"
+#include "LandruCompiler/AST.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace Landru {
+
+    void Reachability::visit(const ASTNode* node, vector<string>& gotos)
+    {
+        if (node->token == kTokenGoto)
+            gotos.push_back(node->str2);
+        else if (node->token == kTokenLaunch) {
+            // the machine name is the first parameter
+            const ASTNode* name = nullptr;
+            if (!node->children.empty() && !node->children.front()->children.empty())
+                name = node->children.front()->children.front();
+            if (name && name->token == kTokenStringLiteral) {
+                if (_machines.insert(name->str2).second)
+                    _launched.push_back(name->str2);
+            }
+            else
+                _allMachines = true;
+        }
+        for (auto i : node->children)
+            visit(i, gotos);
+    }
+
+    void Reachability::visitMachine(const ASTNode* machine)
+    {
+        map<string, vector<const ASTNode*>> states;
+        vector<string> pending;
+        for (auto i : machine->children) {
+            if (i->token == kTokenState)
+                states[i->str2].push_back(i);
+            else
+                visit(i, pending);  // the declarations run when the machine is launched
+        }
+
+        auto main = states.find("main");
+        if (main == states.end()) {
+            for (auto & s : states)
+                for (auto i : s.second)
+                    visit(i, pending);
+            return;
+        }
+
+        set<string>& reached = _states[machine];
+        pending.push_back("main");
+        while (!pending.empty()) {
+            string name = pending.back();
+            pending.pop_back();
+            if (!reached.insert(name).second)
+                continue;
+            auto s = states.find(name);
+            if (s != states.end())
+                for (auto i : s->second)
+                    visit(i, pending);
+        }
+    }
+
+    void Reachability::analyze(const ASTNode* root)
+    {
+        _byName.clear();
+        _allMachines = false;
+        _machines.clear();
+        _launched.clear();
+        _states.clear();
+
+        for (auto i : root->children)
+            if (i->token == kTokenMachine)
+                _byName.emplace(i->str2, i);
+
+        auto visitLaunched = [this]() {
+            while (!_launched.empty()) {
+                string name = _launched.back();
+                _launched.pop_back();
+                auto range = _byName.equal_range(name);
+                for (auto i = range.first; i != range.second; ++i)
+                    visitMachine(i->second);
+            }
+        };
+
+        for (auto & r : _roots)
+            if (_byName.count(r) && _machines.insert(r).second)
+                _launched.push_back(r);
+        if (_machines.empty())
+            _allMachines = true;
+        visitLaunched();
+
+        // every machine may be launched, but their states are still found
+        if (_allMachines) {
+            for (auto & i : _byName)
+                if (_machines.insert(i.first).second)
+                    _launched.push_back(i.first);
+            visitLaunched();
+        }
+    }
+
+    void Reachability::strip(ASTNode* root)
+    {
+        analyze(root);
+
+        ASTChildren& machines = root->children;
+        for (size_t i = 0; i < machines.size(); ) {
+            ASTNode* machine = machines[i];
+            if (machine->token != kTokenMachine) {
+                ++i;
+                continue;
+            }
+            if (!reachable(machine->str2)) {
+                ostringstream s;
+                s << "line " << machine->line << ": machine " << machine->str2 << " is never launched";
+                _warnings.push_back(s.str());
+                machines.erase(machines.begin() + i);
+                ++_strippedMachines;
+                continue;
+            }
+
+            auto reached = _states.find(machine);
+            if (reached != _states.end()) {
+                ASTChildren& states = machine->children;
+                for (size_t j = 0; j < states.size(); ) {
+                    ASTNode* state = states[j];
+                    if (state->token == kTokenState && !reached->second.count(state->str2)) {
+                        ostringstream s;
+                        s << "line " << state->line << ": state " << state->str2 << " of machine "
+                          << machine->str2 << " is unreachable";
+                        _warnings.push_back(s.str());
+                        states.erase(states.begin() + j);
+                        ++_strippedStates;
+                    }
+                    else
+                        ++j;
+                }
+            }
+            ++i;
+        }
+    }
+
+} // Landru
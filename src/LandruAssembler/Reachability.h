@@ -0,0 +1,66 @@
+//
+//  Reachability.h
+//  Landru
+//
+//  Whole program AST pass run by AssemblerBase::assemble at opt level 3,
+//  before type inference. Machines are reached from the root machines,
+//  those the host launches, through the launches in their reachable
+//  states, and states are reached from their machine's main state through
+//  gotos. The states and machines that can't be reached are removed, with
+//  a warning for each.
+//
+//  A launch of a computed name could start any machine, so a program with
+//  one keeps all of its machines, as does a program without any of the
+//  roots. A machine without a main state keeps all of its states.
+//
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Landru {
+
+    class ASTNode;
+
+    class Reachability
+    {
+    public:
+        explicit Reachability(const std::set<std::string>& roots) : _roots(roots) {}
+
+        // finds the reachable machines and states without changing root
+        void analyze(const ASTNode* root);
+
+        // analyzes root, then removes what isn't reachable
+        void strip(ASTNode* root);
+
+        // once analyzed
+        bool reachable(const std::string& machine) const { return _allMachines || _machines.count(machine) > 0; }
+
+        // once stripped
+        const std::vector<std::string>& warnings() const { return _warnings; }
+        int strippedMachines() const { return _strippedMachines; }
+        int strippedStates() const { return _strippedStates; }
+
+    private:
+        void visitMachine(const ASTNode* machine);
+        void visit(const ASTNode* node, std::vector<std::string>& gotos);
+
+        std::set<std::string> _roots;
+        std::multimap<std::string, const ASTNode*> _byName;
+
+        bool _allMachines = false;
+        std::set<std::string> _machines;
+        std::vector<std::string> _launched;     // machines found but not yet visited
+
+        // the reachable states of each machine that has a main state
+        std::map<const ASTNode*, std::set<std::string>> _states;
+
+        std::vector<std::string> _warnings;
+        int _strippedMachines = 0;
+        int _strippedStates = 0;
+    };
+
+} // Landru
@@ -0,0 +1,434 @@
+//
+//  TypeInference.cpp
+//  Landru
+//
+
+#include "TypeInference.h"
+#include "AssemblerBase.h"
+#include "LandruActorVM/Library.h"
+#include "LandruCompiler/AST.h"
+
+#include <cmath>
+#include <climits>
+#include <sstream>
+
+using namespace std;
+
+#define TI_RAISE(text) do { stringstream s; s << "Type error: " << text; throw AssemblerBase::Exception(s); } while (0)
+
+namespace Landru {
+
+    namespace {
+
+        bool isBinaryOp(TokenId t)
+        {
+            switch (t) {
+                case kTokenOpAdd: case kTokenOpSubtract: case kTokenOpMultiply: case kTokenOpDivide:
+                case kTokenOpModulus: case kTokenOpGreaterThan: case kTokenOpLessThan:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool isComparison(TokenId t)
+        {
+            return t == kTokenOpGreaterThan || t == kTokenOpLessThan;
+        }
+
+        vector<string> split(const string& s)
+        {
+            vector<string> result;
+            size_t start = 0;
+            for (size_t dot = s.find('.'); dot != string::npos; dot = s.find('.', start)) {
+                result.push_back(s.substr(start, dot - start));
+                start = dot + 1;
+            }
+            result.push_back(s.substr(start));
+            return result;
+        }
+
+    } // anon
+
+    TypeInference::Type TypeInference::typeNamed(const string& type)
+    {
+        if (type == "int")
+            return Type::Int;
+        if (type == "float" || type == "real")
+            return Type::Float;
+        if (type == "string")
+            return Type::String;
+        return Type::Unknown;
+    }
+
+    const char* TypeInference::name(Type type)
+    {
+        switch (type) {
+            case Type::Int:     return "int";
+            case Type::Float:   return "float";
+            case Type::String:  return "string";
+            default:            return "unknown";
+        }
+    }
+
+    TypeInference::Type TypeInference::lookup(const string& var) const
+    {
+        // dotted names access members of library objects, which aren't typed here
+        if (var.find('.') != string::npos)
+            return Type::Unknown;
+
+        for (auto scope = _scopes.rbegin(); scope != _scopes.rend(); ++scope) {
+            auto i = scope->find(var);
+            if (i != scope->end())
+                return i->second;
+        }
+        return Type::Unknown;
+    }
+
+    void TypeInference::declare(const string& var, const string& type)
+    {
+        _scopes.back()[var] = typeNamed(type);
+    }
+
+    bool TypeInference::convert(Value& v, Type to)
+    {
+        ASTNode* n = v.literal;
+        if (!n)
+            return false;
+
+        if (to == Type::Float && v.type == Type::Int) {
+            n->floatVal1 = n->token == kTokenIntLiteral ? float(n->intVal) : (n->token == kTokenTrue ? 1.f : 0.f);
+            n->token = kTokenFloatLiteral;
+            n->useMask = ASTNode::kFloat;
+        }
+        else if (to == Type::Int && v.type == Type::Float) {
+            float f = n->floatVal1;
+            if (f != floorf(f) || f < float(INT_MIN) || f > float(INT_MAX))
+                return false;
+            n->intVal = int(f);
+            n->token = kTokenIntLiteral;
+            n->useMask = ASTNode::kInt;
+        }
+        else
+            return false;
+
+        v.type = to;
+        ++_convertedLiterals;
+        return true;
+    }
+
+    void TypeInference::require(Value& v, Type to, const string& context)
+    {
+        if (v.type == Type::Unknown || to == Type::Unknown || v.type == to)
+            return;
+        if (convert(v, to))
+            return;
+        TI_RAISE(context << " expects " << name(to) << " but was given " << name(v.type));
+    }
+
+    void TypeInference::infer(ASTNode* root)
+    {
+        if (!root)
+            return;
+
+        _scopes.clear();
+        _scopes.emplace_back();
+
+        for (auto i : root->children) {
+            if (i->token == kTokenGlobalVariable && i->children.size() && i->children.front()->token == kTokenRequire)
+                _requires[i->str2] = i->children.front()->str2;
+            else if (i->token == kTokenDeclare)
+                for (auto var : i->children)
+                    if (var->token == kTokenLocalVariable)
+                        inferDeclaration(var);
+        }
+
+        for (auto i : root->children)
+            if (i->token == kTokenMachine)
+                inferMachine(i);
+    }
+
+    void TypeInference::inferDeclaration(ASTNode* var)
+    {
+        declare(var->str2, var->str1);
+        for (auto a : var->children)
+            if (a->token == kTokenAssignment || a->token == kTokenInitialAssignment)
+                inferAssignment(a, "declaration of");
+    }
+
+    void TypeInference::inferMachine(ASTNode* machine)
+    {
+        _scopes.emplace_back();
+
+        // properties are visible from every state, so declare them all first
+        for (auto i : machine->children)
+            if (i->token == kTokenDeclare)
+                for (auto var : i->children)
+                    declare(var->str2, var->str1);
+
+        for (auto i : machine->children) {
+            if (i->token == kTokenDeclare) {
+                for (auto var : i->children)
+                    for (auto a : var->children)
+                        if (a->token == kTokenAssignment || a->token == kTokenInitialAssignment)
+                            inferAssignment(a, "declaration of");
+            }
+            else if (i->token == kTokenState) {
+                for (auto statements : i->children)
+                    inferStatements(statements);
+            }
+        }
+
+        _scopes.pop_back();
+    }
+
+    void TypeInference::inferStatements(ASTNode* statements)
+    {
+        _scopes.emplace_back();
+        for (auto i : statements->children)
+            inferStatement(i);
+        _scopes.pop_back();
+    }
+
+    void TypeInference::inferStatement(ASTNode* s)
+    {
+        switch (s->token) {
+            case kTokenLocalVariable:
+            case kTokenSharedVariable:
+                for (auto var : s->children)
+                    if (var->str1.length())
+                        inferDeclaration(var);
+                break;
+
+            case kTokenAssignment:
+            case kTokenInitialAssignment:
+                inferAssignment(s, "assignment to");
+                break;
+
+            case kTokenIf: {
+                // children: qualifier, statements, [else, statements]
+                auto j = s->children.begin();
+                if (j == s->children.end())
+                    break;
+                inferConditional(*j++);
+                if (j != s->children.end())
+                    inferStatements(*j++);
+                if (j != s->children.end())
+                    for (auto k : (*j)->children)
+                        inferStatements(k);
+                break;
+            }
+
+            case kTokenFor: {
+                // children: range generator, statements
+                if (s->children.size() < 2)
+                    break;
+                inferExpression(s);     // only the generator is an expression, statements push nothing
+                _scopes.emplace_back();
+                declare(s->str2, s->str1);
+                inferStatements(s->children[1]);
+                _scopes.pop_back();
+                break;
+            }
+
+            case kTokenOn: {
+                // children: event, statements
+                if (s->children.size() < 2)
+                    break;
+                vector<Value> stack;
+                if (s->children[0]->token == kTokenFunction)
+                    inferFunction(s->children[0], false, stack);
+                inferStatements(s->children[1]);
+                break;
+            }
+
+            case kTokenFunction:
+            case kTokenLaunch:
+            case kTokenParameters:
+                inferExpression(s);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    void TypeInference::inferAssignment(ASTNode* assignment, const char* what)
+    {
+        vector<Value> values = inferExpression(assignment);
+        if (values.size() == 1)
+            require(values[0], lookup(assignment->str2), string(what) + " " + assignment->str2);
+    }
+
+    void TypeInference::inferConditional(ASTNode* qualifier)
+    {
+        // the conditional clauses compare floats
+        vector<Value> values = inferExpression(qualifier);
+        for (auto& v : values)
+            require(v, Type::Float, "conditional");
+    }
+
+    vector<TypeInference::Value> TypeInference::inferExpression(ASTNode* node)
+    {
+        // the children of node are an expression in reverse polish order,
+        // simulate the stack to find the operand types of each op
+        vector<Value> stack;
+        bool dotChain = false;
+        for (auto n : node->children) {
+            switch (n->token) {
+                case kTokenFloatLiteral:
+                    stack.push_back({Type::Float, n});
+                    break;
+                case kTokenIntLiteral:
+                case kTokenTrue:
+                case kTokenFalse:
+                    stack.push_back({Type::Int, n});
+                    break;
+                case kTokenRangedLiteral:
+                    stack.push_back({Type::Float, nullptr});
+                    break;
+                case kTokenStringLiteral:
+                    stack.push_back({Type::String, nullptr});
+                    break;
+                case kTokenGetVariable:
+                    stack.push_back({lookup(n->str2), nullptr});
+                    break;
+                case kTokenGetVariableReference:
+                    stack.push_back({Type::Unknown, nullptr});
+                    break;
+                case kTokenParameters: {
+                    vector<Value> params = inferExpression(n);
+                    stack.insert(stack.end(), params.begin(), params.end());
+                    break;
+                }
+                case kTokenFunction:
+                    inferFunction(n, dotChain, stack);
+                    break;
+                case kTokenDotChain:
+                    dotChain = true;
+                    continue;
+                default:
+                    if (isBinaryOp(n->token) || n->token == kTokenOpNegate)
+                        inferOp(n, stack);
+                    break;
+            }
+            dotChain = false;
+        }
+        return stack;
+    }
+
+    void TypeInference::inferFunction(ASTNode* fn, bool onStackTop, vector<Value>& stack)
+    {
+        vector<Value> args;
+        for (auto i : fn->children)
+            if (i->token == kTokenParameters) {
+                vector<Value> params = inferExpression(i);
+                args.insert(args.end(), params.begin(), params.end());
+            }
+
+        // resolve the signature the same way ActorAssembler::callFunction
+        // resolves self and require calls; anything else is unknown
+        Library::Vtable::Entry const* entry = nullptr;
+        vector<string> parts = split(fn->str2);
+        if (_library && !onStackTop) {
+            try {
+                if (parts.size() == 1) {
+                    auto vtable = _library->findVtable("fiber");
+                    entry = vtable ? vtable->function(parts[0].c_str()) : nullptr;
+                }
+                else if (parts.size() == 2 && lookup(parts[0]) == Type::Unknown && _requires.count(parts[0])) {
+                    Library::Vtable const* vtable = nullptr;
+                    for (auto& i : _library->libraries)
+                        if (i.name == parts[0])
+                            vtable = i.findVtable(parts[0].c_str());
+                    if (!vtable)
+                        vtable = _library->findVtable(parts[0].c_str());
+                    entry = vtable ? vtable->function(parts[1].c_str()) : nullptr;
+                }
+            }
+            catch (std::exception&) {
+                // missing vtables are reported by the assembler
+                entry = nullptr;
+            }
+        }
+
+        if (!entry) {
+            stack.push_back({Type::Unknown, nullptr});
+            return;
+        }
+
+        const string& sig = entry->args;
+        if (sig.length() == args.size() && sig.find_first_not_of("fis") == string::npos) {
+            for (size_t i = 0; i < sig.length(); ++i) {
+                Type t = sig[i] == 'f' ? Type::Float : sig[i] == 'i' ? Type::Int : Type::String;
+                stringstream context;
+                context << "argument " << i + 1 << " of " << fn->str2;
+                require(args[i], t, context.str());
+            }
+        }
+
+        const string& response = entry->response;
+        if (response.empty())
+            return;
+        if (response == "f")
+            stack.push_back({Type::Float, nullptr});
+        else if (response == "i")
+            stack.push_back({Type::Int, nullptr});
+        else if (response == "s")
+            stack.push_back({Type::String, nullptr});
+        else
+            stack.push_back({Type::Unknown, nullptr});
+    }
+
+    void TypeInference::inferOp(ASTNode* op, vector<Value>& stack)
+    {
+        const char* opName = tokenName(op->token);
+        if (op->token == kTokenOpNegate) {
+            Value v = stack.size() ? stack.back() : Value{Type::Unknown, nullptr};
+            if (stack.size())
+                stack.pop_back();
+            if (v.type == Type::String)
+                TI_RAISE("operator " << opName << " can't be applied to a string");
+            op->str1 = v.type == Type::Int ? "int" : "float";
+            if (v.type == Type::Unknown)
+                convert(v, Type::Float);
+            else
+                ++_specializedOps;
+            stack.push_back({v.type == Type::Int ? Type::Int : Type::Float, nullptr});
+            return;
+        }
+
+        Value v2 = stack.size() ? stack.back() : Value{Type::Unknown, nullptr};
+        if (stack.size())
+            stack.pop_back();
+        Value v1 = stack.size() ? stack.back() : Value{Type::Unknown, nullptr};
+        if (stack.size())
+            stack.pop_back();
+
+        if (v1.type == Type::String || v2.type == Type::String)
+            TI_RAISE("operator " << opName << " can't be applied to a string");
+
+        Type t;
+        if (v1.type == Type::Unknown || v2.type == Type::Unknown) {
+            // as before, the op checks its operands at runtime
+            t = Type::Float;
+            convert(v1, Type::Float);
+            convert(v2, Type::Float);
+        }
+        else if (v1.type == v2.type)
+            t = v1.type;
+        else if (convert(v1.type == Type::Int ? v1 : v2, Type::Float))
+            t = Type::Float;    // an int literal mixed with a float
+        else if (convert(v1.type == Type::Float ? v1 : v2, Type::Int))
+            t = Type::Int;      // an integral float literal mixed with an int
+        else
+            TI_RAISE("operator " << opName << " mixes " << name(v1.type) << " and " << name(v2.type));
+
+        if (v1.type != Type::Unknown && v2.type != Type::Unknown)
+            ++_specializedOps;
+
+        op->str1 = t == Type::Int ? "int" : "float";
+        stack.push_back({isComparison(op->token) ? Type::Float : t, nullptr});
+    }
+
+} // Landru
@@ -0,0 +1,71 @@
+//
+//  TypeInference.h
+//  Landru
+//
+//  AST pass run by AssemblerBase::assemble before optimization. Declared
+//  variable types, literal types, and library signatures are propagated
+//  through expressions so that every arithmetic op is annotated as int or
+//  float (ASTNode::str1), numeric literals are converted to the type their
+//  use requires, and mixed or mismatched operands are rejected.
+//
+//  Values of unknown type, such as library objects or dotted property
+//  accesses, are left to the runtime checks as before.
+//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Landru {
+
+    class ASTNode;
+    class Library;
+
+    class TypeInference
+    {
+    public:
+        // library may be null, in which case function results are unknown
+        explicit TypeInference(Library* library) : _library(library) {}
+
+        // annotates root in place, throws AssemblerBase::Exception on a type error
+        void infer(ASTNode* root);
+
+        int specializedOps() const { return _specializedOps; }
+        int convertedLiterals() const { return _convertedLiterals; }
+
+    private:
+        enum class Type { Unknown, Int, Float, String };
+        struct Value {
+            Type type;
+            ASTNode* literal;   // a numeric literal that may still be converted
+        };
+
+        static Type typeNamed(const std::string&);
+        static const char* name(Type);
+
+        Type lookup(const std::string& name) const;
+        void declare(const std::string& name, const std::string& type);
+
+        void inferMachine(ASTNode*);
+        void inferStatements(ASTNode*);
+        void inferStatement(ASTNode*);
+        void inferDeclaration(ASTNode* var);
+        void inferAssignment(ASTNode* assignment, const char* what);
+        void inferConditional(ASTNode* qualifier);
+        std::vector<Value> inferExpression(ASTNode* node);
+        void inferFunction(ASTNode* fn, bool onStackTop, std::vector<Value>& stack);
+        void inferOp(ASTNode* op, std::vector<Value>& stack);
+
+        bool convert(Value& v, Type to);
+        void require(Value& v, Type to, const std::string& context);
+
+        Library* _library;
+        std::map<std::string, std::string> _requires;
+        std::vector<std::map<std::string, Type>> _scopes;
+        int _specializedOps = 0;
+        int _convertedLiterals = 0;
+    };
+
+} // Landru
@@ -0,0 +1,167 @@
+//
+//  assemblybench.cpp
+//  Landru
+//
+//  Times the assembly of a large generated program against a library as
+//  registered, and against the same library once frozen, on one thread and
+//  then on several. The program calls into a synthetic plugin library with
+//  many vtables and functions, and declares properties and locals, so that
+//  assembly is dominated by vtable, function and type lookups.
+//
+//  Usage: landru-assembly-bench [machine count] [vtable count] [functions per vtable] [threads]
+//
+
+#include "Landru/Landru.h"
+#include "LandruActorVM/Fiber.h"
+#include "LandruActorVM/Library.h"
+#include "LandruActorVM/MachineDefinition.h"
+#include "LandruActorVM/VMContext.h"
+#include "LandruActorVM/StdLib/StdLib.h"
+#include "LandruAssembler/LandruActorAssembler.h"
+#include "LandruCompiler/AST.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <map>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+namespace {
+
+    typedef chrono::steady_clock Clock;
+
+    const int kStates = 4;
+    const int kCalls = 8;
+
+    double ms(Clock::time_point start)
+    {
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+
+    Landru::RunState nop(Landru::FnContext& run)
+    {
+        run.self->popVar();
+        return Landru::RunState::Continue;
+    }
+
+    // a plugin sized library, bench, with vtables v0..vN, and a root vtable
+    // also named bench so that bench.fn calls resolve
+    void registerBenchLibrary(Landru::Library& lib, int vtables, int functions)
+    {
+        Landru::Library bench("bench");
+        for (int v = 0; v <= vtables; ++v) {
+            string name = v < vtables ? "v" + to_string(v) : string("bench");
+            auto vtable = unique_ptr<Landru::Library::Vtable>(new Landru::Library::Vtable(name.c_str()));
+            for (int f = 0; f < functions; ++f)
+                vtable->registerFn("2.0", ("fn" + to_string(f)).c_str(), "f", "", nop);
+            if (v < vtables)
+                bench.registerVtable(move(vtable));
+            else
+                lib.registerVtable(move(vtable));
+        }
+        lib.libraries.emplace_back(move(bench));
+    }
+
+    string generateProgram(int machines, int functions)
+    {
+        string program = "bench = require(\"bench\")\n\n";
+        int call = 0;
+        for (int m = 0; m < machines; ++m) {
+            program += "machine m" + to_string(m) + ":\n"
+                       "    declare:\n"
+                       "        int a\n"
+                       "        float b = 2\n"
+                       "        shared string c\n"
+                       "    ;\n";
+            for (int s = 0; s < kStates; ++s) {
+                program += "    state s" + to_string(s) + ":\n"
+                           "        declare:\n"
+                           "            float j = 1\n"
+                           "        ;\n";
+                for (int c = 0; c < kCalls; ++c)
+                    program += "        bench.fn" + to_string(call++ % functions) + "(j)\n";
+                program += "    ;\n";
+            }
+            program += ";\n\n";
+        }
+        program += "machine main:\n    state main:\n    ;\n;\n";
+        return program;
+    }
+
+    // a summary of the definitions, to check that they don't depend on the
+    // number of threads
+    size_t definitionsSize(const map<string, shared_ptr<Landru::MachineDefinition>>& definitions)
+    {
+        size_t size = 0;
+        for (auto & d : definitions)
+            size += d.first.length() + d.second->states.size() + d.second->slots.size();
+        return size;
+    }
+
+    double assemble(Landru::Library& lib, const string& program, int threads, size_t& instructions, size_t& definitions)
+    {
+        LandruNode_t* root = landruCreateRootNode();
+        if (landruParseProgram(root, program.c_str(), program.length())) {
+            fprintf(stderr, "the generated program did not parse\n");
+            exit(1);
+        }
+
+        auto start = Clock::now();
+        Landru::ActorAssembler laa(&lib);
+        laa.setThreads(threads);
+        laa.assemble(reinterpret_cast<Landru::ASTNode*>(root));
+        double result = ms(start);
+
+        instructions = laa.instructionCount();
+        definitions = definitionsSize(laa.assembledMachineDefinitions());
+        landruReleaseRootNode(root);
+        return result;
+    }
+
+} // anon
+
+int main(int argc, char** argv)
+{
+    int machines = argc > 1 ? atoi(argv[1]) : 5000;
+    int vtables = argc > 2 ? atoi(argv[2]) : 200;
+    int functions = argc > 3 ? atoi(argv[3]) : 100;
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+
+    string program = generateProgram(machines, functions);
+    printf("%d machines, %d calls, into %d vtables of %d functions\n",
+           machines, machines * kStates * kCalls, vtables + 1, functions);
+
+    Landru::Library registered("landru");
+    Landru::VMContext registeredContext(&registered);
+    Landru::Std::populateLibrary(registered, registeredContext);
+    registerBenchLibrary(registered, vtables, functions);
+
+    Landru::Library frozen("landru");
+    Landru::VMContext frozenContext(&frozen);
+    Landru::Std::populateLibrary(frozen, frozenContext);
+    registerBenchLibrary(frozen, vtables, functions);
+    auto start = Clock::now();
+    frozen.freeze();
+    double freezeTime = ms(start);
+
+    size_t instructions = 0, definitions = 0;
+    size_t parallelInstructions = 0, parallelDefinitions = 0;
+    double unfrozenTime = assemble(registered, program, 1, instructions, definitions);
+    double frozenTime = assemble(frozen, program, 1, instructions, definitions);
+    double parallelTime = assemble(frozen, program, threads, parallelInstructions, parallelDefinitions);
+
+    printf("  %zu instructions\n", instructions);
+    printf("  registered  assemble %9.2f ms\n", unfrozenTime);
+    printf("  frozen      assemble %9.2f ms  freeze %7.2f ms\n", frozenTime, freezeTime);
+    printf("  parallel    assemble %9.2f ms  on %s threads\n", parallelTime,
+           threads > 0 ? to_string(threads).c_str() : ("up to " + to_string(thread::hardware_concurrency())).c_str());
+    if (parallelInstructions != instructions || parallelDefinitions != definitions) {
+        fprintf(stderr, "parallel assembly differs from assembly on one thread\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+//
+//  parsebench.cpp
+//  Landru
+//
+//  Measures parser throughput on a large generated program exercising
+//  declarations, assignments, function calls, conditionals, loops, on
+//  clauses, gotos and launches, and reports it in MB/s along with the
+//  number of heap allocations made by each parse.
+//
+//  Usage: landru-parse-bench [machine count] [repetitions]
+//
+
+#include "Landru/Landru.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+using namespace std;
+
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace {
+
+    typedef chrono::steady_clock Clock;
+
+    const int kStates = 6;
+
+    string generateProgram(int machines)
+    {
+        string program =
+            "io = require(\"io\")\n"
+            "time = require(\"time\")\n"
+            "real = require(\"real\")\n\n"
+            "declare:\n"
+            "    string greeting = \"hello\"\n"
+            "    int count = 9\n"
+            ";\n\n";
+
+        for (int m = 0; m < machines; ++m) {
+            string name = "m" + to_string(m);
+            program += "// machine " + to_string(m) + " of " + to_string(machines) + "\n"
+                       "machine " + name + ":\n"
+                       "    declare:\n"
+                       "        int a\n"
+                       "        shared int b = 1\n"
+                       "        float c = 2.5\n"
+                       "        string d = \"" + name + "-string\"\n"
+                       "    ;\n";
+            for (int s = 0; s < kStates; ++s) {
+                string next = "s" + to_string((s + 1) % kStates);
+                program += "    state s" + to_string(s) + ":\n"
+                           "        declare:\n"
+                           "            float j = " + to_string(s) + "\n"
+                           "        ;\n"
+                           "        a = b\n"
+                           "        io.print(\"state \", j, \" of \", d, \"\\n\")\n"
+                           "        if (a):\n"
+                           "            io.print(\"a is set\\n\")\n"
+                           "        ;\n"
+                           "        else:\n"
+                           "            io.print(\"a is not set\\n\")\n"
+                           "        ;\n"
+                           "        for i in real.range(0, 10, 1):\n"
+                           "            io.print(i, \" \")\n"
+                           "        ;\n"
+                           "        on time.after(0.5):\n"
+                           "            goto " + next + "\n"
+                           "        ;\n"
+                           "    ;\n";
+            }
+            program += "    state main:\n"
+                       "        launch(\"" + name + "\")\n"
+                       "        goto s0\n"
+                       "    ;\n"
+                       ";\n\n";
+        }
+        program += "machine main:\n    state main:\n        io.print(greeting)\n    ;\n;\n";
+        return program;
+    }
+
+} // anon
+
+int main(int argc, char** argv)
+{
+    int machines = argc > 1 ? atoi(argv[1]) : 2000;
+    int repetitions = argc > 2 ? atoi(argv[2]) : 5;
+
+    string program = generateProgram(machines);
+    double megabytes = program.length() / (1024.0 * 1024.0);
+    printf("%d machines, %.2f MB of source\n", machines, megabytes);
+
+    double best = 0;
+    for (int r = 0; r < repetitions; ++r) {
+        size_t before = allocations;
+        LandruNode_t* root = landruCreateRootNode();
+        auto start = Clock::now();
+        int error = landruParseProgram(root, program.c_str(), program.length());
+        double seconds = chrono::duration<double>(Clock::now() - start).count();
+        size_t allocated = allocations - before;
+        landruReleaseRootNode(root);
+        if (error) {
+            fprintf(stderr, "the generated program did not parse\n");
+            return 1;
+        }
+        best = r ? min(best, seconds) : seconds;
+        printf("  parse %9.2f ms  %8.2f MB/s  %zu allocations\n", seconds * 1000, megabytes / seconds, allocated);
+    }
+    printf("  best  %9.2f ms  %8.2f MB/s\n", best * 1000, megabytes / best);
+    return 0;
+}
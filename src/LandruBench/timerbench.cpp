@@ -0,0 +1,137 @@
+//
+//  timerbench.cpp
+//  Landru
+//
+//  Compares the TimingWheel used by the time plugin with an ordered
+//  multiset, for a million concurrent timers expiring over a minute of
+//  frames, and for a workload where most timers are cancelled.
+//
+//  Usage: landru-timer-bench [timer count]
+//
+
+#include "LandruActorVM/TimingWheel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+    const double kFrame = 1.0 / 60.0;
+    const double kSpan = 60.0;
+
+    typedef chrono::steady_clock Clock;
+
+    double ms(Clock::time_point start)
+    {
+        return chrono::duration<double, milli>(Clock::now() - start).count();
+    }
+
+    struct Result
+    {
+        double schedule;
+        double cancel;
+        double expire;
+        size_t fired;
+        bool ordered;
+    };
+
+    void report(const char* name, const Result& r)
+    {
+        printf("  %-10s schedule %9.2f ms  cancel %9.2f ms  expire %9.2f ms  fired %zu%s\n",
+               name, r.schedule, r.cancel, r.expire, r.fired, r.ordered ? "" : "  OUT OF ORDER");
+    }
+
+    Result runWheel(const vector<double>& deadlines, const vector<size_t>& cancels)
+    {
+        Result r = {};
+        r.ordered = true;
+        Landru::TimingWheel<uint32_t> wheel(1.e-3, 0);
+        vector<Landru::TimingWheel<uint32_t>::Handle> handles(deadlines.size());
+
+        auto start = Clock::now();
+        for (size_t i = 0; i < deadlines.size(); ++i)
+            handles[i] = wheel.schedule(deadlines[i], uint32_t(i));
+        r.schedule = ms(start);
+
+        start = Clock::now();
+        for (size_t i : cancels)
+            wheel.cancel(handles[i]);
+        r.cancel = ms(start);
+
+        double last = 0;
+        start = Clock::now();
+        for (double now = 0; now <= kSpan + kFrame; now += kFrame)
+            wheel.advance(now, [&](Landru::TimingWheel<uint32_t>::Handle, uint32_t&, double deadline) {
+                if (deadline < last || deadline > now)
+                    r.ordered = false;
+                last = deadline;
+                ++r.fired;
+            });
+        r.expire = ms(start);
+        return r;
+    }
+
+    Result runMultiset(const vector<double>& deadlines, const vector<size_t>& cancels)
+    {
+        Result r = {};
+        r.ordered = true;
+        typedef multiset<pair<double, uint32_t>> Queue;
+        Queue queue;
+        vector<Queue::iterator> handles(deadlines.size());
+
+        auto start = Clock::now();
+        for (size_t i = 0; i < deadlines.size(); ++i)
+            handles[i] = queue.emplace(deadlines[i], uint32_t(i));
+        r.schedule = ms(start);
+
+        start = Clock::now();
+        for (size_t i : cancels)
+            queue.erase(handles[i]);
+        r.cancel = ms(start);
+
+        start = Clock::now();
+        for (double now = 0; now <= kSpan + kFrame; now += kFrame)
+            while (!queue.empty() && queue.begin()->first <= now) {
+                queue.erase(queue.begin());
+                ++r.fired;
+            }
+        r.expire = ms(start);
+        return r;
+    }
+
+} // anon
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    mt19937_64 rng(1234);
+    uniform_real_distribution<double> when(0, kSpan);
+    vector<double> deadlines(count);
+    for (auto & d : deadlines)
+        d = when(rng);
+
+    vector<size_t> none;
+    vector<size_t> most;
+    for (size_t i = 0; i < count; ++i)
+        if (rng() % 10)
+            most.push_back(i);
+    shuffle(most.begin(), most.end(), rng);
+
+    printf("%zu concurrent timers over %.0f s at 60 Hz\n", count, kSpan);
+    report("wheel", runWheel(deadlines, none));
+    report("multiset", runMultiset(deadlines, none));
+
+    printf("%zu timers, %zu cancelled\n", count, most.size());
+    report("wheel", runWheel(deadlines, most));
+    report("multiset", runMultiset(deadlines, most));
+    return 0;
+}
@@ -6,15 +6,21 @@
 #include "LandruCompiler/lcRaiseError.h"
 #include "LandruAssembler/LandruAssembler.h"
 #include "LandruAssembler/LandruActorAssembler.h"
+#include "LandruAssembler/CppAssembler.h"
+#include "LandruAssembler/Module.h"
+#include "LandruActorVM/DebugMap.h"
 #include "LandruActorVM/Fiber.h"
 #include "LandruActorVM/Library.h"
+#include "LandruActorVM/PluginLoader.h"
 #include "LandruActorVM/VMContext.h"
 #include "LandruActorVM/StdLib/StdLib.h"
+#include "LandruActorVM/Trace.h"
 #include "LabText/LabText.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <iostream>
-#include <set>
 #include <string>
 #include <thread>
 #include <vector>
@@ -22,114 +28,58 @@
 #if defined(LANDRU_OS_WINDOWS)
  #include <Windows.h>
 #else
- #include <dlfcn.h>
+ #include <dirent.h>
 #endif
 
 using namespace std;
 
-namespace {
-    #if defined(ARCH_OS_LINUX) || defined(ARCH_OS_DARWIN)
-    #   define ARCH_LIBRARY_LAZY    RTLD_LAZY
-    #   define ARCH_LIBRARY_NOW     RTLD_NOW
-    #   define ARCH_LIBRARY_LOCAL   RTLD_LOCAL
-    #   define ARCH_LIBRARY_GLOBAL  RTLD_GLOBAL
-    #else
-    #   define ARCH_LIBRARY_LAZY    0
-    #   define ARCH_LIBRARY_NOW     0
-    #   define ARCH_LIBRARY_LOCAL   0
-    #   define ARCH_LIBRARY_GLOBAL  0
-    #endif
-
+// the scripts in a directory, those named .ws or .lan
+vector<string> scriptsIn(const string& dir)
+{
+	vector<string> names;
 #if defined(LANDRU_OS_WINDOWS)
-	std::string ArchStrSysError(unsigned long errorCode)
-	{
-		if (errorCode == 0)
-			return std::string();
-
-		LPSTR buffer = nullptr;
-		size_t len = FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER |
-			FORMAT_MESSAGE_FROM_SYSTEM |
-			FORMAT_MESSAGE_IGNORE_INSERTS,
-			nullptr,
-			errorCode,
-			MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-			(LPSTR)&buffer,
-			0,
-			nullptr);
-
-		std::string message(buffer, len);
-
-		OutputDebugString(buffer);
-		LocalFree(buffer);
-
-		return message;
-		return std::string();
+	WIN32_FIND_DATAA found;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &found);
+	if (h != INVALID_HANDLE_VALUE) {
+		do names.push_back(found.cFileName);
+		while (FindNextFileA(h, &found));
+		FindClose(h);
+	}
+#else
+	if (DIR* d = opendir(dir.c_str())) {
+		while (dirent* e = readdir(d))
+			names.push_back(e->d_name);
+		closedir(d);
 	}
 #endif
-
-
-    void* ArchLibraryOpen(const std::string &filename, int flag)
-    {
-    #if defined(LANDRU_OS_WINDOWS)
-        return LoadLibrary(filename.c_str());
-    #else
-        return dlopen(filename.c_str(), flag);
-    #endif
-    }
-
-    const char* ArchLibraryError()
-    {
-    #if defined(LANDRU_OS_WINDOWS)
-        DWORD error = ::GetLastError();
-        return error ?  ArchStrSysError(error).c_str() : nullptr;
-    #else
-        return dlerror();
-    #endif
-    }
-
-    int ArchLibraryClose(void* handle)
-    {
-    #if defined(LANDRU_OS_WINDOWS)
-        int status = ::FreeLibrary(reinterpret_cast<HMODULE>(handle));
-    #else
-        int status = dlclose(handle);
-    #endif
-        return status;
-    }
-
-    void* ArchLibraryGetSymbol(void* handle, const char* name)
-    {
-    #if defined(LANDRU_OS_WINDOWS)
-        return GetProcAddress((HMODULE) handle, name);
-    #else
-        return dlsym(handle, name);
-    #endif
-    }
+	vector<string> scripts;
+	for (auto & n : names) {
+		size_t dot = n.find_last_of('.');
+		if (dot != string::npos && (n.substr(dot) == ".ws" || n.substr(dot) == ".lan"))
+			scripts.push_back(dir + "/" + n);
+	}
+	sort(scripts.begin(), scripts.end());
+	return scripts;
 }
 
-void loadLibrary(Landru::Library & lib, const std::string & s, Landru::VMContext* vm)
+// parses every script in the directory on all cores, returns the number that failed
+int parseDirectory(const string& dir)
 {
-	using Landru::LandruRequire;
-    static set<string> loadedLibraries;
-    if (loadedLibraries.find(s) == loadedLibraries.end()) {
-        if (s.length()) {
-			LandruRequire req;
-			req.name = "landru_" + s;
-            req.plugin = ArchLibraryOpen(req.name + ".dll", ARCH_LIBRARY_LAZY);
-            if (!req.plugin) {
-                // raise error
-            }
-            else {
-                req.init = (LandruRequire::InitFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_init").c_str());
-                req.update = (LandruRequire::UpdateFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_update").c_str());
-                req.finish = (LandruRequire::FinishFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_finish").c_str());
-                req.fiberExpiring = (LandruRequire::FiberExpiringFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_fiberExpiring").c_str());
-				req.clearContinuations = (LandruRequire::ClearContinuationsFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_clearContinuations").c_str());
-				req.pendingContinuations = (LandruRequire::PendingContinuationsFn) ArchLibraryGetSymbol(req.plugin, (req.name + "_pendingContinuations").c_str());
-				vm->plugins.push_back(req);
-            }
-        }
-    }
+	vector<string> scripts = scriptsIn(dir);
+	vector<const char*> paths;
+	for (auto & s : scripts)
+		paths.push_back(s.c_str());
+	vector<LandruNode_t*> roots(paths.size());
+
+	auto start = chrono::steady_clock::now();
+	int failed = landruParseFiles(paths.data(), paths.size(), roots.data(), 0);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	for (auto r : roots)
+		if (r)
+			landruReleaseRootNode(r);
+	printf("Parsed %zu scripts in %.2f ms, %d failed\n", paths.size(), seconds * 1.e3, failed);
+	return failed;
 }
 
 void print_library(const Landru::Library& l, const std::string& root)
@@ -182,70 +132,220 @@ int main(int argc, char** argv)
     bool json = false;
     op.AddTrueOption("j", "json", json, "Output AST as Json");
     std::string path;
-    op.AddStringOption("f", "file", path, "Compile this file");
+    op.AddStringOption("f", "file", path, "Compile this file, or load this .lmod module");
+    bool compileOnly = false;
+    op.AddTrueOption("C", "compile-only", compileOnly, "Write the assembled program as a module rather than running it");
+    std::string modulePath;
+    op.AddStringOption("o", "output", modulePath, "Write the module to this file, by default the file's name with .lmod");
     bool printAst = false;
     op.AddTrueOption("p", "print", printAst, "Print AST to console");
     bool run = false;
     op.AddTrueOption("r", "run", run, "Run on succesful compilation");
     bool verbose = false;
     op.AddTrueOption("v", "verbose", verbose, "Verbose output");
+    std::string traceFile;
+    op.AddStringOption("t", "trace", traceFile, "Write a binary instruction trace to this file");
     int breakPoint = ~0;
     op.AddIntOption("b", "breakpoint", breakPoint, "Breakpoint");
 	bool repl = false;
 	op.AddTrueOption("l", "repl", repl, "Start a REPL");
+    int optLevel = 1;
+    op.AddIntOption("O", "opt-level", optLevel, "Optimization level, 0 disables optimization, 3 also strips unreachable states and machines");
+    int assemblyThreads = 0;
+    op.AddIntOption("a", "assembly-threads", assemblyThreads, "Assemble machines on this many threads, 0 for one per core");
+    std::string emitCpp;
+    op.AddStringOption("c", "emit-cpp", emitCpp, "Translate the program to C++ in this file, to be built as the plugin landru_<file name>");
+    std::string nativeModule;
+    op.AddStringOption("n", "native", nativeModule, "Run states natively from the plugin landru_<module> built from --emit-cpp output");
+    bool stats = false;
+    op.AddTrueOption("s", "stats", stats, "Report instruction counts before and after optimization");
+    std::string profileFile;
+    op.AddStringOption("P", "profile", profileFile, "Profile the run, writing collapsed stacks for flame graphs to this file");
+    int profileInterval = 1000;
+    op.AddIntOption("i", "profile-interval", profileInterval, "Profiler sampling interval in microseconds");
+    int fiberBudget = 0;
+    op.AddIntOption("B", "fiber-budget", fiberBudget, "Preempt fibers after this many instructions per update, 0 is unlimited");
+    int fiberTime = 0;
+    op.AddIntOption("F", "fiber-time", fiberTime, "Preempt fibers after running this many microseconds per update, 0 is unlimited");
+    bool timings = false;
+    op.AddTrueOption("T", "timings", timings, "Report the time spent starting up, including loading each plugin");
+    std::string pluginPath;
+    op.AddStringOption("L", "plugin-path", pluginPath, "Search this directory for plugins, after LANDRU_PLUGIN_PATH");
+
+	std::string parseDir;
+	op.AddStringOption("d", "parse-dir", parseDir, "Parse every script in this directory, on all cores, and report errors");
 
 	if (op.Parse(argc, argv))
 	{
+        if (parseDir.length())
+            exit(parseDirectory(parseDir) ? 1 : 0);
+
         if (path.length() == 0) {
             op.Usage();
             exit(1);
         }
 
-        FILE* f = fopen(path.c_str(), "rb");
-		if (!f) {
-			std::cout << path << " not found" << std::endl;
-			exit(1);
+		// startup phases, reported by --timings
+		typedef chrono::steady_clock Clock;
+		auto startup = Clock::now();
+		auto phase = startup;
+		vector<pair<string, double>> phaseTimes;
+		auto endPhase = [&phase, &phaseTimes](const char* name) {
+			auto now = Clock::now();
+			phaseTimes.emplace_back(name, chrono::duration<double, milli>(now - phase).count());
+			phase = now;
+		};
+		vector<Landru::PluginLoader::Timing> pluginTimes;
+
+		// a precompiled module is mapped, and its tree used as is
+		bool isModule = path.length() > 5 && path.substr(path.length() - 5) == ".lmod";
+		Landru::Module module;
+		char* text = nullptr;
+		size_t len = 0;
+		if (isModule) {
+			std::string error;
+			if (!module.open(path.c_str(), error)) {
+				std::cout << path << ": " << error << std::endl;
+				exit(1);
+			}
+			endPhase("map module");
 		}
+		else {
+			FILE* f = fopen(path.c_str(), "rb");
+			if (!f) {
+				std::cout << path << " not found" << std::endl;
+				exit(1);
+			}
 
-		fseek(f, 0, SEEK_END);
-		size_t len = ftell(f);
-		fseek(f, 0, SEEK_SET);
-		char* text = new char[len + 1];
-		fread(text, 1, len, f);
-		text[len] = '\0';
-		fclose(f);
+			fseek(f, 0, SEEK_END);
+			len = ftell(f);
+			fseek(f, 0, SEEK_SET);
+			text = new char[len + 1];
+			fread(text, 1, len, f);
+			text[len] = '\0';
+			fclose(f);
+			endPhase("read");
+		}
 
-		std::cout << "Compiling " << path << std::endl;
+		std::cout << (isModule ? "Loading " : "Compiling ") << path << std::endl;
 
 		// parse the program
 		//
-		LandruNode_t* rootNode = landruCreateRootNode();
-//		std::vector<std::pair<std::string, Json::Value*> > jsonVars;
-		bool success = !landruParseProgram(rootNode, /*&jsonVars,*/ text, len);
+		LandruNode_t* rootNode = nullptr;
+		bool success = true;
+		if (isModule) {
+			rootNode = (LandruNode_t*) module.createRoot();
+			endPhase("load module");
+		}
+		else {
+			rootNode = landruCreateRootNode();
+//			std::vector<std::pair<std::string, Json::Value*> > jsonVars;
+			success = !landruParseProgram(rootNode, /*&jsonVars,*/ text, len);
+			endPhase("parse");
+		}
 
 		Landru::Library library("landru");
 		Landru::ActorAssembler laa(&library);
 
 		Landru::VMContext vmContext(&library);
 
+		// instruction descriptions and source locations are only needed to
+		// decode traces and profiles
+		bool trace = verbose || traceFile.length() > 0;
+		bool profile = profileFile.length() > 0;
+		Landru::DebugMap::shared().setEnabled(trace || profile);
+
 		try
 		{
 			// load libraries to learn valid interfaces
 			//
 			Landru::Std::populateLibrary(library, vmContext);
 			//Landru::Audio::LabSoundLib::registerLib(library());
+			endPhase("standard library");
+
+			if (pluginPath.length())
+				Landru::PluginLoader::shared().addSearchPath(pluginPath);
+			vector<string> requires = isModule ? module.requires() : laa.requires2((Landru::ASTNode*) rootNode);
+			pluginTimes = Landru::PluginLoader::shared().load(&vmContext, requires);
+			endPhase("load plugins");
 
-			vector<string> requires = laa.requires2((Landru::ASTNode*) rootNode);
-			for (auto r : requires) {
-				loadLibrary(library, r, &vmContext);
-			}
 			for (auto & r : vmContext.plugins) {
 				if (r.init)
 					r.init(&library);
 			}
+			endPhase("initialize plugins");
+			library.freeze();
+			endPhase("freeze library");
+
+			// the optimizer rewrites the AST, so the unoptimized baseline for
+			// the report has to be assembled first
+			size_t unoptimizedCount = 0;
+			if (stats) {
+				Landru::ActorAssembler baseline(&library);
+				baseline.setOptLevel(0);
+				baseline.assemble((Landru::ASTNode*) rootNode);
+				unoptimizedCount = baseline.instructionCount();
+			}
 
-			// assemble the program
+			// assemble the program. A module's tree was optimized when the
+			// module was written, and no longer hashes as it was parsed.
+			if (isModule)
+				laa.setSourceHashes(module.sourceHashes());
+			laa.setOptLevel(isModule ? 0 : optLevel);
+			// breakpoints are instruction addresses, which are only numbered
+			// in program order when the machines are assembled on one thread
+			laa.setThreads(breakPoint != ~0 ? 1 : assemblyThreads);
 			laa.assemble((Landru::ASTNode*) rootNode);
+			endPhase("assemble");
+			for (auto & w : laa.warnings())
+				std::cout << path << ": warning: " << w << std::endl;
+
+			if (compileOnly || modulePath.length()) {
+				if (!modulePath.length())
+					modulePath = path.substr(0, path.find_last_of('.')) + ".lmod";
+				if (Landru::writeModule(modulePath.c_str(), (Landru::ASTNode*) rootNode,
+				                        laa.assembledMachineDefinitions(), isModule ? int(module.header().optLevel) : optLevel))
+					std::cout << "Wrote " << modulePath << std::endl;
+				else {
+					std::cout << "Could not write " << modulePath << std::endl;
+					success = false;
+				}
+				endPhase("write module");
+			}
+
+			if (stats)
+				std::cout << "Instructions: " << unoptimizedCount << " unoptimized, "
+				          << laa.instructionCount() << " at opt level " << optLevel << std::endl;
+
+			if (emitCpp.length()) {
+				// the AST has already been optimized by laa
+				Landru::CppAssembler cpp(&library);
+				cpp.setOptLevel(0);
+				cpp.assemble((Landru::ASTNode*) rootNode);
+
+				string module = emitCpp;
+				size_t slash = module.find_last_of("/\\");
+				if (slash != string::npos)
+					module = module.substr(slash + 1);
+				module = module.substr(0, module.find('.'));
+
+				FILE* out = fopen(emitCpp.c_str(), "wb");
+				if (!out) {
+					std::cout << "Could not write " << emitCpp << std::endl;
+					success = false;
+				}
+				else {
+					string src = cpp.source(module, path);
+					fwrite(src.data(), 1, src.length(), out);
+					fclose(out);
+				}
+			}
+
+			if (nativeModule.length()) {
+				auto native = Landru::PluginLoader::shared().load(&vmContext, { nativeModule });
+				pluginTimes.insert(pluginTimes.end(), native.begin(), native.end());
+				endPhase("load native module");
+			}
 		}
 		catch (const std::exception& exc) {
 			std::cout << "Compilation error occured: " << exc.what() << std::endl;
@@ -254,6 +354,17 @@ int main(int argc, char** argv)
 
 		delete[] text;
 
+		if (timings) {
+			double total = chrono::duration<double, milli>(Clock::now() - startup).count();
+			printf("Startup %.2f ms\n", total);
+			for (auto & t : phaseTimes)
+				printf("  %-20s %9.2f ms\n", t.first.c_str(), t.second);
+			for (auto & t : pluginTimes)
+				printf("    %-18s %9.2f ms  %s%s\n", t.name.c_str(), t.seconds * 1.e3,
+				       t.loaded ? t.path.c_str() : "not found",
+				       t.cached ? " (manifest)" : "");
+		}
+
 		// diagnostic
 		//
 		if (json)
@@ -263,11 +374,13 @@ int main(int argc, char** argv)
 
 		// execution
 		//
-		if (run && success)
+		if (run && success && !compileOnly)
 		{
 			bool run = true;
-			vmContext.traceEnabled = verbose;
+			vmContext.traceEnabled = trace;
 			vmContext.breakPoint = breakPoint;
+			vmContext.setFiberBudget(fiberBudget > 0 ? uint32_t(fiberBudget) : 0,
+			                         fiberTime > 0 ? fiberTime * 1.e-6 : 0);
 			vmContext.setDefinitions(laa.assembledMachineDefinitions());
 			for (auto i : laa.assembledGlobalVariables()) {
 				vmContext.storeGlobal(i.first, i.second);
@@ -277,9 +390,66 @@ int main(int argc, char** argv)
 
 			vmContext.launchQueue.push(Landru::VMContext::LaunchRecord("main", Landru::Fiber::Stack()));
 
-			std::thread t([&run, &vmContext]()
+			if (profile)
+				vmContext.profiler().start(profileInterval);
+
+			// the REPL's reload command has the update thread reparse the file,
+			// or remap the module, between updates, and swap in the machines
+			// that changed
+			std::atomic<bool> reloadRequested(false);
+			auto reloadProgram = [&path, &library, &vmContext, optLevel, isModule]()
+			{
+				LandruNode_t* root = nullptr;
+				Landru::Module reloaded;
+				if (isModule) {
+					std::string error;
+					if (!reloaded.open(path.c_str(), error)) {
+						std::cout << path << ": " << error << std::endl;
+						return;
+					}
+					root = (LandruNode_t*) reloaded.createRoot();
+				}
+				else {
+					FILE* f = fopen(path.c_str(), "rb");
+					if (!f) {
+						std::cout << path << " not found" << std::endl;
+						return;
+					}
+					std::string source;
+					char buff[4096];
+					size_t read;
+					while ((read = fread(buff, 1, sizeof(buff), f)) > 0)
+						source.append(buff, read);
+					fclose(f);
+
+					root = landruCreateRootNode();
+					if (landruParseProgram(root, source.c_str(), source.length())) {
+						landruReleaseRootNode(root);
+						return;
+					}
+				}
+
+				try {
+					Landru::ActorAssembler reloader(&library);
+					if (isModule)
+						reloader.setSourceHashes(reloaded.sourceHashes());
+					reloader.setOptLevel(isModule ? 0 : optLevel);
+					size_t count = reloader.reload((Landru::ASTNode*) root, &vmContext);
+					std::cout << "Reloaded " << count << " machines" << std::endl;
+				}
+				catch (const std::exception& exc) {
+					std::cout << "Reload failed: " << exc.what() << std::endl;
+				}
+				landruReleaseRootNode(root);
+			};
+
+			vector<Landru::TraceRecord> traceRecords;
+			std::thread t([&run, &vmContext, &traceRecords, &traceFile, &reloadRequested, &reloadProgram, verbose]()
 			{
 				do {
+					if (reloadRequested.exchange(false))
+						reloadProgram();
+
 					chrono::high_resolution_clock::time_point now = chrono::high_resolution_clock::now();
 					chrono::duration<double> time_span = chrono::duration_cast<chrono::seconds>(now.time_since_epoch());
 					try {
@@ -295,12 +465,26 @@ int main(int argc, char** argv)
 						run = false;
 					}
 
+					if (vmContext.traceEnabled) {
+						vmContext.traceBuffer().drain([&](const Landru::TraceRecord& r) {
+							if (verbose) {
+								const char* str = Landru::DebugMap::shared().lookup(r.addr);
+								printf("%08x %u: %s\n", r.fiber, r.addr, str ? str : "?");
+							}
+							if (traceFile.length())
+								traceRecords.push_back(r);
+						});
+					}
+
 					if (vmContext.undeferredMessagesPending()) {
 						continue;
 					}
 					else if (!vmContext.launchQueue.empty()) {
 						continue;
 					}
+					else if (vmContext.suspendedFibersPending()) {
+						continue;
+					}
 					else if (vmContext.deferredMessagesPending()) {
 						std::this_thread::sleep_for(std::chrono::microseconds(2000));
 					}
@@ -324,6 +508,8 @@ int main(int argc, char** argv)
 						curr = tsGetToken(curr, end, ' ', &token, &len);
 						if (!strncmp(token, "quit", 4))
 							run = false;
+						else if (!strncmp(token, "reload", 6))
+							reloadRequested = true;
 						else if (!strncmp(token, "definitions", 11)) {
 							auto d = vmContext.definitions();
 							for (auto i : d)
@@ -348,6 +534,20 @@ int main(int argc, char** argv)
 			}
 
 			t.join();
+
+			if (profile) {
+				vmContext.profiler().stop();
+				vmContext.profiler().printTop(stdout, 20, Landru::DebugMap::shared());
+				if (!vmContext.profiler().writeCollapsed(profileFile.c_str(), Landru::DebugMap::shared()))
+					std::cerr << "Could not write profile to " << profileFile << std::endl;
+			}
+
+			if (traceFile.length()) {
+				if (!Landru::writeTraceFile(traceFile.c_str(), traceRecords, Landru::DebugMap::shared()))
+					std::cerr << "Could not write trace to " << traceFile << std::endl;
+				else if (vmContext.traceBuffer().dropped())
+					std::cerr << "Trace dropped " << vmContext.traceBuffer().dropped() << " records" << std::endl;
+			}
 		}
 	}
 	else
@@ -11,12 +11,84 @@
 
 namespace Landru
 {
-	int ASTNode::inParamList = 0;
+	thread_local int ASTNode::inParamList = 0;
 
-	ASTNode::~ASTNode()
+	void* ASTArena::allocate(size_t bytes, size_t align)
 	{
-		for (ASTConstIter i = children.begin(); i != children.end(); ++i)
-			delete *i;
+		char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(_next) + align - 1) & ~(uintptr_t(align) - 1));
+		if (!_next || p + bytes > _end) {
+			// requests too big for a block get a block to themselves
+			size_t size = bytes + align > kBlockSize ? bytes + align : kBlockSize;
+			char* block = new char[size];
+			_blocks.push_back(block);
+			_next = block;
+			_end = block + size;
+			p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(_next) + align - 1) & ~(uintptr_t(align) - 1));
+		}
+		_next = p + bytes;
+		_used += bytes;
+		return p;
+	}
+
+	ASTString ASTArena::copy(const char* str, size_t length)
+	{
+		if (!length)
+			return ASTString();
+		char* result = static_cast<char*>(allocate(length + 1, 1));
+		memcpy(result, str, length);
+		result[length] = '\0';
+		return ASTString(result, length);
+	}
+
+	void ASTArena::reset()
+	{
+		for (char* block : _blocks)
+			delete [] block;
+		_blocks.clear();
+		_retained.clear();
+		_next = _end = nullptr;
+		_used = 0;
+	}
+
+	ASTNode* ASTArena::createRoot()
+	{
+		ASTArena* arena = new ASTArena();
+		return arena->node(kTokenProgram, "Landru");
+	}
+
+	void ASTArena::releaseRoot(ASTNode* root)
+	{
+		if (root)
+			delete &root->children.arena();
+	}
+
+	void ASTChildren::push_back(ASTNode* node)
+	{
+		if (_size == _capacity)
+			reserve(_capacity ? _capacity * 2 : 4);
+		_data[_size++] = node;
+	}
+
+	void ASTChildren::reserve(uint32_t capacity)
+	{
+		if (capacity <= _capacity)
+			return;
+		ASTNode** data = static_cast<ASTNode**>(_arena->allocate(capacity * sizeof(ASTNode*), alignof(ASTNode*)));
+		if (_size)
+			memcpy(data, _data, _size * sizeof(ASTNode*));
+		_data = data;
+		_capacity = capacity;
+	}
+
+	ASTChildren::iterator ASTChildren::erase(const_iterator first, const_iterator last)
+	{
+		iterator dst = _data + (first - _data);
+		size_t count = last - first;
+		if (count) {
+			memmove(dst, last, (end() - last) * sizeof(ASTNode*));
+			_size -= static_cast<uint32_t>(count);
+		}
+		return dst;
 	}
 
 
@@ -341,6 +413,49 @@ namespace Landru
 			i->dump(tabs+1);
 	}
 
+    namespace {
+        // FNV-1a
+        const uint64_t kHashBasis = 14695981039346656037ull;
+        const uint64_t kHashPrime = 1099511628211ull;
+
+        uint64_t hashBytes(uint64_t h, const void* data, size_t length)
+        {
+            const unsigned char* p = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < length; ++i)
+                h = (h ^ p[i]) * kHashPrime;
+            return h;
+        }
+
+        template <typename T>
+        uint64_t hashValue(uint64_t h, const T& value)
+        {
+            return hashBytes(h, &value, sizeof(value));
+        }
+
+        uint64_t hashNode(uint64_t h, const ASTNode* node)
+        {
+            h = hashValue(h, node->token);
+            h = hashValue(h, node->useMask);
+            switch (node->useMask) {
+                case ASTNode::kInt: h = hashValue(h, node->intVal); break;
+                case ASTNode::kFloat: h = hashValue(h, node->floatVal1); break;
+                case ASTNode::kFloat2: h = hashValue(h, node->floatVal1); h = hashValue(h, node->floatVal2); break;
+                default: break;
+            }
+            h = hashBytes(h, node->str1.c_str(), node->str1.length() + 1);
+            h = hashBytes(h, node->str2.c_str(), node->str2.length() + 1);
+            h = hashValue(h, node->children.size());
+            for (auto child : node->children)
+                h = hashNode(h, child);
+            return h;
+        }
+    }
+
+    uint64_t ASTNode::contentHash() const
+    {
+        return hashNode(kHashBasis, this);
+    }
+
     std::string ASTNode::toJson() const
     {
         printf("{ \"%s\" : \"%s\"", tokenName(token), str2.c_str());
@@ -6,15 +6,146 @@
 #define LANDRU_AST_H
 
 #include "LandruCompiler/Tokens.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <ostream>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace Landru
 {
+	class ASTArena;
 	class ASTNode;
-	typedef std::vector<ASTNode*>::const_iterator ASTConstIter;
+	typedef ASTNode* const* ASTConstIter;
 
 	class AssemblerBase;
+
+	// A string held by a node. It points at storage in the node's arena, or
+	// at a literal, and is always NUL terminated, so it is cheap to copy and
+	// needs no destructor.
+	class ASTString
+	{
+	public:
+		ASTString() : _str(""), _length(0) {}
+		ASTString(const char* str, size_t length) : _str(str), _length(length) {}
+
+		// str must be a literal, or outlive the tree
+		ASTString& operator=(const char* str)
+		{
+			_str = str;
+			_length = strlen(str);
+			return *this;
+		}
+
+		const char* c_str() const { return _str; }
+		size_t length() const { return _length; }
+		size_t size() const { return _length; }
+		bool empty() const { return _length == 0; }
+
+		operator std::string() const { return std::string(_str, _length); }
+
+		bool operator==(const char* rhs) const { return !strcmp(_str, rhs); }
+		bool operator!=(const char* rhs) const { return !(*this == rhs); }
+		bool operator==(const std::string& rhs) const { return rhs.length() == _length && !memcmp(_str, rhs.data(), _length); }
+		bool operator!=(const std::string& rhs) const { return !(*this == rhs); }
+
+	private:
+		const char* _str;
+		size_t _length;
+	};
+
+	inline bool operator==(const std::string& lhs, const ASTString& rhs) { return rhs == lhs; }
+	inline bool operator!=(const std::string& lhs, const ASTString& rhs) { return rhs != lhs; }
+	inline std::string operator+(const std::string& lhs, const ASTString& rhs) { return lhs + rhs.c_str(); }
+	inline std::string operator+(const ASTString& lhs, const std::string& rhs) { return lhs.c_str() + rhs; }
+	inline std::ostream& operator<<(std::ostream& os, const ASTString& s) { return os.write(s.c_str(), s.length()); }
+
+	// A node's children, as a contiguous run of pointers in the arena. A run
+	// that outgrows its capacity moves to one twice the size, and the old run
+	// is reclaimed with the rest of the arena.
+	class ASTChildren
+	{
+	public:
+		typedef ASTNode** iterator;
+		typedef ASTConstIter const_iterator;
+
+		explicit ASTChildren(ASTArena& arena) : _arena(&arena) {}
+
+		iterator begin() { return _data; }
+		iterator end() { return _data + _size; }
+		const_iterator begin() const { return _data; }
+		const_iterator end() const { return _data + _size; }
+
+		size_t size() const { return _size; }
+		bool empty() const { return _size == 0; }
+
+		ASTNode*& operator[](size_t i) { return _data[i]; }
+		ASTNode* operator[](size_t i) const { return _data[i]; }
+		ASTNode* front() const { return _data[0]; }
+		ASTNode* back() const { return _data[_size - 1]; }
+
+		void push_back(ASTNode* node);
+		void reserve(uint32_t capacity);
+		iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+		iterator erase(const_iterator first, const_iterator last);
+
+		ASTArena& arena() const { return *_arena; }
+
+	private:
+		ASTArena* _arena;
+		ASTNode** _data = nullptr;
+		uint32_t _size = 0;
+		uint32_t _capacity = 0;
+	};
+
+	// Nodes, their children and their strings are bump allocated from blocks
+	// owned by an arena, and are all freed at once when the arena is reset or
+	// deleted. Nodes are never destroyed individually.
+	class ASTArena
+	{
+	public:
+		ASTArena() = default;
+		~ASTArena() { reset(); }
+
+		ASTArena(const ASTArena&) = delete;
+		ASTArena& operator=(const ASTArena&) = delete;
+
+		void* allocate(size_t bytes, size_t align);
+
+		// copies str into the arena, so it needn't outlive the parse
+		ASTString copy(const char* str, size_t length);
+		ASTString copy(const char* str) { return copy(str, strlen(str)); }
+
+		template <typename... Args>
+		ASTNode* node(Args&&... args);
+
+		// keeps storage that the tree's strings point into, such as a mapped
+		// module, until the arena is reset
+		void retain(std::shared_ptr<const void> storage) { _retained.push_back(std::move(storage)); }
+
+		// frees every node, child list and string allocated from the arena
+		void reset();
+
+		size_t blocks() const { return _blocks.size(); }
+		size_t bytesUsed() const { return _used; }
+
+		// a kTokenProgram node in an arena of its own, freed by releaseRoot
+		static ASTNode* createRoot();
+		static void releaseRoot(ASTNode* root);
+
+	private:
+		static const size_t kBlockSize = 64 * 1024;
+
+		std::vector<char*> _blocks;
+		std::vector<std::shared_ptr<const void>> _retained;
+		char* _next = nullptr;
+		char* _end = nullptr;
+		size_t _used = 0;
+	};
 	
 	class ASTNode
 	{
@@ -22,27 +153,27 @@ namespace Landru
         
         enum UseMask { kNone, kInt, kFloat, kFloat2, kStr, kStr2 };
         
-		ASTNode(TokenId token) : token(token), useMask(kNone)
+		// nodes are made by ASTArena::node, and live as long as their arena
+		ASTNode(ASTArena& arena, TokenId token) : token(token), useMask(kNone), children(arena)
 		{
 		}
-		ASTNode(TokenId token, int i) : token(token), intVal(i), useMask(kInt)
+		ASTNode(ASTArena& arena, TokenId token, int i) : token(token), useMask(kInt), intVal(i), children(arena)
 		{
 		}
-		ASTNode(TokenId token, float f) : token(token), floatVal1(f), useMask(kFloat)
+		ASTNode(ASTArena& arena, TokenId token, float f) : token(token), useMask(kFloat), floatVal1(f), children(arena)
 		{
 		}
-		ASTNode(TokenId token, float f1, float f2) : token(token), floatVal1(f1), floatVal2(f2), useMask(kFloat2)
+		ASTNode(ASTArena& arena, TokenId token, float f1, float f2) : token(token), useMask(kFloat2), floatVal1(f1), floatVal2(f2), children(arena)
 		{
 		}
-		ASTNode(TokenId token, const char* str2) : token(token), str2(str2), useMask(kStr)
+		ASTNode(ASTArena& arena, TokenId token, const char* str2) : token(token), useMask(kStr), str2(arena.copy(str2)), children(arena)
 		{
 		}
-		ASTNode(TokenId token, const char* str1, const char* str2) : token(token), str1(str1), str2(str2), useMask(kStr2)
+		ASTNode(ASTArena& arena, TokenId token, const char* str1, const char* str2)
+		: token(token), useMask(kStr2), str1(arena.copy(str1)), str2(arena.copy(str2)), children(arena)
 		{
 		}
-        
-		~ASTNode();
-		
+
 		void addChild(ASTNode* ast)
 		{
 			children.push_back(ast);
@@ -51,6 +182,11 @@ namespace Landru
 		//void compile(AssemblerBase& a);
         
         std::string toJson() const;
+
+		// a hash of the node and its descendants, excluding line numbers, so
+		// that a machine whose text hasn't changed hashes the same wherever
+		// it is in the file
+		uint64_t contentHash() const;
 		
 		void dump(int tabs=0) const;
 		void print(int tabs=0) const;
@@ -58,16 +194,17 @@ namespace Landru
 
 		TokenId					token;
         UseMask                 useMask;
-		std::string				str1;
-		std::string				str2;
+		ASTString				str1;
+		ASTString				str2;
 		float					floatVal1;
 		float					floatVal2;
 		int						intVal;
-		std::vector<ASTNode*>	children;
+		int						line = 0;	// source line of the statement, 0 if unknown
+		ASTChildren				children;
         
         
 	protected:
-		static int inParamList;
+		static thread_local int inParamList;
 		
 		void printParameters(int tabs = 0) const;
 		void printQualifier() const;
@@ -75,6 +212,12 @@ namespace Landru
 		void printStatements(int tabs) const;
 		void printChildStatements(int tabs) const;
 	};
+
+	template <typename... Args>
+	ASTNode* ASTArena::node(Args&&... args)
+	{
+		return new (allocate(sizeof(ASTNode), alignof(ASTNode))) ASTNode(*this, std::forward<Args>(args)...);
+	}
 	
 } // Landru
 
@@ -15,7 +15,6 @@
 #include <string.h>
 #include <stdio.h>
 #include <vector>
-#include <string>
 
 // operators
 // precedence   operators       associativity
@@ -84,13 +83,14 @@ unsigned int op_arg_count(const char c)
 #define SCOPE_OPEN_TOKEN '('
 #define SCOPE_CLOSE_TOKEN ')'
 
-bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& outposVec, bool stopOnOuterParen)
+bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<ExpressionToken>& outposVec,
+                   std::vector<ExpressionToken>& stackVec, bool stopOnOuterParen)
 {    
     char     sc;          // used to record stack element
     
-    std::vector<std::string> stackVec;
+    stackVec.clear();
     if (stopOnOuterParen)
-        stackVec.push_back("#");
+        stackVec.push_back({ "#", 0, true });   // opens the outermost parameters, as a function's name would
     bool expectOperator = false;
     size_t stackStopSize = stopOnOuterParen ? 1 : 0;
     
@@ -102,9 +102,7 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
         if(!expectOperator && peekIsLiteral(strpos, strend))  {
             const char* startpos = strpos;
             int literalLen = literalLength(strpos, strend);
-            std::string s;
-            s.assign(startpos, literalLen);
-            outposVec.push_back(s);
+            outposVec.push_back({ startpos, static_cast<uint32_t>(literalLen), false });
             --strpos; // anticipate the increment
             expectOperator = true;
             // expectOperator is used to force x-3 becomes x 3 - instead of x -3
@@ -112,19 +110,18 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
         }
         // If the token is a function token, variable, or variable reference, then push it onto the stack.
         else if(is_function(c) || c == '@')   {
-			std::string s;
+            const char* startpos = strpos;
 			if (c == '@')
 				++strpos;
 
-            const char* startpos = strpos;
             Landru::getNameSpacedToken(strpos, strend);
-            s.assign(startpos, strpos - startpos);
-			if (c == '@')
-				s = "@" + s;
+            ExpressionToken s = { startpos, static_cast<uint32_t>(strpos - startpos), false };
 
             strpos = tsSkipCommentsAndWhitespace(strpos, strend);
-            if (is_scope_open(*strpos))
-                stackVec.push_back(s+"#");  // if a function push it on the stack
+            if (is_scope_open(*strpos)) {
+                s.function = true;
+                stackVec.push_back(s);  // if a function push it on the stack
+            }
             else
                 outposVec.push_back(s); // otherwise, it's a variable, push it on the output queue
             --strpos; // anticipate the increment
@@ -134,7 +131,7 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
         else if(c == ',')   {
             bool pe = false;
             while (stackVec.size() > 0)   {
-                sc = stackVec.back()[0];
+                sc = stackVec.back().str[0];
                 if (is_scope_open(sc))  {
                     pe = true;
                     break;
@@ -157,7 +154,7 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
         // If the token is an operator, op1, then:
         else if(is_operator(c))  {
             while(stackVec.size() > 0)    {
-                sc = stackVec.back()[0];
+                sc = stackVec.back().str[0];
                 // While there is an operator token, op2, at the top of the stack
                 // op1 is left-associative and its precedence is less than or equal to that of op2,
                 // or op1 has precedence less than that of op2,
@@ -177,9 +174,7 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
                 }
             }
             // push op1 onto the stack.
-            std::string s;
-            s = c;
-            stackVec.push_back(s);
+            stackVec.push_back({ strpos, 1, false });
             expectOperator = false;
         }
         // If the token is a left parenthesis, then push it onto the stack.
@@ -187,13 +182,13 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
             expectOperator = false;
             char test = '\0';
             if (stackVec.size() > 0)
-                test = *stackVec.back().rbegin() == '#';
+                test = stackVec.back().function;
             if (test) {
-                stackVec.push_back("(");
-                outposVec.push_back("("); /// @Lab push a mark to indicate the limit of the parameter scope
+                stackVec.push_back({ "(", 1, false });
+                outposVec.push_back({ "(", 1, false }); /// @Lab push a mark to indicate the limit of the parameter scope
             }
             else
-                stackVec.push_back("{");
+                stackVec.push_back({ "{", 1, false });
         }
         // If the token is a right parenthesis or brace:
         else if (is_scope_close(c)) {
@@ -202,10 +197,10 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
             // Until the token at the top of the stack is a left parenthesis,
             // pop operators off the stack onto the output queue
             while(stackVec.size() > stackStopSize) {
-                sc = stackVec.back()[0];
+                sc = stackVec.back().str[0];
                 if (is_scope_close(c) && is_scope_open(sc)) {
                     pe = true;
-                    outposVec.push_back(")"); /// @Lab push a mark to indicate the other end of the parameter scope
+                    outposVec.push_back({ ")", 1, false }); /// @Lab push a mark to indicate the other end of the parameter scope
                     break;
                 }
                 else if (is_scope_close(c) && sc == '{') {
@@ -227,7 +222,7 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
             
             // If the token at the top of the stack is a function token, pop it onto the output queue.
             if (stackVec.size() > stackStopSize) {
-                sc = stackVec.back()[0];
+                sc = stackVec.back().str[0];
                 if (is_function(sc))   {
                     outposVec.push_back(stackVec.back());
                     stackVec.pop_back();
@@ -241,9 +236,7 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
             uint32_t length;
             const char* value;
             strpos = tsGetString(strpos, strend, true, &value, &length);
-            std::string s;
-            s.assign(value, length);
-            outposVec.push_back(s);
+            outposVec.push_back({ value, length, false });
             --strpos;   // because an increment follows
         }
         else  {
@@ -256,7 +249,7 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
     // When there are no more tokens to read:
     // While there are still operator tokens in the stack:
     while(stackVec.size() > stackStopSize)  {
-        sc = stackVec.back()[0];
+        sc = stackVec.back().str[0];
         if(sc == '(' || sc == ')')   {
             printf("Error: parentheses mismatched\n");
             return false;
@@ -268,9 +261,10 @@ bool shunting_yard(CurrPtr& strpos, EndPtr strend, std::vector<std::string>& out
 }
 
 
-int parseExpression(CurrPtr& curr, EndPtr end, std::vector<std::string>& outposVec)
+int parseExpression(CurrPtr& curr, EndPtr end, std::vector<ExpressionToken>& outposVec,
+                    std::vector<ExpressionToken>& stackVec)
 {
-    bool result = shunting_yard(curr, end, outposVec, true);
+    bool result = shunting_yard(curr, end, outposVec, stackVec, true);
     if (!result)
         printf("\nInvalid input\n");
     return 0;
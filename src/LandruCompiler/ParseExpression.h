@@ -5,7 +5,20 @@
 #pragma once
 
 #include "LandruCompiler/Parser.h"
+#include <cstdint>
 #include <vector>
-#include <string>
 
-int parseExpression(CurrPtr& curr, EndPtr end, std::vector<std::string>& outposVec);
+// A token of an expression, referring to the program's text rather than a
+// copy of it. A function name is marked rather than suffixed with '#'.
+struct ExpressionToken
+{
+    char const* str;
+    uint32_t length;
+    bool function;
+};
+
+// Appends the tokens of the expression at curr to outposVec in reverse
+// polish order. stackVec is scratch space for operators, so that it and
+// outposVec may be reused from one expression to the next.
+int parseExpression(CurrPtr& curr, EndPtr end, std::vector<ExpressionToken>& outposVec,
+                    std::vector<ExpressionToken>& stackVec);
@@ -9,36 +9,43 @@
 #include "LandruCompiler/lcRaiseError.h"
 #include "LandruCompiler/Parser.h"
 #include "LandruCompiler/ParseExpression.h"
+#include "LandruCompiler/ParserContext.h"
 #include "LandruCompiler/Tokens.h"
 
 #ifdef LANDRU_HAVE_JSON
 #include "LabJson/json.h"
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <thread>
+#include <vector>
 
 using namespace Landru;
 
 
-void parseAssignment(CurrPtr& curr, EndPtr end);
-void parseLandruBlock(CurrPtr&, EndPtr);
+void parseAssignment(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
+void parseLandruBlock(CurrPtr&, EndPtr, ASTNode *& currNode);
 void parseLandruVarDeclaration(CurrPtr&, EndPtr, ASTNode *& currNode);
-void parseElse(CurrPtr& curr, EndPtr end);
-void parseFor(CurrPtr& curr, EndPtr end);
+void parseElse(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
+void parseFor(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
 void parseGlobalVarDecls(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
-void parseGoto(CurrPtr& curr, EndPtr end);
-void parseStatement(CurrPtr& curr, EndPtr end);
-void parseParamList(CurrPtr& curr, EndPtr end);
-void parseParam(CurrPtr& curr, EndPtr end);
+void parseGoto(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
+void parseStatement(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
+void parseParamList(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
+void parseParam(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
 void parseStatements(CurrPtr&, EndPtr, ASTNode *& currNode);
-void parseConditional(CurrPtr& curr, EndPtr end);
+void parseConditional(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
 void parseState(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
 void parseDeclare(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
 void parseLocals(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
 void parseMachine(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
-void parseOn(CurrPtr& curr, EndPtr end);
-void parseFunction(CurrPtr& curr, EndPtr end, TokenId);
+void parseOn(CurrPtr& curr, EndPtr end, ASTNode *& currNode);
+void parseFunction(CurrPtr& curr, EndPtr end, ASTNode *& currNode, TokenId);
 bool peekIsLiteral(CurrPtr& curr, EndPtr end);
 void parseLiteral(CurrPtr& curr, EndPtr end, ASTNode *& currNode, TokenId conversionType);
 
@@ -46,18 +53,20 @@ void parseLiteral(CurrPtr& curr, EndPtr end, ASTNode *& currNode, TokenId conver
 namespace Landru {
 
     static const char kTerminalChar = ';';
+    thread_local ParserContext* currentContext = nullptr;
     TokenId tokenize(const char* str, size_t length);
 
 	struct Token
 	{
 		TokenId token;
 		const char* name;
+		uint32_t length;
 	};
 
 #ifdef TOKEN_DECL
 #undef TOKEN_DECL
 #endif
-#define TOKEN_DECL(a, b) kToken##a, b,
+#define TOKEN_DECL(a, b) { kToken##a, b, sizeof(b) - 1 },
 
 	Token tokens[] =
 	{
@@ -66,16 +75,29 @@ namespace Landru {
 
 #undef TOKEN_DECL
 
-	TokenId tokenize(const char* str, size_t length)
+	// the tokens by length, so that a lexeme is only compared against the
+	// few names of its own length
+	struct TokensByLength
 	{
-		for (int i = 0; i < sizeof(tokens)/sizeof(Token); ++i)
+		static const uint32_t kMaxLength = 31;
+		std::vector<const Token*> tokens[kMaxLength + 1];
+
+		TokensByLength()
 		{
-            size_t l = strlen(tokens[i].name);
-            if (l != length)
-                continue;
-			if (!strncmp(str, tokens[i].name, length))
-				return tokens[i].token;
+			for (const Token& t : Landru::tokens)
+				if (t.length <= kMaxLength)
+					tokens[t.length].push_back(&t);
 		}
+	};
+
+	TokenId tokenize(const char* str, size_t length)
+	{
+		static const TokensByLength byLength;
+		if (!length || length > TokensByLength::kMaxLength)
+			return kTokenUnknown;
+		for (const Token* t : byLength.tokens[length])
+			if (t->name[0] == str[0] && !memcmp(str, t->name, length))
+				return t->token;
 		return kTokenUnknown;
 	}
 
@@ -108,7 +130,31 @@ namespace Landru {
         return ret;
     }
 
+    TokenId lexToken(CurrPtr& curr, EndPtr end);
+
     TokenId getToken(CurrPtr& curr, EndPtr end)
+    {
+        ParserContext* context = ParserContext::current();
+        if (!context)
+            return lexToken(curr, end);
+
+        ParserContext::LexCache& lexCache = context->lexCache;
+        if (curr == lexCache.at && end == lexCache.programEnd) {
+            curr = lexCache.next;
+            return lexCache.token;
+        }
+
+        char const* at = curr;
+        TokenId tokenId = lexToken(curr, end);
+        if (end == lexCache.programEnd && at >= lexCache.programStart && at < end && !lcCurrentError()) {
+            lexCache.at = at;
+            lexCache.next = curr;
+            lexCache.token = tokenId;
+        }
+        return tokenId;
+    }
+
+    TokenId lexToken(CurrPtr& curr, EndPtr end)
     {
         more(curr, end);
         TokenId tokenId = kTokenUnknown;
@@ -219,8 +265,35 @@ namespace Landru {
         return token;
     }
 
-    /// @TODO - this kills thread safety. It should be passed through the parser as part of a parse context object
-    ASTNode* currNode = 0;
+    int lineAt(char const* p)
+    {
+        ParserContext::LineCursor& lineCursor = ParserContext::current()->lineCursor;
+        if (p < lineCursor.pos) {
+            lineCursor.pos = lineCursor.start;
+            lineCursor.line = 1;
+        }
+        for (; lineCursor.pos < p; ++lineCursor.pos)
+            if (*lineCursor.pos == '\n')
+                ++lineCursor.line;
+        return lineCursor.line;
+    }
+
+    // nested statements have already been stamped with their own lines
+    void stampLine(ASTNode* node, int line)
+    {
+        if (node->line)
+            return;
+        node->line = line;
+        for (auto child : node->children)
+            stampLine(child, line);
+    }
+
+    // nodes are allocated from the arena of the tree being parsed
+    template <typename... Args>
+    ASTNode* makeNode(Args&&... args)
+    {
+        return currentContext->arena->node(std::forward<Args>(args)...);
+    }
 } // Landru
 
 
@@ -336,7 +409,7 @@ void parseLocals(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	if (!getColon(curr, end))
 		return;
 
-	ASTNode* ast = new ASTNode(kTokenLocalVariable, "");
+	ASTNode* ast = makeNode(kTokenLocalVariable, "");
 	currNode->addChild(ast);
 	ASTNode* pop = currNode;
 	currNode = ast;
@@ -373,7 +446,7 @@ void parseDeclare(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 	if (!getColon(curr, end))
 		return;
 
-	ASTNode* ast = new ASTNode(kTokenDeclare, "");
+	ASTNode* ast = makeNode(kTokenDeclare, "");
 	currNode->addChild(ast);
 	ASTNode* pop = currNode;
 	currNode = ast;
@@ -434,7 +507,7 @@ void parseLandruVarDeclaration(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 	else if (paramToken)
 		token = kTokenParam;
 
-	ASTNode * variableNode = new ASTNode(token, varType, name);
+	ASTNode * variableNode = makeNode(token, varType, name);
 	currNode->addChild(variableNode);
 
 	token = peekToken(curr, end);
@@ -442,9 +515,9 @@ void parseLandruVarDeclaration(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 		getToken(curr, end); // consume assignment operator
 		ASTNode * pop = currNode;
 		if (sharedToken)
-			currNode = new ASTNode(kTokenInitialAssignment, name);
+			currNode = makeNode(kTokenInitialAssignment, name);
 		else
-			currNode = new ASTNode(kTokenAssignment, name);
+			currNode = makeNode(kTokenAssignment, name);
 		variableNode->addChild(currNode);
 		parseLiteral(curr, end, currNode, declaredType); // and put the assigned value in the tree
 		currNode = pop;
@@ -470,6 +543,8 @@ void parseLandruVarDeclaration(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 
 void parseState(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 {
+	more(curr, end);
+	int line = lineAt(curr);
 	if (getToken(curr, end) != kTokenState)
 	{
 		lcRaiseError("Expected 'state'", curr, 32);
@@ -482,7 +557,8 @@ void parseState(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 		return;
 
 	ASTNode* pop = currNode;
-	ASTNode* ast = new ASTNode(kTokenState, name);
+	ASTNode* ast = makeNode(kTokenState, name);
+	ast->line = line;
 	currNode->addChild(ast);
 	currNode = ast;
 
@@ -500,7 +576,7 @@ void parseState(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 void parseStatements(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 {
 	ASTNode* pop = currNode;
-	ASTNode* ast = new ASTNode(kTokenStatements);
+	ASTNode* ast = makeNode(kTokenStatements);
 	pop->addChild(ast);
 	currNode = ast;
 
@@ -511,7 +587,7 @@ void parseStatements(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 			break;
 		}
 
-		parseStatement(curr, end);
+		parseStatement(curr, end, currNode);
 	}
 	currNode = pop;
 }
@@ -527,8 +603,13 @@ void parseStatements(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 	 ;
  */
 
-void parseStatement(CurrPtr& curr, EndPtr end)
+void parseStatement(CurrPtr& curr, EndPtr end, ASTNode *& currNode)
 {
+	more(curr, end);
+	int line = lineAt(curr);
+	ASTNode* parent = currNode;
+	size_t first = parent->children.size();
+
 	TokenId token = peekToken(curr, end);
 	switch (token) {
         case kTokenDeclare:
@@ -542,48 +623,51 @@ void parseStatement(CurrPtr& curr, EndPtr end)
 
 			if (peekChar(curr, end) == '=') {
 				curr = orig;
-				parseAssignment(curr, end);
+				parseAssignment(curr, end, currNode);
 			}
 			else {
 				curr = orig;
-				parseFunction(curr, end, kTokenFunction);
+				parseFunction(curr, end, currNode, kTokenFunction);
 			} }
             break;
 
 		case kTokenTrue: {
-			currNode->addChild(new ASTNode(kTokenTrue));
+			currNode->addChild(makeNode(kTokenTrue));
 			getToken(curr, end); }
             break;
 
 		case kTokenFalse: {
-			currNode->addChild(new ASTNode(kTokenFalse));
+			currNode->addChild(makeNode(kTokenFalse));
 			getToken(curr, end); }
             break;
 
 		case kTokenGoto:
-			parseGoto(curr, end);
+			parseGoto(curr, end, currNode);
 			break;
 
 		case kTokenOn:
-			parseOn(curr, end);
+			parseOn(curr, end, currNode);
 			break;
 
         case kTokenFor:
-            parseFor(curr, end);
+            parseFor(curr, end, currNode);
             break;
 
 		case kTokenIf:
-			parseConditional(curr, end);
+			parseConditional(curr, end, currNode);
 			break;
 
 		case kTokenLaunch:
-            parseFunction(curr, end, kTokenLaunch);
+            parseFunction(curr, end, currNode, kTokenLaunch);
 			break;
 
         default:
             lcRaiseError("Expected token", curr, 32);
             break;
 	}
+
+	for (size_t i = first; i < parent->children.size(); ++i)
+		stampLine(parent->children[i], line);
 }
 
 /*
@@ -593,11 +677,11 @@ lGoto	:
 	;
 */
 
-void parseGoto(CurrPtr& curr, EndPtr end) {
+void parseGoto(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	getToken(curr, end);	// goto
 	char buff[256];
 	getDeclarator(curr, end, buff);
-	currNode->addChild(new ASTNode(kTokenGoto, buff));
+	currNode->addChild(makeNode(kTokenGoto, buff));
 }
 
 
@@ -608,11 +692,11 @@ void parseGoto(CurrPtr& curr, EndPtr end) {
 	;
  */
 
-void parseAssignment(CurrPtr& curr, EndPtr end) {
+void parseAssignment(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	char buff[256];
 	getNameSpacedDeclarator(curr, end, buff);
 
-	ASTNode* ast = new ASTNode(kTokenAssignment, buff);
+	ASTNode* ast = makeNode(kTokenAssignment, buff);
 	currNode->addChild(ast);
 	ASTNode* pop = currNode;
 	currNode = ast;
@@ -624,7 +708,7 @@ void parseAssignment(CurrPtr& curr, EndPtr end) {
 	}
 
 	// fetch right hand side
-	parseParam(curr, end);
+	parseParam(curr, end, currNode);
 
 	currNode = pop;
 }
@@ -640,7 +724,7 @@ lConditional
 	;
 */
 
-void parseConditional(CurrPtr& curr, EndPtr end) {
+void parseConditional(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	TokenId tokenId = getToken(curr, end);
 	if (tokenId != kTokenIf) {
 		lcRaiseError("Expected 'if'", curr, 32);
@@ -654,16 +738,16 @@ void parseConditional(CurrPtr& curr, EndPtr end) {
         tokenId = getToken(curr, end);
 
 	ASTNode* pop = currNode;
-	ASTNode* astIf = new ASTNode(kTokenIf);
+	ASTNode* astIf = makeNode(kTokenIf);
 	currNode->addChild(astIf);
-	ASTNode* astQualifier = new ASTNode(tokenId);
+	ASTNode* astQualifier = makeNode(tokenId);
 	astIf->addChild(astQualifier);
-	ASTNode* astParams = new ASTNode(kTokenParameters);
+	ASTNode* astParams = makeNode(kTokenParameters);
 	astQualifier->addChild(astParams);
 	currNode = astParams;
 
 	if (peekChar(curr, end) == '(')
-		parseParamList(curr, end);
+		parseParamList(curr, end, currNode);
 
 	currNode = astIf;
 
@@ -675,7 +759,7 @@ void parseConditional(CurrPtr& curr, EndPtr end) {
 
 	tokenId = peekToken(curr, end);
 	if (tokenId == kTokenElse)
-		parseElse(curr, end);
+		parseElse(curr, end, currNode);
 
 	currNode = pop;
 }
@@ -688,14 +772,14 @@ lElse
 	;
  */
 
-void parseElse(CurrPtr& curr, EndPtr end) {
+void parseElse(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	getToken(curr, end);	// consume else
 
 	if (!getColon(curr, end))
 		return;
 
 	ASTNode* pop = currNode;
-	currNode = new ASTNode(kTokenElse);
+	currNode = makeNode(kTokenElse);
 	pop->addChild(currNode);
 
 	parseStatements(curr, end, currNode);
@@ -714,7 +798,7 @@ void parseElse(CurrPtr& curr, EndPtr end) {
  ;
  */
 
-void parseFor(CurrPtr& curr, EndPtr end) {
+void parseFor(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	TokenId tokenId = getToken(curr, end); // consume for
     if (tokenId != kTokenFor) {
         lcRaiseError("Expected 'for'", "parseFor", 0);
@@ -735,7 +819,7 @@ void parseFor(CurrPtr& curr, EndPtr end) {
 	}
 
     ASTNode* pop = currNode;
-	ASTNode* forNode = new ASTNode(kTokenFor, name);
+	ASTNode* forNode = makeNode(kTokenFor, name);
 	currNode->addChild(forNode);
 	currNode = forNode;
 
@@ -744,7 +828,7 @@ void parseFor(CurrPtr& curr, EndPtr end) {
         lcRaiseError("Expected 'in'", "parseFor", 0);
     }
 
-    parseFunction(curr, end, kTokenFunction);
+    parseFunction(curr, end, currNode, kTokenFunction);
 
 	if (!getColon(curr, end)) {
         lcRaiseError("Expected ':'", "parseFor", 0);
@@ -772,7 +856,7 @@ void parseFor(CurrPtr& curr, EndPtr end) {
 	;
  */
 
-void parseOn(CurrPtr& curr, EndPtr end) {
+void parseOn(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	getToken(curr, end); // consume on
 
 	char name[256];
@@ -791,16 +875,16 @@ void parseOn(CurrPtr& curr, EndPtr end) {
 	}
 
     ASTNode* pop = currNode;
-	ASTNode* onNode = new ASTNode(kTokenOn);
+	ASTNode* onNode = makeNode(kTokenOn);
 	currNode->addChild(onNode);
 	currNode = onNode;
-	ASTNode* eventNode = new ASTNode(what, name);
+	ASTNode* eventNode = makeNode(what, name);
 	onNode->addChild(eventNode);
 	currNode = eventNode;				// curr is now the qualifier, eg. message
 
     more(curr, end);
     if (peekChar(curr, end) == '(')
-        parseParamList(curr, end);
+        parseParamList(curr, end, currNode);
 
 	currNode = onNode;
 
@@ -821,15 +905,15 @@ void parseOn(CurrPtr& curr, EndPtr end) {
  functions can be chained with '.' ie foo().bar().baz()
  */
 
-void parseFunction(CurrPtr& curr, EndPtr end, TokenId token) {
+void parseFunction(CurrPtr& curr, EndPtr end, ASTNode *& currNode, TokenId token) {
 	char buff[256];
 	getNameSpacedDeclarator(curr, end, buff);   // get function name
 
 	ASTNode* pop = currNode;
-	currNode = new ASTNode(token, buff);
+	currNode = makeNode(token, buff);
 	pop->addChild(currNode);
 
-    parseParamList(curr, end);
+    parseParamList(curr, end, currNode);
     currNode = pop;
 
     more(curr, end);
@@ -837,8 +921,8 @@ void parseFunction(CurrPtr& curr, EndPtr end, TokenId token) {
         // chained functions assume that the previous function left something on the stack
         // which can have a function invoked on it.
         ++curr;
-        currNode->addChild(new ASTNode(kTokenDotChain, buff));
-        parseFunction(curr, end, kTokenFunction);
+        currNode->addChild(makeNode(kTokenDotChain, buff));
+        parseFunction(curr, end, currNode, kTokenFunction);
     }
 }
 
@@ -850,15 +934,18 @@ void parseFunction(CurrPtr& curr, EndPtr end, TokenId token) {
  -> ^(TokenParams lParam*) ;
  */
 
-void parseParamList(CurrPtr& curr, EndPtr end) {
+void parseParamList(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	// if parsing a function, then an opening paren must have been encountered
 	if (peekChar(curr, end) != '(') {
 		lcRaiseError("Expecting a parameter list, no opening parenthesis found", curr, 32);
 		return;
 	}
 
-    std::vector<std::string> paramList;
-    parseExpression(curr, end, paramList);
+    // the context's scratch space is reused, as expressions don't nest
+    ParserContext::Expression& scratch = currentContext->expression;
+    std::vector<ExpressionToken>& paramList = scratch.tokens;
+    paramList.clear();
+    parseExpression(curr, end, paramList, scratch.operators);
 
     // closing paren
     if (peekChar(curr, end) == ')')
@@ -868,30 +955,30 @@ void parseParamList(CurrPtr& curr, EndPtr end) {
 
     ASTNode* popNode = currNode;
 
-    std::vector<ASTNode*> nodeStack; // this is where the things that get parameters go
+    std::vector<ASTNode*>& nodeStack = scratch.nodes; // this is where the things that get parameters go
+    nodeStack.clear();
 
     ASTNode* paramNode = 0;
     for (auto i = paramList.begin(); i != paramList.end(); ++i) {
-        const std::string& s = *i;
+        std::string& s = scratch.token;
+        s.assign(i->str, i->length);
         const char* strstart = s.c_str();
         const char* strend = strstart + s.size();
 
         if (s == "(") {
             nodeStack.push_back(currNode);
-            currNode = new ASTNode(kTokenParameters);
+            currNode = makeNode(kTokenParameters);
         }
         else if (s == ")") {
             paramNode = currNode;
             currNode = nodeStack.back();
             nodeStack.pop_back();
         }
-        else if (*(strend - 1) == '#') {
+        else if (i->function) {
             if (!paramNode)
                 lcRaiseError("Missing parameters for function", curr, 32);
 
-            std::string funcName;
-            funcName = s.substr(0, s.size() - 1);
-            ASTNode* functionNode = new ASTNode(kTokenFunction, funcName.c_str());
+            ASTNode* functionNode = makeNode(kTokenFunction, strstart);
             functionNode->addChild(paramNode);
             paramNode = 0;
             currNode->addChild(functionNode);
@@ -899,27 +986,27 @@ void parseParamList(CurrPtr& curr, EndPtr end) {
         else if (peekIsLiteral(strstart, strend))
             parseLiteral(strstart, strend, currNode, kTokenNullLiteral);
         else if (s == "*")
-            currNode->addChild(new ASTNode(kTokenOpMultiply));
+            currNode->addChild(makeNode(kTokenOpMultiply));
         else if (s == "+")
-            currNode->addChild(new ASTNode(kTokenOpAdd));
+            currNode->addChild(makeNode(kTokenOpAdd));
         else if (s == "/")
-            currNode->addChild(new ASTNode(kTokenOpDivide));
+            currNode->addChild(makeNode(kTokenOpDivide));
         else if (s == "-")
-            currNode->addChild(new ASTNode(kTokenOpSubtract));
+            currNode->addChild(makeNode(kTokenOpSubtract));
         else if (s == "!")
-            currNode->addChild(new ASTNode(kTokenOpNegate));
+            currNode->addChild(makeNode(kTokenOpNegate));
         else if (s == "%")
-            currNode->addChild(new ASTNode(kTokenOpModulus));
+            currNode->addChild(makeNode(kTokenOpModulus));
         else if (s == ">")
-            currNode->addChild(new ASTNode(kTokenOpGreaterThan));
+            currNode->addChild(makeNode(kTokenOpGreaterThan));
         else if (s == "<")
-            currNode->addChild(new ASTNode(kTokenOpLessThan));
+            currNode->addChild(makeNode(kTokenOpLessThan));
         //else if (s == "=")
         //    pushAssign();
         else if (s[0] == '@')
-			currNode->addChild(new ASTNode(kTokenGetVariableReference, strstart+1));
+			currNode->addChild(makeNode(kTokenGetVariableReference, strstart+1));
 		else
-            currNode->addChild(new ASTNode(kTokenGetVariable, strstart));
+            currNode->addChild(makeNode(kTokenGetVariable, strstart));
     }
     if (!nodeStack.empty() || !paramNode)
         lcRaiseError("Unmatched parenthesis in expression", curr, 32);
@@ -942,7 +1029,7 @@ void parseParamList(CurrPtr& curr, EndPtr end) {
 	;
  */
 
-void parseParam(CurrPtr& curr, EndPtr end) {
+void parseParam(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	if (peekChar(curr, end) == ')')
 		return;
 
@@ -960,15 +1047,15 @@ void parseParam(CurrPtr& curr, EndPtr end) {
 
 	if (peekChar(curr, end) == '(') {
 		ASTNode* pop = currNode;
-		currNode = new ASTNode(kTokenFunction, buff);
+		currNode = makeNode(kTokenFunction, buff);
 		pop->addChild(currNode);
-		parseParamList(curr, end);
+		parseParamList(curr, end, currNode);
 		currNode = pop;
 	}
 	else if (peekChar(curr, end) == '@')
-		currNode->addChild(new ASTNode(kTokenGetVariableReference, buff+1));
+		currNode->addChild(makeNode(kTokenGetVariableReference, buff+1));
 	else
-		currNode->addChild(new ASTNode(kTokenGetVariable, buff));
+		currNode->addChild(makeNode(kTokenGetVariable, buff));
 
 	more(curr, end);
 }
@@ -1067,15 +1154,15 @@ void parseLiteral(CurrPtr& curr, EndPtr end, ASTNode*& currNode, TokenId convers
 		curr = tsGetString(curr, end, true, &tokenStr, &length);
 		strncpy(buff, tokenStr, length);
 		buff[length] = '\0';
-		currNode->addChild(new ASTNode(kTokenStringLiteral, buff));
+		currNode->addChild(makeNode(kTokenStringLiteral, buff));
 	}
 	else if (numeric) {
 		float floatVal;
 		curr = tsGetFloat(curr, end, &floatVal);
 		if (conversionType == kTokenIntLiteral)
-			currNode->addChild(new ASTNode(kTokenIntLiteral, (int)floatVal));
+			currNode->addChild(makeNode(kTokenIntLiteral, (int)floatVal));
 		else
-			currNode->addChild(new ASTNode(kTokenFloatLiteral, floatVal));
+			currNode->addChild(makeNode(kTokenFloatLiteral, floatVal));
 	}
 	else if (rangedRandom) {
 		float floatVal;
@@ -1093,20 +1180,20 @@ void parseLiteral(CurrPtr& curr, EndPtr end, ASTNode*& currNode, TokenId convers
 			lcRaiseError("Syntax Error", curr, 32);
 		getChar(curr, end); // consume '>'
 
-		currNode->addChild(new ASTNode(kTokenRangedLiteral, floatVal, maxFloatVal));
+		currNode->addChild(makeNode(kTokenRangedLiteral, floatVal, maxFloatVal));
 	}
 	else if (hex) {
 		unsigned int hexVal = 0;
 		getChar(curr, end); // consume '#'
 		curr = tsGetHex(curr, end, &hexVal);
-		currNode->addChild(new ASTNode(kTokenIntLiteral, (int) hexVal));
+		currNode->addChild(makeNode(kTokenIntLiteral, (int) hexVal));
 	}
 	else {
 		TokenId token = getToken(curr, end);
 		if (token == kTokenFalse)
-			currNode->addChild(new ASTNode(kTokenFalse));
+			currNode->addChild(makeNode(kTokenFalse));
 		else if (token == kTokenTrue)
-			currNode->addChild(new ASTNode(kTokenTrue));
+			currNode->addChild(makeNode(kTokenTrue));
 		else
 			lcRaiseError("Syntax Error", curr, 32);
 	}
@@ -1117,9 +1204,11 @@ void parseLiteral(CurrPtr& curr, EndPtr end, ASTNode*& currNode, TokenId convers
 
 class JSONCallback : public Lab::Json::Callback {
 public:
+    explicit JSONCallback(ASTNode*& currNode) : currNode(currNode) {}
+
     virtual void startArray() {
         nodestack.push_back(currNode);
-        ASTNode* newNode = new ASTNode(kTokenDataArray);
+        ASTNode* newNode = makeNode(kTokenDataArray);
         currNode->addChild(newNode);
         currNode = newNode;
     }
@@ -1133,7 +1222,7 @@ public:
     virtual void startObject()
     {
         nodestack.push_back(currNode);
-        ASTNode* newNode = new ASTNode(kTokenDataObject);
+        ASTNode* newNode = makeNode(kTokenDataObject);
         currNode->addChild(newNode);
         currNode = newNode;
     }
@@ -1144,7 +1233,7 @@ public:
         char temp[256];
         strncpy(temp, name, len);
         temp[len] = '\0';
-        ASTNode* newNode = new ASTNode(kTokenDataElement, temp);
+        ASTNode* newNode = makeNode(kTokenDataElement, temp);
         currNode->addChild(newNode);
         currNode = newNode;
     }
@@ -1163,12 +1252,12 @@ public:
 
     virtual void nullVal()
     {
-       currNode->addChild(new ASTNode(kTokenDataNullLiteral));
+       currNode->addChild(makeNode(kTokenDataNullLiteral));
     }
 
     virtual void boolVal(bool b)
     {
-        currNode->addChild(new ASTNode(kTokenDataIntLiteral, b ? 1 : 0));
+        currNode->addChild(makeNode(kTokenDataIntLiteral, b ? 1 : 0));
     }
 
     virtual void strVal(char const*const str, int len)
@@ -1176,12 +1265,12 @@ public:
         char temp[256];
         strncpy(temp, str, len);
         temp[len] = '\0';
-        currNode->addChild(new ASTNode(kTokenDataStringLiteral, temp));
+        currNode->addChild(makeNode(kTokenDataStringLiteral, temp));
     }
 
     virtual void floatVal(float f)
     {
-        currNode->addChild(new ASTNode(kTokenDataFloatLiteral, f));
+        currNode->addChild(makeNode(kTokenDataFloatLiteral, f));
     }
 
     virtual void raiseError(char const*const curr, int len)
@@ -1189,6 +1278,7 @@ public:
         lcRaiseError("Problem parsing JSON", curr, len);
     }
 
+    ASTNode*& currNode;
     std::vector<ASTNode*> nodestack;
 };
 
@@ -1230,7 +1320,7 @@ void parseGlobalVarDecls(CurrPtr& curr, EndPtr end, ASTNode *& currNode
         lcRaiseError("Missing = after global declaration. Eg: \nio = require(\"io\")\n", curr, 32);
     }
 
-    ASTNode* globVar = new ASTNode(kTokenGlobalVariable, name);
+    ASTNode* globVar = makeNode(kTokenGlobalVariable, name);
     currNode->addChild(globVar);
 
 #ifdef LANDRU_HAVE_JSON
@@ -1239,9 +1329,9 @@ void parseGlobalVarDecls(CurrPtr& curr, EndPtr end, ASTNode *& currNode
         const char* jsonStart = curr;
 
         // Parse a JSON block.
-        JSONCallback jsonCallback;
+        JSONCallback jsonCallback(currNode);
         ASTNode* pop = currNode;
-        currNode = new ASTNode(kTokenStaticData);
+        currNode = makeNode(kTokenStaticData);
         globVar->addChild(currNode);
         if (!Lab::Json::parseJsonValue(curr, end, &jsonCallback))
             lcRaiseError("Poorly formed JSON chunk", curr, 32);
@@ -1276,7 +1366,7 @@ void parseGlobalVarDecls(CurrPtr& curr, EndPtr end, ASTNode *& currNode
                 lcRaiseError("Poorly formed require", curr, 32);
             }
         }
-        globVar->addChild(new ASTNode(kTokenRequire, require));
+        globVar->addChild(makeNode(kTokenRequire, require));
     }
     else {
         curr = t;
@@ -1291,7 +1381,7 @@ void parseGlobalVarDecls(CurrPtr& curr, EndPtr end, ASTNode *& currNode
  : lDeclareBlock | lStateBlock ;
  */
 
-void parseLandruBlock(CurrPtr& curr, EndPtr end) {
+void parseLandruBlock(CurrPtr& curr, EndPtr end, ASTNode *& currNode) {
 	TokenId token = peekToken(curr, end);
 	switch (token) {
 		case kTokenDeclare:  parseDeclare(curr, end, currNode);          break;
@@ -1310,6 +1400,8 @@ void parseLandruBlock(CurrPtr& curr, EndPtr end) {
  */
 
 void parseMachine(CurrPtr& curr, EndPtr end, ASTNode* & currNode) {
+	more(curr, end);
+	int line = lineAt(curr);
 	TokenId token = getToken(curr, end);
 	if (token != kTokenMachine) {
 		lcRaiseError("Expected 'machine'", curr, 32);
@@ -1321,7 +1413,8 @@ void parseMachine(CurrPtr& curr, EndPtr end, ASTNode* & currNode) {
 	if (!getColon(curr, end))
 		return;
 
-	ASTNode* ast = new ASTNode(kTokenMachine, declarator);
+	ASTNode* ast = makeNode(kTokenMachine, declarator);
+	ast->line = line;
 	currNode->addChild(ast);
 	ASTNode* pop = currNode;
 	currNode = ast;
@@ -1334,7 +1427,7 @@ void parseMachine(CurrPtr& curr, EndPtr end, ASTNode* & currNode) {
 			++curr;
 			break;
 		}
-		parseLandruBlock(curr, end);
+		parseLandruBlock(curr, end, currNode);
 	}
 
 	currNode = pop;
@@ -1351,36 +1444,107 @@ void parseMachine(CurrPtr& curr, EndPtr end, ASTNode* & currNode) {
  */
 
 
+namespace Landru {
+
+    ParserContext::ParserContext(char const* buff, size_t len)
+    : _previous(currentContext)
+    {
+        lineCursor.start = lineCursor.pos = buff;
+        lexCache.programStart = buff;
+        lexCache.programEnd = buff + len;
+        currentContext = this;
+    }
+
+    ParserContext::~ParserContext()
+    {
+        currentContext = _previous;
+    }
+
+    ParserContext* ParserContext::current()
+    {
+        return currentContext;
+    }
+
+    int parseProgram(ASTNode* rootNode, char const* buff, size_t len, std::vector<std::string>& diagnostics)
+    {
+        ParserContext context(buff, len);
+        context.arena = &rootNode->children.arena();
+        ASTNode* currNode = rootNode;
+
+        char const*const end = buff + len;
+        char const* curr = buff;
+
+        while (more(curr, end)) {
+            TokenId token = peekToken(curr, end);
+            switch (token) {
+                case kTokenMachine:
+                    parseMachine(curr, end, currNode);
+                    break;
+
+                default:
+                    parseGlobalVarDecls(curr, end, currNode);
+                    break;
+            }
+        }
+
+        diagnostics.insert(diagnostics.end(), context.diagnostics.begin(), context.diagnostics.end());
+        return context.errors;
+    }
+
+} // Landru
+
 extern "C"
 int landruParseProgram(LandruNode_t* rootNode,
 //                        std::vector<std::pair<std::string, Json::Value*> >* jsonVars,
                         char const* buff, size_t len)
 {
-    #ifdef LANDRU_HAVE_JSON
-    std::vector<std::pair<std::string, Json::Value*> >* jsonVars,
-    #endif
-    currNode = (Landru::ASTNode*) rootNode;
-
-	char const*const end = buff + len;
-	char const* curr = buff;
-
-	while (more(curr, end)) {
-		TokenId token = peekToken(curr, end);
-		switch (token) {
-			case kTokenMachine:
-				parseMachine(curr, end, currNode);
-				break;
-
-			default:
-                parseGlobalVarDecls(curr, end, currNode
-#ifdef LANDRU_HAVE_JSON
-                    , jsonVars
-#endif
-                );
-				break;
-		}
-	}
-    return lcCurrentError();
+    std::vector<std::string> diagnostics;
+    int errors = Landru::parseProgram((Landru::ASTNode*) rootNode, buff, len, diagnostics);
+    for (auto & d : diagnostics)
+        printf("%s", d.c_str());
+    return errors;
+}
+
+extern "C"
+int landruParseFiles(char const*const* paths, size_t count, LandruNode_t** roots, int threads)
+{
+    if (threads <= 0)
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    threads = static_cast<int>(std::min(static_cast<size_t>(threads), std::max<size_t>(count, 1)));
+
+    // each worker takes the next file until there are none left
+    std::vector<std::vector<std::string>> diagnostics(count);
+    std::atomic<size_t> next(0);
+    std::atomic<int> failed(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            roots[i] = nullptr;
+            std::ifstream file(paths[i], std::ios::binary);
+            if (!file) {
+                diagnostics[i].push_back(std::string(paths[i]) + " not found\n");
+                ++failed;
+                continue;
+            }
+            std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            Landru::ASTNode* root = Landru::ASTArena::createRoot();
+            if (Landru::parseProgram(root, text.c_str(), text.length(), diagnostics[i]))
+                ++failed;
+            roots[i] = reinterpret_cast<LandruNode_t*>(root);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; ++t)
+        workers.emplace_back(work);
+    work();
+    for (auto & w : workers)
+        w.join();
+
+    // reported in the order given, rather than as the files finished
+    for (size_t i = 0; i < count; ++i)
+        for (auto & d : diagnostics[i])
+            printf("%s: %s", paths[i], d.c_str());
+    return failed;
 }
 
 
@@ -1390,15 +1554,14 @@ int landruParseProgram(LandruNode_t* rootNode,
 extern "C"
 LandruNode_t* landruCreateRootNode()
 {
-    Landru::ASTNode* node = new Landru::ASTNode(kTokenProgram, "Landru");
+    Landru::ASTNode* node = Landru::ASTArena::createRoot();
     return reinterpret_cast<LandruNode_t*>(node);
 }
 
 extern "C"
 void landruReleaseRootNode(LandruNode_t* rootNode_)
 {
-    Landru::ASTNode* rootNode = reinterpret_cast<Landru::ASTNode*>(rootNode_);
-    delete rootNode;
+    Landru::ASTArena::releaseRoot(reinterpret_cast<Landru::ASTNode*>(rootNode_));
 }
 
 extern "C"
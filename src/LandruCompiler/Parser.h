@@ -5,6 +5,9 @@
 #pragma once
 
 #include "LandruCompiler/Tokens.h"
+#include <cstddef>
+#include <string>
+#include <vector>
 
 typedef char const* CurrPtr;
 typedef char const*const EndPtr;
@@ -13,6 +16,13 @@ bool peekIsLiteral(CurrPtr& curr, EndPtr end);
 int literalLength(CurrPtr& curr, EndPtr end);
 
 namespace Landru {
+    class ASTNode;
+
     TokenId getNameSpacedToken(CurrPtr& curr, EndPtr end);
     TokenId getToken(CurrPtr& curr, EndPtr end);
+
+    // Parses a program into rootNode, in a ParserContext of its own, so that
+    // it may be called on several threads at once. Returns the number of
+    // errors, whose messages are appended to diagnostics.
+    int parseProgram(ASTNode* rootNode, char const* buff, size_t len, std::vector<std::string>& diagnostics);
 }
\ No newline at end of file
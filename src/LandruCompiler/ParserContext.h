@@ -0,0 +1,78 @@
+//
+//  ParserContext.h
+//  Landru
+//
+//  The state of a parse, so that programs can be parsed concurrently on
+//  separate threads. landruParseProgram makes a context for the length of
+//  the parse and makes it current on the calling thread, where the lexer
+//  and lcRaiseError find it. The node being built is passed explicitly
+//  through the parse functions.
+//
+
+#pragma once
+
+#include "LandruCompiler/ParseExpression.h"
+#include "LandruCompiler/Tokens.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Landru {
+
+    class ASTArena;
+    class ASTNode;
+
+    class ParserContext
+    {
+    public:
+        ParserContext(char const* buff, size_t len);
+        ~ParserContext();   // restores the context that was current before
+
+        ParserContext(const ParserContext&) = delete;
+        ParserContext& operator=(const ParserContext&) = delete;
+
+        // the calling thread's innermost context, or nullptr outside a parse
+        static ParserContext* current();
+
+        // source position of the line count, advanced as parsing proceeds.
+        // The parser only backtracks within a statement, so rescans are rare.
+        struct LineCursor
+        {
+            char const* start = nullptr;
+            char const* pos = nullptr;
+            int line = 1;
+        } lineCursor;
+
+        // The token last lexed from the program, so that the usual peek and
+        // then get lexes a token once. Only positions in the program being
+        // parsed are remembered, not those in scratch buffers.
+        struct LexCache
+        {
+            char const* programStart = nullptr;
+            char const* programEnd = nullptr;
+            char const* at = nullptr;           // before any whitespace
+            char const* next = nullptr;
+            TokenId token = kTokenUnknown;
+        } lexCache;
+
+        ASTArena* arena = nullptr;             // the tree's, nodes are made in it
+
+        // scratch space for parsing expressions, kept from one to the next
+        // so that its storage is reused
+        struct Expression
+        {
+            std::vector<ExpressionToken> tokens;    // reverse polish order
+            std::vector<ExpressionToken> operators;
+            std::vector<ASTNode*> nodes;
+            std::string token;                      // NUL terminated copy of a token
+        } expression;
+
+        int errors = 0;
+        std::vector<std::string> diagnostics;  // in the order raised
+
+    private:
+        ParserContext* _previous;
+    };
+
+} // Landru
@@ -1,15 +1,19 @@
-
 // Copyright (c) 2013 Nick Porcino, All rights reserved.
 // License is MIT: http://opensource.org/licenses/MIT
 
 #include "LandruCompiler/lcRaiseError.h"
+#include "LandruCompiler/ParserContext.h"
+#include <atomic>
 #include <stdio.h>
 #include <string.h>
 
-static int errorRaised = 0;
+// errors raised outside of a parse, for example while assembling
+static std::atomic<int> errorRaised(0);
 
 int lcCurrentError() 
 { 
+	if (Landru::ParserContext* context = Landru::ParserContext::current())
+		return context->errors;
 	return errorRaised;
 }
 
@@ -21,7 +25,17 @@ void lcRaiseError(const char* msg, const char* aux, int n)
     char buff[1024];
     strncpy(buff, aux, n);
     buff[n] = '\0';
-    
+
+	// a parse's errors are reported when it finishes, so that concurrent
+	// parses don't interleave their diagnostics
+	if (Landru::ParserContext* context = Landru::ParserContext::current()) {
+		char message[1200];
+		snprintf(message, sizeof(message), "\n<--- %s: %s--->\n", msg, buff);
+		context->diagnostics.push_back(message);
+		++context->errors;
+		return;
+	}
+
 	printf("\n<--- %s: %s--->\n", msg, buff);
 	++errorRaised;
 }
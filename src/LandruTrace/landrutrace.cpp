@@ -0,0 +1,42 @@
+//
+//  landrutrace.cpp
+//  Landru
+//
+//  Decodes a binary trace written by landruc --trace, or by
+//  landruVMContextWriteTrace, into readable text.
+//
+
+#include "LandruActorVM/Trace.h"
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        printf("Usage: landru-trace <tracefile>\n");
+        return 1;
+    }
+
+    vector<Landru::TraceRecord> records;
+    vector<pair<uint32_t, string>> entries;
+    if (!Landru::readTraceFile(argv[1], records, entries)) {
+        printf("Could not read trace file %s\n", argv[1]);
+        return 1;
+    }
+
+    unordered_map<uint32_t, string> debugMap(entries.begin(), entries.end());
+
+    uint64_t start = records.size() ? records.front().ticks : 0;
+    for (auto& r : records) {
+        auto i = debugMap.find(r.addr);
+        printf("%12llu %08x %6u: %s\n",
+               static_cast<unsigned long long>(r.ticks - start), r.fiber, r.addr,
+               i != debugMap.end() ? i->second.c_str() : "?");
+    }
+    return 0;
+}
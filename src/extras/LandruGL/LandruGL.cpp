@@ -15,7 +15,7 @@ namespace {
 
     struct OnWindowClosed : public OnEventEvaluator
     {
-		explicit OnWindowClosed(GLFWwindow* w, std::shared_ptr<Fiber> f, vector<Instruction> & statements)
+		explicit OnWindowClosed(GLFWwindow* w, std::shared_ptr<Fiber> f, InstructionBlock statements)
 			: OnEventEvaluator(f, statements)
 			, window(w) {}
 
@@ -24,7 +24,7 @@ namespace {
 
 	struct OnWindowResized : public OnEventEvaluator
 	{
-		explicit OnWindowResized(GLFWwindow* w, std::shared_ptr<Fiber> f, vector<Instruction> & statements)
+		explicit OnWindowResized(GLFWwindow* w, std::shared_ptr<Fiber> f, InstructionBlock statements)
 			: OnEventEvaluator(f, statements)
 			, window(w) {}
 
@@ -33,16 +33,28 @@ namespace {
 		static void window_resized(GLFWwindow* w, int width, int height);
 	};
 
-    std::vector<GLFWwindow*> sgWindows;
-    std::vector<OnWindowClosed> sgOnWindowClosed;
-	std::vector<OnWindowResized> sgOnWindowResized;
-
 	struct PendingResize
 	{
 		GLFWwindow * window;
 		float width, height;
 	};
-	std::vector<PendingResize> sgResizes;
+
+	// the plugin's state in one VMContext. Windows point back to the
+	// instance that created them through their GLFW user pointer.
+	struct GLInstance
+	{
+		std::vector<GLFWwindow*> windows;
+		std::vector<OnWindowClosed> onWindowClosed;
+		std::vector<OnWindowResized> onWindowResized;
+		std::vector<PendingResize> resizes;
+	};
+
+	const char* kPluginName = "landru_gl";
+
+	GLInstance* instance(FnContext& run)
+	{
+		return static_cast<GLInstance*>(run.vm->pluginInstance(kPluginName));
+	}
 
     void error_callback(int error, const char* description)
     {
@@ -60,9 +72,12 @@ namespace {
 
 	void OnWindowResized::window_resized(GLFWwindow* w, int width, int height)
 	{
-		for (auto & i : sgOnWindowResized) {
+		GLInstance* gl = static_cast<GLInstance*>(glfwGetWindowUserPointer(w));
+		if (!gl)
+			return;
+		for (auto & i : gl->onWindowResized) {
 			if (i.window == w) {
-				sgResizes.push_back({ w, (float) width, (float) height });
+				gl->resizes.push_back({ w, (float) width, (float) height });
 			}
 		}
 	}
@@ -74,7 +89,6 @@ namespace {
         {
             glfwSetErrorCallback(error_callback);
             glfwInit();
-            sgWindows = std::vector<GLFWwindow*>();
         });
     }
 
@@ -94,31 +108,33 @@ namespace {
         glfwSetKeyCallback(window, key_callback);
         glfwMakeContextCurrent(window);
         glfwSwapInterval(0);
-        sgWindows.emplace_back(window);
+        GLInstance* gl = instance(run);
+        glfwSetWindowUserPointer(window, gl);
+        gl->windows.emplace_back(window);
         run.self->push<GLFWwindow*>(window);
 		return RunState::Continue;
     }
 
 	RunState windowClosed(FnContext& run)
     {
-        vector<Instruction> instr = run.self->back<vector<Instruction>>(-2);
+        InstructionBlock instr = run.self->back<InstructionBlock>(-2);
 		auto property = run.self->pop<GLFWwindow*>();
 		run.self->popVar(); // drop the instr
 		if (property)
-			sgOnWindowClosed.emplace_back(OnWindowClosed(property, run.vm->fiberPtr(run.self), instr));
+			instance(run)->onWindowClosed.emplace_back(OnWindowClosed(property, run.vm->fiberPtr(run.self), instr));
 
 		return RunState::Continue;
     }
 
 	RunState windowResized(FnContext& run)
 	{
-		vector<Instruction> instr = run.self->back<vector<Instruction>>(-2);
+		InstructionBlock instr = run.self->back<InstructionBlock>(-2);
 		auto property = run.self->pop<GLFWwindow*>();
 		run.self->popVar(); // drop the instr
 
 		if (property) {
 			glfwSetWindowSizeCallback(property, OnWindowResized::window_resized);
-			sgOnWindowResized.emplace_back(OnWindowResized(property, run.vm->fiberPtr(run.self), instr));
+			instance(run)->onWindowResized.emplace_back(OnWindowResized(property, run.vm->fiberPtr(run.self), instr));
 		}
 
 		return RunState::Continue;
@@ -157,47 +173,75 @@ void landru_gl_init(void* vl)
 
 extern "C"
 LANDRUGL_API
-RunState landru_gl_update(double now, VMContext* vm)
+int landru_gl_protocol()
+{
+    return 2;   // the callbacks take the instance
+}
+
+extern "C"
+LANDRUGL_API
+void* landru_gl_createInstance(VMContext*)
+{
+    return new GLInstance();
+}
+
+extern "C"
+LANDRUGL_API
+void landru_gl_destroyInstance(void* instance)
 {
+    GLInstance* gl = static_cast<GLInstance*>(instance);
+    for (auto w : gl->windows)
+        glfwDestroyWindow(w);
+    delete gl;
+}
+
+extern "C"
+LANDRUGL_API
+RunState landru_gl_update(void* instance, double now, VMContext* vm)
+{
+    GLInstance* gl = static_cast<GLInstance*>(instance);
     bool cullWindows;
     do {
 		cullWindows = false;
-        for (auto i = sgWindows.begin(); i != sgWindows.end(); ++i) {
+        for (auto i = gl->windows.begin(); i != gl->windows.end(); ++i) {
             if (glfwWindowShouldClose(*i)) {
-                for (auto j = sgOnWindowClosed.begin(); j != sgOnWindowClosed.end(); ++j) {
-					if (j->window == *i) {
-						FnContext fn(vm, j->fiber(), nullptr);
-						auto & instr = j->instructions();
-						fn.run(instr);
-					}
-
-                    j = sgOnWindowClosed.erase(j);
-					if (j == sgOnWindowClosed.end())
+                for (auto j = gl->onWindowClosed.begin(); j != gl->onWindowClosed.end(); ++j) {
+					if (j->window == *i)
+						vm->schedule(j->fiberPtr(), j->instructions());
+
+                    j = gl->onWindowClosed.erase(j);
+					if (j == gl->onWindowClosed.end())
 						break;
                 }
 
                 glfwDestroyWindow(*i);
-                sgWindows.erase(i);
+                gl->windows.erase(i);
                 cullWindows = true;
                 break;
             }
         }
     } while (cullWindows);
 
-	for (auto i : sgResizes) {
-		for (auto & j : sgOnWindowResized) {
+	for (auto i : gl->resizes) {
+		for (auto & j : gl->onWindowResized) {
 			if (j.window == i.window) {
-				FnContext fn(vm, j.fiber(), nullptr);
-				j.fiber()->push<float>(i.height);
-				j.fiber()->push<float>(i.width);
-				auto & instr = j.instructions();
-				fn.run(instr);
+				// the size is pushed when the statements run, not now
+				float width = i.width;
+				float height = i.height;
+				vector<Instruction> instr;
+				instr.emplace_back(Instruction([width, height](FnContext& run)->RunState {
+					run.self->push<float>(height);
+					run.self->push<float>(width);
+					return RunState::Continue;
+				}, "window resized"));
+				instr.insert(instr.end(), j.instructions()->begin(), j.instructions()->end());
+				vm->schedule(j.fiberPtr(), instr);
 			}
 		}
 	}
-	sgResizes.clear();
+	gl->resizes.clear();
 
-    for (auto w : sgWindows) {
+    for (auto w : gl->windows) {
         /// @TODO only render and swap buffers if the window needs redrawing
         /// @TODO render here
         glfwSwapBuffers(w);
@@ -216,31 +260,32 @@ void landru_gl_finish(void* vl)
 
 extern "C"
 LANDRUGL_API
-void landru_gl_fiberExpiring(Fiber* f)
+void landru_gl_fiberExpiring(void* instance, Fiber* f)
 {
 //    called when Fibers are destroyed so that pending items like onWindowsClosed can be removed
 }
 
 extern "C"
 LANDRUGL_API
-void landru_gl_clearContinuations(Fiber* f, int level)
+void landru_gl_clearContinuations(void* instance, Fiber* f, int level)
 {
 	// called when continuations must be cleared, for example before executing a goto statement
+    GLInstance* gl = static_cast<GLInstance*>(instance);
     if (!f)
-        sgOnWindowClosed.clear();
+        gl->onWindowClosed.clear();
     else
 	{
-		for (std::vector<OnWindowClosed>::iterator i = sgOnWindowClosed.begin(); i != sgOnWindowClosed.end(); ++i) {
+		for (std::vector<OnWindowClosed>::iterator i = gl->onWindowClosed.begin(); i != gl->onWindowClosed.end(); ++i) {
             if (i->fiber() == f) {
-                i = sgOnWindowClosed.erase(i);
-                if (i == sgOnWindowClosed.end())
+                i = gl->onWindowClosed.erase(i);
+                if (i == gl->onWindowClosed.end())
                     break;
             }
         }
-		for (std::vector<OnWindowResized>::iterator i = sgOnWindowResized.begin(); i != sgOnWindowResized.end(); ++i) {
+		for (std::vector<OnWindowResized>::iterator i = gl->onWindowResized.begin(); i != gl->onWindowResized.end(); ++i) {
 			if (i->fiber() == f) {
-				i = sgOnWindowResized.erase(i);
-				if (i == sgOnWindowResized.end())
+				i = gl->onWindowResized.erase(i);
+				if (i == gl->onWindowResized.end())
 					break;
 			}
 		}
@@ -249,7 +294,8 @@ void landru_gl_clearContinuations(Fiber* f, int level)
 
 extern "C"
 LANDRUGL_API
-bool landru_gl_pendingContinuations(Fiber * f)
+bool landru_gl_pendingContinuations(void* instance, Fiber * f)
 {
-	return sgOnWindowClosed.size() > 0 || sgOnWindowResized.size() > 0;
+    GLInstance* gl = static_cast<GLInstance*>(instance);
+	return gl->onWindowClosed.size() > 0 || gl->onWindowResized.size() > 0;
 }
@@ -1,8 +1,127 @@
 
 #include <Landru/Landru.h>
+#include "LandruActorVM/DebugMap.h"
+#include "LandruActorVM/Fiber.h"
+#include "LandruActorVM/MachineDefinition.h"
+#include "LandruActorVM/NativeState.h"
+#include "LandruActorVM/Profiler.h"
+#include "LandruActorVM/Property.h"
+#include "LandruActorVM/TimingWheel.h"
+#include "LandruActorVM/VMContext.h"
+#include "LandruAssembler/LandruActorAssembler.h"
+#include "LandruAssembler/Module.h"
+#include "LandruCompiler/AST.h"
+#include "LandruCompiler/Parser.h"
+#include <atomic>
+#include <cstdio>
 #include <thread>
 #include <chrono>
 
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+// A program assembled at an optimization level, and run in a context of its
+// own by the tests that follow test_declarations
+struct TestProgram
+{
+    LandruLibrary_t* library = nullptr;
+    LandruVMContext_t* vmContext = nullptr;
+    LandruNode_t* rootNode = nullptr;
+    LandruAssembler_t* assembler = nullptr;
+    Landru::VMContext* vm = nullptr;
+    Landru::ActorAssembler* laa = nullptr;
+    std::string error;      // why the program didn't parse, assemble, or run
+    double now = 0;
+
+    TestProgram(const char* source, int optLevel)
+    {
+        library = landruCreateLibrary("landru");
+        vmContext = landruCreateVMContext(library);
+        landruInitializeStdLib(library, vmContext);
+        vm = reinterpret_cast<Landru::VMContext*>(vmContext);
+        rootNode = landruCreateRootNode();
+        assembler = landruCreateAssembler(library);
+        laa = reinterpret_cast<Landru::ActorAssembler*>(assembler);
+        laa->setOptLevel(optLevel);
+        if (landruParseProgram(rootNode, source, strlen(source))) {
+            error = "the program didn't parse";
+            return;
+        }
+        landruLoadRequiredLibraries(assembler, rootNode, library, vmContext);
+        try {
+            landruAssemble(assembler, rootNode);
+        }
+        catch (std::exception& exc) {
+            error = exc.what();
+        }
+    }
+
+    ~TestProgram()
+    {
+        landruReleaseAssembler(assembler);
+        landruReleaseRootNode(rootNode);
+        landruReleaseLibrary(library);
+        landruReleaseVMContext(vmContext);
+    }
+
+    bool assembled() const { return error.empty(); }
+
+    // prepares the context, and launches the main machine
+    void launch()
+    {
+        landruInitializeContext(assembler, vmContext);
+        landruLaunchMachine(vmContext, "main");
+    }
+
+    // runs updates a millisecond apart, returning false if the program raised
+    bool update(int count = 1)
+    {
+        try {
+            for (int i = 0; i < count; ++i) {
+                vm->update(now);
+                now += 0.001;
+            }
+        }
+        catch (std::exception& exc) {
+            error = exc.what();
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    T property(const char* name, const char* machine = "main") const
+    {
+        return fiberProperty<T>(vm, name, machine);
+    }
+
+    std::string state(const char* machine = "main") const
+    {
+        auto f = fiber(vm, machine);
+        return f && f->currentState() ? f->currentState() : "";
+    }
+
+    static std::shared_ptr<Landru::Fiber> fiber(Landru::VMContext* vm, const char* machine)
+    {
+        for (auto & f : vm->fibers())
+            if (f->machineDefinition->name == machine)
+                return f;
+        return std::shared_ptr<Landru::Fiber>();
+    }
+
+    // the value of a property of the machine's fiber, or T() if it has none of that type
+    template <typename T>
+    static T fiberProperty(Landru::VMContext* vm, const char* name, const char* machine = "main")
+    {
+        auto f = fiber(vm, machine);
+        auto p = f ? vm->findInstance(f.get(), name) : std::shared_ptr<Landru::Property>();
+        if (!p || !p->data || p->data->type() != typeid(T))
+            return T();
+        return static_cast<Wires::Data<T>*>(p->data.get())->value();
+    }
+};
+
 const char* test_declarations_ws = R"landru(
 
 io = require("io")
@@ -95,8 +214,938 @@ void test_declarations()
     printf("Run successfully completed\n");
 }
 
+// line 6 is the only statement of the state the machine spins in
+const char* test_profiler_ws = R"landru(
+real = require("real")
+machine main:
+    declare: float x = 0 ;
+    state spin:
+        x = real.add(x, 1)
+        goto spin
+    ;
+    state main:
+        goto spin
+    ;
+;
+)landru";
+
+void test_profiler()
+{
+    LandruLibrary_t* library = landruCreateLibrary("landru");
+    LandruVMContext_t* vmContext = landruCreateVMContext(library);
+    landruInitializeStdLib(library, vmContext);
+
+    // samples are attributed through the DebugMap, which the assembler fills
+    landruSetDebugInfoEnabled(true);
+
+    LandruNode_t* rootNode = landruCreateRootNode();
+    CHECK(!landruParseProgram(rootNode, test_profiler_ws, strlen(test_profiler_ws)));
+    LandruAssembler_t* assembler = landruCreateAssembler(library);
+    landruLoadRequiredLibraries(assembler, rootNode, library, vmContext);
+    landruAssemble(assembler, rootNode);
+    landruInitializeContext(assembler, vmContext);
+    landruLaunchMachine(vmContext, "main");
+
+    // the machine never stops, so it is preempted to return from each update
+    landruVMContextSetFiberBudget(vmContext, 10000, 0);
+    landruVMContextStartProfiler(vmContext, 100);
+    using namespace std::chrono;
+    auto start = steady_clock::now();
+    double now = 0;
+    while (steady_clock::now() - start < milliseconds(200)) {
+        landruUpdate(vmContext, now);
+        now += 0.001;
+    }
+    landruVMContextStopProfiler(vmContext);
+
+    Landru::VMContext* vm = reinterpret_cast<Landru::VMContext*>(vmContext);
+    uint64_t samples = 0;
+    uint64_t instructions = 0;
+    for (auto & e : vm->profiler().report(Landru::DebugMap::shared())) {
+        if (e.machine == "main" && e.state == "spin" && e.line == 6) {
+            samples += e.samples;
+            instructions += e.instructions;
+        }
+    }
+    printf("Profiled %llu samples and %llu instructions on main;spin;6\n",
+           (unsigned long long) samples, (unsigned long long) instructions);
+    CHECK(instructions > 0);
+    CHECK(samples > 0);
+    CHECK(samples <= vm->profiler().samples());
+
+    landruSetDebugInfoEnabled(false);
+    landruReleaseAssembler(assembler);
+    landruReleaseRootNode(rootNode);
+    landruReleaseLibrary(library);
+    landruReleaseVMContext(vmContext);
+}
+
+// the first timer of a batch cancels the others, which must not fire
+void test_timing_wheel_cancel()
+{
+    typedef Landru::TimingWheel<int> Wheel;
+    Wheel wheel(1.e-3, 0);
+    Wheel::Handle handles[3];
+    for (int i = 0; i < 3; ++i)
+        handles[i] = wheel.schedule(0.01, i);
+    Wheel::Handle later = wheel.schedule(0.02, 3);
+
+    std::vector<int> fired;
+    wheel.advance(0.01, [&](Wheel::Handle, int& value, double) {
+        fired.push_back(value);
+        if (value == 0) {
+            CHECK(wheel.cancel(handles[1]));
+            CHECK(wheel.cancel(handles[2]));
+            CHECK(!wheel.cancel(handles[2]));
+            CHECK(!wheel.valid(handles[1]));
+        }
+    });
+    CHECK(fired.size() == 1 && fired[0] == 0);
+    CHECK(wheel.size() == 1);
+
+    // the cancelled nodes are reused without disturbing the pending timer
+    Wheel::Handle reused[3];
+    for (int i = 0; i < 3; ++i)
+        reused[i] = wheel.schedule(0.03, 4 + i);
+    CHECK(wheel.size() == 4);
+    CHECK(wheel.valid(later));
+    CHECK(!wheel.valid(handles[1]) && !wheel.valid(handles[2]));
+
+    fired.clear();
+    wheel.advance(0.03, [&](Wheel::Handle, int& value, double) { fired.push_back(value); });
+    CHECK(fired == std::vector<int>({ 3, 4, 5, 6 }));
+    CHECK(wheel.empty());
+    printf("Timing wheel cancellation %s\n", fired.size() == 4 ? "succeeded" : "failed");
+}
+
+const char* test_module_ws = R"landru(
+io = require("io")
+machine main:
+    declare: int n = 3 ;
+    state main:
+        io.print("n ", n, "\n")
+        goto done
+    ;
+    state done:
+    ;
+;
+)landru";
+
+static std::vector<char> readFile(const char* path)
+{
+    std::vector<char> bytes;
+    if (FILE* f = fopen(path, "rb")) {
+        char buff[4096];
+        size_t n;
+        while ((n = fread(buff, 1, sizeof(buff), f)) > 0)
+            bytes.insert(bytes.end(), buff, buff + n);
+        fclose(f);
+    }
+    return bytes;
+}
+
+static void writeFile(const char* path, const std::vector<char>& bytes)
+{
+    if (FILE* f = fopen(path, "wb")) {
+        fwrite(bytes.data(), 1, bytes.size(), f);
+        fclose(f);
+    }
+}
+
+// writes a module, reads it back, then damages copies of it
+void test_module()
+{
+    using namespace Landru;
+    int before = failures;
+    LandruLibrary_t* library = landruCreateLibrary("landru");
+    LandruVMContext_t* vmContext = landruCreateVMContext(library);
+    landruInitializeStdLib(library, vmContext);
+
+    LandruNode_t* rootNode = landruCreateRootNode();
+    CHECK(!landruParseProgram(rootNode, test_module_ws, strlen(test_module_ws)));
+    LandruAssembler_t* assembler = landruCreateAssembler(library);
+    landruLoadRequiredLibraries(assembler, rootNode, library, vmContext);
+    landruAssemble(assembler, rootNode);
+    ActorAssembler* laa = reinterpret_cast<ActorAssembler*>(assembler);
+    ASTNode* root = reinterpret_cast<ASTNode*>(rootNode);
+
+    const char* path = "landru-test.lmod";
+    CHECK(writeModule(path, root, laa->assembledMachineDefinitions(), 2));
+
+    std::string error;
+    {
+        Module module;
+        CHECK(module.open(path, error));
+        CHECK(module.header().optLevel == 2);
+        CHECK(module.requires() == std::vector<std::string>({ "io" }));
+        auto hashes = module.sourceHashes();
+        CHECK(hashes.size() == 1 && hashes["main"] == laa->assembledMachineDefinitions().at("main")->sourceHash);
+        ASTNode* loaded = module.createRoot();
+        CHECK(loaded->contentHash() == root->contentHash());
+        ASTArena::releaseRoot(loaded);
+    }
+
+    std::vector<char> bytes = readFile(path);
+    CHECK(bytes.size() > sizeof(ModuleFormat::Header));
+    auto rejects = [path, &error](const std::vector<char>& damaged) {
+        writeFile(path, damaged);
+        Module module;
+        error.clear();
+        return !module.open(path, error) && !error.empty();
+    };
+
+    std::vector<char> damaged = bytes;
+    damaged[0] = 'X';
+    CHECK(rejects(damaged));
+    CHECK(error == "not a Landru module");
+
+    damaged = bytes;
+    reinterpret_cast<ModuleFormat::Header*>(damaged.data())->version = ModuleFormat::kVersion + 1;
+    CHECK(rejects(damaged));
+
+    damaged = bytes;
+    reinterpret_cast<ModuleFormat::Header*>(damaged.data())->optLevel = 99;
+    CHECK(rejects(damaged));
+
+    damaged.assign(bytes.begin(), bytes.end() - 8);
+    CHECK(rejects(damaged));
+    CHECK(error == "the module is truncated or corrupt");
+
+    damaged = bytes;
+    damaged.back() ^= 0x5a;
+    CHECK(rejects(damaged));
+    CHECK(error == "the module is truncated or corrupt");
+
+    // the tables are outside the hashed content, so only their checks catch this
+    damaged = bytes;
+    reinterpret_cast<ModuleFormat::Header*>(damaged.data())->nodes.count += 1000;
+    CHECK(rejects(damaged));
+    CHECK(error == "the module's tables are malformed");
+
+    remove(path);
+    printf("Module round trip and corruption checks %s\n", failures == before ? "succeeded" : "failed");
+
+    landruReleaseAssembler(assembler);
+    landruReleaseRootNode(rootNode);
+    landruReleaseLibrary(library);
+    landruReleaseVMContext(vmContext);
+}
+
+// at opt level 3, waiting is only reached by a goto and is kept, while
+// unused is never reached and idle is never launched
+const char* test_reachability_ws = R"landru(
+io = require("io")
+machine idle:
+    state main:
+        io.print("idle\n")
+    ;
+;
+machine main:
+    state main:
+        goto waiting
+    ;
+    state waiting:
+        io.print("waiting\n")
+    ;
+    state unused:
+        io.print("unused\n")
+    ;
+;
+)landru";
+
+void test_reachability()
+{
+    using namespace Landru;
+    int before = failures;
+    LandruLibrary_t* library = landruCreateLibrary("landru");
+    LandruVMContext_t* vmContext = landruCreateVMContext(library);
+    landruInitializeStdLib(library, vmContext);
+
+    LandruNode_t* rootNode = landruCreateRootNode();
+    CHECK(!landruParseProgram(rootNode, test_reachability_ws, strlen(test_reachability_ws)));
+    LandruAssembler_t* assembler = landruCreateAssembler(library);
+    ActorAssembler* laa = reinterpret_cast<ActorAssembler*>(assembler);
+    laa->setOptLevel(3);
+    landruLoadRequiredLibraries(assembler, rootNode, library, vmContext);
+    landruAssemble(assembler, rootNode);
+
+    auto & definitions = laa->assembledMachineDefinitions();
+    CHECK(definitions.size() == 1 && definitions.count("main"));
+    if (definitions.count("main")) {
+        auto & states = definitions.at("main")->states;
+        CHECK(states.count("main") && states.count("waiting"));
+        CHECK(!states.count("unused"));
+    }
+
+    auto warned = [laa](const char* text) {
+        for (auto & w : laa->warnings())
+            if (w.find(text) != std::string::npos)
+                return true;
+        return false;
+    };
+    CHECK(laa->warnings().size() == 2);
+    CHECK(warned("machine idle is never launched"));
+    CHECK(warned("state unused of machine main is unreachable"));
+    CHECK(!warned("waiting"));
+    printf("Reachability %s\n", failures == before ? "succeeded" : "failed");
+
+    landruReleaseAssembler(assembler);
+    landruReleaseRootNode(rootNode);
+    landruReleaseLibrary(library);
+    landruReleaseVMContext(vmContext);
+}
+
+// the goto ends the state on the first pass through the loop, whether the
+// state is interpreted or run natively
+const char* test_for_each_goto_ws = R"landru(
+real = require("real")
+int = require("int")
+machine main:
+    declare:
+        int visits = 0
+        int after = 0
+    ;
+    state main:
+        for i in real.range(0, 4):
+            visits = int.add(visits, 1)
+            goto done
+        ;
+        after = 1
+    ;
+    state done:
+    ;
+;
+)landru";
+
+namespace {
+    using namespace Landru;
+    using namespace Landru::Native;
+
+    // main.main as landruc --emit-cpp translates it
+    const CallSite forEachGotoCallSites[] = {
+        { "", "real", "range" },
+        { "", "int", "add" },
+    };
+    ActorFn forEachGotoFns[2];
+
+    RunState main_main_1(FnContext& run)
+    {
+        RunState rs = RunState::Continue;
+        pushInstance(run, "visits");
+        pushInt(run, 1);
+        if ((rs = forEachGotoFns[1](run)) != RunState::Continue && rs != RunState::Yield) return rs;
+        storeInstance(run, "visits");
+        return gotoState(run, "done");
+        return rs;
+    }
+
+    RunState main_main_2(FnContext& run)
+    {
+        RunState rs = RunState::Continue;
+        pushFloat(run, 0x0p+0f);
+        pushFloat(run, 0x1p+2f);
+        if ((rs = forEachGotoFns[0](run)) != RunState::Continue && rs != RunState::Yield) return rs;
+        if ((rs = forEach(run, main_main_1)) != RunState::Continue && rs != RunState::Yield) return rs;
+        pushInt(run, 1);
+        storeInstance(run, "after");
+        return rs;
+    }
+
+    void forEachGotoNativeStates(NativeStates* states, Library* library)
+    {
+        resolve(library, forEachGotoCallSites, forEachGotoFns, 2);
+        states->add("main", "main", main_main_2);
+    }
+}
+
+void test_for_each_goto()
+{
+    int before = failures;
+    for (bool native : { false, true }) {
+        TestProgram program(test_for_each_goto_ws, 1);
+        CHECK(program.assembled());
+        if (native) {
+            Landru::LandruRequire plugin;
+            plugin.name = "test_for_each_goto";
+            plugin.nativeStates = forEachGotoNativeStates;
+            program.vm->addPlugin(plugin);
+        }
+        program.launch();
+        CHECK(program.update(2));
+        CHECK(program.state() == "done");
+        CHECK(program.property<int>("visits") == 1);
+        CHECK(program.property<int>("after") == 0);
+    }
+    printf("Goto in a for each loop %s\n", failures == before ? "succeeded" : "failed");
+}
+
+// Gotos inside the nested frames of an on clause, an if, and a for each
+// loop end the state; statements after them, in any frame, don't run.
+const char* test_nested_goto_ws = R"landru(
+real = require("real")
+int = require("int")
+time = require("time")
+machine main:
+    declare:
+        int visits = 0
+        int fired = 0
+        int after = 0
+    ;
+    state main:
+        if (2 > 1):
+            for i in real.range(0, 4):
+                visits = int.add(visits, 1)
+                if (i > 0):
+                    goto waiting
+                ;
+            ;
+            after = int.add(after, 1)
+        ;
+        after = int.add(after, 1)
+    ;
+    state waiting:
+        on time.every(0.001):
+            fired = int.add(fired, 1)
+            goto done
+            after = int.add(after, 1)
+        ;
+        after = int.add(after, 10)
+    ;
+    state done:
+    ;
+;
+)landru";
+
+// A yield at the back-edge of the inner loop suspends three frames deep,
+// and the fiber resumes in the inner loop, with the outer loop's and the
+// state's remaining statements still to run.
+const char* test_nested_yield_ws = R"landru(
+real = require("real")
+int = require("int")
+machine main:
+    declare:
+        float sum = 0
+        int rows = 0
+        int after = 0
+    ;
+    state main:
+        for i in real.range(0, 50):
+            for j in real.range(0, 4):
+                sum = real.add(sum, j)
+            ;
+            rows = int.add(rows, 1)
+        ;
+        after = int.add(after, 1)
+    ;
+;
+)landru";
+
+void test_nested_frames()
+{
+    int before = failures;
+    for (int optLevel : { 0, 2 }) {
+        TestProgram program(test_nested_goto_ws, optLevel);
+        CHECK(program.assembled());
+        program.launch();
+        CHECK(program.update());
+        CHECK(program.state() == "waiting");
+        CHECK(program.property<int>("visits") == 2);
+        CHECK(program.property<int>("after") == 10);
+        CHECK(program.update(10));
+        CHECK(program.state() == "done");
+        CHECK(program.property<int>("fired") == 1);
+        CHECK(program.property<int>("after") == 10);
+    }
+
+    for (int optLevel : { 0, 2 }) {
+        TestProgram program(test_nested_yield_ws, optLevel);
+        CHECK(program.assembled());
+        landruVMContextSetFiberBudget(program.vmContext, 20, 0);
+        program.launch();
+        CHECK(program.update());
+        CHECK(program.vm->suspendedFibersPending());
+        CHECK(program.property<int>("rows") < 50);
+        int updates = 1;
+        while (program.vm->suspendedFibersPending() && updates < 1000) {
+            CHECK(program.update());
+            ++updates;
+        }
+        CHECK(updates > 2);
+        CHECK(program.property<float>("sum") == 300);
+        CHECK(program.property<int>("rows") == 50);
+        CHECK(program.property<int>("after") == 1);
+    }
+    printf("Gotos and yields in nested frames %s\n", failures == before ? "succeeded" : "failed");
+}
+
+// Folds the literal arithmetic, fuses the arithmetic on locals, and drops
+// the dead initial store to j. The store of 5 to j is only read by the on
+// clause, after the state has run, so it has to stay.
+const char* test_optimizer_ws = R"landru(
+real = require("real")
+int = require("int")
+time = require("time")
+machine main:
+    declare:
+        float x = 0
+        float y = 0
+        int n = 0
+        int seen = 0
+    ;
+    state main:
+        declare:
+            float a = 3
+            float b = 0.5
+            int j = 1
+            int p = 7
+            int q = 2
+        ;
+        j = 5
+        x = real.add(2 * 3 * 4, a * b)
+        y = real.add(a * b / b, a / b)
+        n = int.add(p / q, q * 6)
+        on time.after(0.002):
+            seen = int.add(j, 0)
+        ;
+    ;
+;
+)landru";
+
+void test_optimizer()
+{
+    int before = failures;
+    TestProgram unoptimized(test_optimizer_ws, 0);
+    TestProgram optimized(test_optimizer_ws, 2);
+    CHECK(unoptimized.assembled() && optimized.assembled());
+    printf("Optimizer instructions %zu at level 0, %zu at level 2\n",
+           unoptimized.laa->instructionCount(), optimized.laa->instructionCount());
+    CHECK(optimized.laa->instructionCount() < unoptimized.laa->instructionCount());
+
+    for (TestProgram* program : { &unoptimized, &optimized }) {
+        program->launch();
+        CHECK(program->update(10));
+    }
+    CHECK(optimized.property<float>("x") == 25.5f);
+    CHECK(optimized.property<float>("y") == 9);
+    CHECK(optimized.property<int>("n") == 15);
+    CHECK(optimized.property<int>("seen") == 5);
+    CHECK(optimized.property<float>("x") == unoptimized.property<float>("x"));
+    CHECK(optimized.property<float>("y") == unoptimized.property<float>("y"));
+    CHECK(optimized.property<int>("n") == unoptimized.property<int>("n"));
+    CHECK(optimized.property<int>("seen") == unoptimized.property<int>("seen"));
+    printf("Optimizer %s\n", failures == before ? "succeeded" : "failed");
+}
+
+// p / 2 is specialized to int division, as the literal is integral
+const char* test_type_inference_ws = R"landru(
+real = require("real")
+int = require("int")
+machine main:
+    declare:
+        int i = 0
+        int j = 0
+        float x = 0
+        float y = 0
+    ;
+    state main:
+        declare:
+            int p = 7
+            int q = 2
+            float a = 3
+            float b = 0.5
+        ;
+        i = int.add(p / q, p % q)
+        j = int.add(p / 2, p * 3)
+        x = real.add(a / b, a * b)
+        y = real.add(a / 2, 0)
+    ;
+;
+)landru";
+
+// an int operand can't be mixed with a float variable, nor passed as a float
+const char* test_type_errors_ws[] = {
+R"landru(
+real = require("real")
+machine main:
+    declare: float x = 0 ;
+    state main:
+        declare:
+            int p = 7
+            float a = 3
+        ;
+        x = real.add(p * a, 0)
+    ;
+;
+)landru",
+R"landru(
+int = require("int")
+machine main:
+    declare: int i = 0 ;
+    state main:
+        declare: float a = 3 ;
+        i = int.add(a / 2, 1)
+    ;
+;
+)landru",
+};
+
+void test_type_inference()
+{
+    int before = failures;
+    TestProgram unoptimized(test_type_inference_ws, 0);
+    TestProgram optimized(test_type_inference_ws, 2);
+    for (TestProgram* program : { &unoptimized, &optimized }) {
+        CHECK(program->assembled());
+        program->launch();
+        CHECK(program->update());
+        CHECK(program->property<int>("i") == 4);
+        CHECK(program->property<int>("j") == 24);
+        CHECK(program->property<float>("x") == 7.5f);
+        CHECK(program->property<float>("y") == 1.5f);
+    }
+    CHECK(optimized.property<int>("i") == unoptimized.property<int>("i"));
+    CHECK(optimized.property<int>("j") == unoptimized.property<int>("j"));
+    CHECK(optimized.property<float>("x") == unoptimized.property<float>("x"));
+    CHECK(optimized.property<float>("y") == unoptimized.property<float>("y"));
+
+    // the errors are raised by the assembler, before anything runs
+    for (const char* source : test_type_errors_ws) {
+        TestProgram program(source, 0);
+        CHECK(!program.assembled());
+        CHECK(program.error.find("Type error") != std::string::npos);
+        CHECK(program.laa->assembledMachineDefinitions().empty());
+    }
+    printf("Type inference %s\n", failures == before ? "succeeded" : "failed");
+}
+
+// pad's method is called through its slot, and g's on whichever context
+// is running the shared instructions
+const char* test_contexts_ws = R"landru(
+real = require("real")
+declare:
+    float g = 1
+;
+machine main:
+    declare:
+        float pad = 2
+        float seen = 0
+        float read = 0
+    ;
+    state main:
+        pad = pad.add(1)
+        seen = g.add(0)
+        read = real.add(g, 0)
+        goto main
+    ;
+;
+)landru";
+
+// two contexts run the same assembly at once, each with its own g
+void test_contexts()
+{
+    int before = failures;
+    TestProgram program(test_contexts_ws, 2);
+    CHECK(program.assembled());
+    program.launch();
+
+    Landru::VMContext second(program.vm->libs);
+    landruInitializeContext(program.assembler, reinterpret_cast<LandruVMContext_t*>(&second));
+    auto g = second.findGlobal("g");
+    CHECK(g && g->data);
+    auto own = std::make_shared<Landru::Property>(g->name, g->type, g->typeFactory());
+    static_cast<Wires::Data<float>*>(own->data.get())->setValue(5);
+    second.storeGlobal("g", own);
+    second.launchQueue.push(Landru::VMContext::LaunchRecord("main", Landru::Fiber::Stack()));
+
+    // the machines never stop, so they're preempted to return from each update
+    std::vector<float> seen[2];
+    std::vector<float> read[2];
+    Landru::VMContext* contexts[2] = { program.vm, &second };
+    std::thread threads[2];
+    for (int i = 0; i < 2; ++i) {
+        contexts[i]->setFiberBudget(100, 0);
+        threads[i] = std::thread([i, &contexts, &seen, &read]() {
+            for (int u = 0; u < 200; ++u) {
+                contexts[i]->update(u * 0.001);
+                seen[i].push_back(TestProgram::fiberProperty<float>(contexts[i], "seen"));
+                read[i].push_back(TestProgram::fiberProperty<float>(contexts[i], "read"));
+            }
+        });
+    }
+    for (auto & t : threads)
+        t.join();
+
+    CHECK(seen[0] == std::vector<float>(200, 1.f));
+    CHECK(read[0] == std::vector<float>(200, 1.f));
+    CHECK(seen[1] == std::vector<float>(200, 5.f));
+    CHECK(read[1] == std::vector<float>(200, 5.f));
+    CHECK(TestProgram::fiberProperty<float>(program.vm, "pad") > 3);
+    CHECK(TestProgram::fiberProperty<float>(&second, "pad") > 3);
+    printf("Globals of two contexts %s\n", failures == before ? "succeeded" : "failed");
+}
+
+// the reload changes the state's body, and changed from an int to a float
+const char* test_reload_ws[] = {
+R"landru(
+int = require("int")
+time = require("time")
+machine main:
+    declare:
+        int kept = 0
+        int changed = 7
+        int version = 0
+    ;
+    state main:
+        version = int.add(1, 0)
+        kept = int.add(kept, 1)
+        on time.after(0.002):
+            goto main
+        ;
+    ;
+;
+)landru",
+R"landru(
+int = require("int")
+time = require("time")
+machine main:
+    declare:
+        int kept = 0
+        float changed = 2.5
+        int version = 0
+    ;
+    state main:
+        version = int.add(2, 0)
+        kept = int.add(kept, 10)
+        on time.after(0.002):
+            goto main
+        ;
+    ;
+;
+)landru",
+};
+
+void test_reload()
+{
+    int before = failures;
+    TestProgram program(test_reload_ws[0], 1);
+    CHECK(program.assembled());
+    program.launch();
+    CHECK(program.update(10));
+    int kept = program.property<int>("kept");
+    CHECK(kept > 1);
+    CHECK(program.property<int>("version") == 1);
+    CHECK(program.property<int>("changed") == 7);
+    auto fiber = TestProgram::fiber(program.vm, "main");
+
+    LandruNode_t* rootNode = landruCreateRootNode();
+    CHECK(!landruParseProgram(rootNode, test_reload_ws[1], strlen(test_reload_ws[1])));
+    CHECK(landruReloadMachines(program.library, program.vmContext, rootNode) == 1);
+    landruReleaseRootNode(rootNode);
+
+    // the fiber keeps running the old definition until its next goto
+    CHECK(program.vm->definition("main") != fiber->machineDefinition);
+    CHECK(program.property<int>("version") == 1);
+    int updates = 0;
+    while (program.property<int>("version") == 1 && updates++ < 10)
+        CHECK(program.update());
+
+    CHECK(TestProgram::fiber(program.vm, "main") == fiber);
+    CHECK(fiber->machineDefinition == program.vm->definition("main"));
+    CHECK(program.property<int>("version") == 2);
+    CHECK(program.property<int>("kept") == kept + 10);
+    CHECK(program.property<float>("changed") == 2.5f);
+    printf("Reload %s\n", failures == before ? "succeeded" : "failed");
+}
+
+// the syntax errors are reported with the marker that follows them
+const char* test_parse_error_ws = R"landru(
+io = require("io")
+machine main:
+    state main:
+        io.print "marker-%d"
+    ;
+;
+)landru";
+
+// Parses the other tests' programs on several threads at once, each thread
+// also parsing a bad program of its own. Every parse has its own context,
+// so each sees only its own diagnostics, and builds the same trees as a
+// parse on its own.
+void test_parallel_parse()
+{
+    int before = failures;
+    const char* sources[] = {
+        test_declarations_ws, test_nested_goto_ws, test_nested_yield_ws, test_optimizer_ws,
+        test_type_inference_ws, test_contexts_ws, test_reload_ws[0], test_reload_ws[1],
+    };
+    const size_t count = sizeof(sources) / sizeof(sources[0]);
+    uint64_t hashes[count];
+    for (size_t i = 0; i < count; ++i) {
+        Landru::ASTNode* root = Landru::ASTArena::createRoot();
+        std::vector<std::string> diagnostics;
+        CHECK(!Landru::parseProgram(root, sources[i], strlen(sources[i]), diagnostics));
+        hashes[i] = root->contentHash();
+        Landru::ASTArena::releaseRoot(root);
+    }
+
+    const int threads = 4;
+    std::atomic<int> ready(0);
+    std::atomic<int> mismatches(0);
+    std::vector<std::string> diagnostics[threads];
+    int errors[threads] = {};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            char bad[256];
+            snprintf(bad, sizeof(bad), test_parse_error_ws, t);
+            for (++ready; ready < threads; )
+                std::this_thread::yield();
+            for (int pass = 0; pass < 10; ++pass) {
+                for (size_t i = 0; i < count; ++i) {
+                    Landru::ASTNode* root = Landru::ASTArena::createRoot();
+                    std::vector<std::string> none;
+                    if (Landru::parseProgram(root, sources[i], strlen(sources[i]), none) || !none.empty() ||
+                        root->contentHash() != hashes[i])
+                        ++mismatches;
+                    Landru::ASTArena::releaseRoot(root);
+
+                    if (i == count / 2) {
+                        root = Landru::ASTArena::createRoot();
+                        errors[t] += Landru::parseProgram(root, bad, strlen(bad), diagnostics[t]);
+                        Landru::ASTArena::releaseRoot(root);
+                    }
+                }
+            }
+        });
+    }
+    for (auto & w : workers)
+        w.join();
+
+    CHECK(mismatches == 0);
+    for (int t = 0; t < threads; ++t) {
+        CHECK(errors[t] >= 10);
+        CHECK(errors[t] == int(diagnostics[t].size()));
+        char mine[32];
+        snprintf(mine, sizeof(mine), "marker-%d", t);
+        int own = 0;
+        for (auto & d : diagnostics[t]) {
+            if (d.find(mine) != std::string::npos)
+                ++own;
+            for (int other = 0; other < threads; ++other) {
+                char theirs[32];
+                snprintf(theirs, sizeof(theirs), "marker-%d", other);
+                CHECK(other == t || d.find(theirs) == std::string::npos);
+            }
+        }
+        CHECK(own == errors[t]);
+    }
+
+    // a batch of files, one of them bad, parsed by a pool of threads
+    std::vector<std::string> paths;
+    for (size_t i = 0; i <= count; ++i) {
+        char path[64];
+        snprintf(path, sizeof(path), "landru-test-%zu.lan", i);
+        paths.push_back(path);
+        const char* text = i < count ? sources[i] : test_parse_error_ws;
+        writeFile(path, std::vector<char>(text, text + strlen(text)));
+    }
+    std::vector<const char*> names;
+    for (auto & p : paths)
+        names.push_back(p.c_str());
+    std::vector<LandruNode_t*> roots(names.size());
+    CHECK(landruParseFiles(names.data(), names.size(), roots.data(), threads) == 1);
+    for (size_t i = 0; i < roots.size(); ++i) {
+        CHECK(roots[i] != nullptr);
+        if (i < count && roots[i])
+            CHECK(reinterpret_cast<Landru::ASTNode*>(roots[i])->contentHash() == hashes[i]);
+        if (roots[i])
+            landruReleaseRootNode(roots[i]);
+        remove(names[i]);
+    }
+    printf("Parallel parsing %s\n", failures == before ? "succeeded" : "failed");
+}
+
+// main leaves its state on its third tap, while counter counts every tap
+const char* test_host_events_ws = R"landru(
+host = require("host")
+int = require("int")
+machine counter:
+    declare: int taps = 0 ;
+    state main:
+        on host.event("tap"):
+            taps = int.add(taps, 1)
+        ;
+    ;
+;
+machine main:
+    declare: int taps = 0 ;
+    state main:
+        launch("counter")
+        on host.event("tap"):
+            taps = int.add(taps, 1)
+            if (taps > 2):
+                goto done
+            ;
+        ;
+    ;
+    state done:
+    ;
+;
+)landru";
+
+// batches posted from another thread while the context updates
+void test_host_events()
+{
+    int before = failures;
+    TestProgram program(test_host_events_ws, 1);
+    CHECK(program.assembled());
+    int tap = landruRegisterEventType(program.vmContext, "tap", 1);
+    CHECK(tap >= 0);
+    program.launch();
+    CHECK(program.update(2));
+
+    // main unsubscribes partway through the batch, by going to done
+    const float taps[5] = { 1, 2, 3, 4, 5 };
+    std::thread poster([&]() { CHECK(landruPostEvents(program.vmContext, tap, taps, 5)); });
+    poster.join();
+    CHECK(program.update());
+    CHECK(program.property<int>("taps") == 3);
+    CHECK(program.property<int>("taps", "counter") == 5);
+    CHECK(program.update());
+    CHECK(program.state() == "done");
+
+    std::atomic<bool> posting(true);
+    poster = std::thread([&]() {
+        for (int i = 0; i < 50; ++i) {
+            CHECK(landruPostEvents(program.vmContext, tap, taps, 2));
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        posting = false;
+    });
+    while (posting)
+        CHECK(program.update());
+    poster.join();
+    CHECK(program.update());
+    CHECK(!program.vm->postedEventsPending());
+    CHECK(program.property<int>("taps") == 3);
+    CHECK(program.property<int>("taps", "counter") == 105);
+    printf("Host events %s\n", failures == before ? "succeeded" : "failed");
+}
+
 int main(int argc, char** argv)
 {
     test_declarations();
-    return 0;
+    test_profiler();
+    test_timing_wheel_cancel();
+    test_module();
+    test_reachability();
+    test_for_each_goto();
+    test_nested_frames();
+    test_optimizer();
+    test_type_inference();
+    test_contexts();
+    test_reload();
+    test_parallel_parse();
+    test_host_events();
+    return failures ? 1 : 0;
 }